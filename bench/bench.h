@@ -0,0 +1,68 @@
+/* Copyright (c) 2016-2023, The C++ IPFS client library developers
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#ifndef IPFS_BENCH_BENCH_H
+#define IPFS_BENCH_BENCH_H
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+namespace ipfs {
+
+namespace bench {
+
+/** Run `run` once to warm up and then `iterations` times, and print the
+ * average time per iteration, plus the throughput if `bytes_per_op` is given. */
+inline void measure(
+    /** [in] Label to print in front of the result. */
+    const std::string& label,
+    /** [in] Number of timed iterations. */
+    size_t iterations,
+    /** [in] Code to measure. */
+    const std::function<void()>& run,
+    /** [in] Number of bytes that one iteration transfers, 0 if not relevant. */
+    size_t bytes_per_op = 0) {
+  run();
+
+  const auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < iterations; ++i) {
+    run();
+  }
+  const std::chrono::duration<double, std::micro> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  std::cout << std::left << std::setw(40) << label << std::right
+            << std::setw(12) << std::fixed << std::setprecision(1)
+            << elapsed.count() / iterations << " us/op";
+  if (bytes_per_op > 0) {
+    std::cout << std::setw(12)
+              << bytes_per_op * iterations / elapsed.count() * 1e6 / (1 << 20)
+              << " MiB/s";
+  }
+  std::cout << std::endl;
+}
+
+} /* namespace bench */
+} /* namespace ipfs */
+
+#endif /* IPFS_BENCH_BENCH_H */
@@ -0,0 +1,95 @@
+/* Copyright (c) 2016-2023, The C++ IPFS client library developers
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+/* Compare saving a big file to disk through an std::fstream with writing it
+ * straight to a file descriptor (FilesGetToFd()).
+ *
+ * Usage: bench_fd_sink <ipfs path> <output file> [port] [iterations] */
+
+#include <fcntl.h>
+#include <ipfs/client.h>
+#include <ipfs/http/fd-sink.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include "bench.h"
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    std::cerr << "Usage: " << argv[0]
+              << " <ipfs path> <output file> [port] [iterations]" << std::endl;
+    return 1;
+  }
+  const std::string path = argv[1];
+  const std::string output = argv[2];
+  const long port = argc > 3 ? std::atol(argv[3]) : 5001;
+  const size_t iterations = argc > 4 ? std::atol(argv[4]) : 3;
+
+  try {
+    ipfs::Client client("localhost", port);
+
+    /* Learn the size of the file, for the throughput. */
+    size_t size = 0;
+    {
+      std::fstream file(output, std::ios::out | std::ios::trunc |
+                                    std::ios::binary);
+      client.FilesGet(path, &file);
+      size = static_cast<size_t>(file.tellp());
+    }
+
+    ipfs::bench::measure(
+        "fstream",
+        iterations,
+        [&]() {
+          std::fstream file(output, std::ios::out | std::ios::trunc |
+                                        std::ios::binary);
+          client.FilesGet(path, &file);
+        },
+        size);
+
+    for (bool drop_cache : {false, true}) {
+      ipfs::http::FdSinkOptions options;
+      options.expected_size = size;
+      options.drop_cache = drop_cache;
+      ipfs::bench::measure(
+          drop_cache ? "fd, drop cache" : "fd",
+          iterations,
+          [&]() {
+            const int fd =
+                open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd == -1) {
+              throw std::runtime_error("Can't open " + output);
+            }
+            client.FilesGetToFd(path, fd, options);
+            close(fd);
+          },
+          size);
+    }
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
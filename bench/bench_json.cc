@@ -0,0 +1,174 @@
+/* Copyright (c) 2016-2023, The C++ IPFS client library developers
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+/* Measure how fast the responses of `pin/ls`, `swarm/peers` and `dag/get` are
+ * parsed. Every response is fetched once from the daemon and then replayed
+ * from memory, so that the network does not count. The response is handed to
+ * the sink of the call in one piece, like a transport that streams it does
+ * chunk by chunk, so the throughput is that of the parse plus one copy of the
+ * body. Build with "-DWITH_SIMDJSON=ON" to compare the JSON parsers.
+ *
+ * Usage: bench_json [port] [iterations] */
+
+#include <ipfs/client.h>
+#include <ipfs/http/transport-curl.h>
+
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+
+/** Transport that fetches every URL once, and then answers it from memory. */
+class ReplayTransport : public ipfs::http::Transport {
+ public:
+  std::unique_ptr<Transport> Clone() const override {
+    throw std::logic_error("ReplayTransport can't be copied");
+  }
+
+  void Fetch(const std::string& url,
+             const std::vector<ipfs::http::FileUpload>& files,
+             std::iostream* response) override {
+    const std::string& body = Replay(url, files);
+    response->write(body.data(), body.size());
+  }
+
+  void Fetch(const std::string& url,
+             const std::vector<ipfs::http::FileUpload>& files,
+             ipfs::http::ResponseSink* sink,
+             const ipfs::http::FetchOptions&) override {
+    const std::string& body = Replay(url, files);
+    sink->OnBegin(body.size());
+    sink->OnData(body.data(), body.size());
+    sink->OnEnd();
+  }
+
+  void StopFetch() override {}
+
+  void ResetFetch() override {}
+
+  void UrlEncode(const std::string& raw, std::string* encoded) override {
+    live_.UrlEncode(raw, encoded);
+  }
+
+  /** @return Size of the last response. */
+  size_t LastSize() const { return last_size_; }
+
+ private:
+  /** @return The response to a URL, fetched from the daemon the first
+   * time. */
+  const std::string& Replay(const std::string& url,
+                            const std::vector<ipfs::http::FileUpload>& files) {
+    auto recorded = responses_.find(url);
+    if (recorded == responses_.end()) {
+      std::stringstream body;
+      live_.Fetch(url, files, &body);
+      recorded = responses_.emplace(url, body.str()).first;
+    }
+    last_size_ = recorded->second.size();
+    return recorded->second;
+  }
+
+  /** Transport to the daemon, for the first fetch of every URL. */
+  ipfs::http::TransportCurl live_{false};
+
+  /** The responses, by URL. */
+  std::map<std::string, std::string> responses_;
+
+  /** Size of the last response. */
+  size_t last_size_ = 0;
+};
+
+int main(int argc, char** argv) {
+  const long port = argc > 1 ? std::atol(argv[1]) : 5001;
+  const size_t iterations = argc > 2 ? std::atol(argv[2]) : 20;
+
+  try {
+    /* A DAG node with some bulk, for dag/get. */
+    ipfs::Client live("localhost", port);
+    ipfs::Json node;
+    for (int i = 0; i < 5000; ++i) {
+      node["entries"].push_back(
+          {{"name", "file-" + std::to_string(i) + ".txt"},
+           {"size", i * 1031},
+           {"mtime", 1.7e9 + i / 7.0},
+           {"tags", {"bench", i % 2 == 0 ? "even" : "odd"}}});
+    }
+    std::string cid;
+    live.DagPut(&node, false, &cid);
+
+    auto transport = std::make_unique<ReplayTransport>();
+    ReplayTransport* replay = transport.get();
+    ipfs::Client client(std::move(transport), "localhost", port);
+
+#ifdef IPFS_WITH_SIMDJSON
+    std::cout << "JSON parser: simdjson" << std::endl;
+#else
+    std::cout << "JSON parser: nlohmann::json" << std::endl;
+#endif
+
+    /* Record the response and measure the call on it. */
+    auto measure = [&](const std::string& label,
+                       const std::function<void()>& run) {
+      run();
+      const size_t size = replay->LastSize();
+      ipfs::bench::measure(label + ", " + std::to_string(size >> 10) + " KiB",
+                           iterations, run, size);
+    };
+
+    /* The arena is reused: emptied before every call, once the previous
+     * result is gone. */
+    std::pmr::monotonic_buffer_resource arena;
+    ipfs::ArenaJson arena_json;
+    auto in_arena = [&](const std::function<void()>& call) {
+      return [&, call]() {
+        arena_json = nullptr;
+        arena.release();
+        call();
+      };
+    };
+
+    ipfs::Json json;
+    measure("PinLs into Json", [&]() { client.PinLs(&json); });
+    measure("PinLs into ArenaJson",
+            in_arena([&]() { client.PinLs(&arena, &arena_json); }));
+    std::vector<ipfs::PinInfo> pins;
+    measure("PinLs into PinInfo", [&]() { client.PinLs(&pins); });
+    measure("SwarmPeers into Json", [&]() { client.SwarmPeers(&json); });
+    measure("SwarmPeers into ArenaJson",
+            in_arena([&]() { client.SwarmPeers(&arena, &arena_json); }));
+    std::vector<ipfs::PeerInfo> peers;
+    measure("SwarmPeers into PeerInfo", [&]() { client.SwarmPeers(&peers); });
+    measure("DagGet into Json", [&]() { client.DagGet(cid, &json); });
+    measure("DagGet into ArenaJson",
+            in_arena([&]() { client.DagGet(cid, &arena, &arena_json); }));
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,91 @@
+/* Copyright (c) 2016-2023, The C++ IPFS client library developers
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+/* Compare the latency of `block/get` over a Unix domain socket with loopback
+ * TCP. The daemon has to listen on both, eg. with
+ *   ipfs config --json Addresses.API \
+ *     '["/ip4/127.0.0.1/tcp/5001", "/unix/tmp/ipfs-api.sock"]'
+ *
+ * Usage: bench_unix_socket <socket path> [port] [iterations] */
+
+#include <ipfs/client.h>
+#include <ipfs/http/transport-curl.h>
+
+#include <cstdlib>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    std::cerr << "Usage: " << argv[0] << " <socket path> [port] [iterations]"
+              << std::endl;
+    return 1;
+  }
+  const std::string socket_path = argv[1];
+  const long port = argc > 2 ? std::atol(argv[2]) : 5001;
+  const size_t iterations = argc > 3 ? std::atol(argv[3]) : 2000;
+
+  try {
+    ipfs::Client tcp("localhost", port);
+
+    auto transport = std::make_unique<ipfs::http::TransportCurl>(false);
+    transport->SetUnixSocketPath(socket_path);
+    ipfs::Client unix_socket(std::move(transport), "localhost", port);
+
+    ipfs::Json block;
+    tcp.BlockPut({"block.bin", ipfs::http::FileUpload::Type::kFileContents,
+                  std::string(4096, 'b')},
+                 &block);
+    const std::string cid = block["Key"];
+
+    for (auto* entry : {&tcp, &unix_socket}) {
+      ipfs::Client& client = *entry;
+      const std::string name = entry == &tcp ? "tcp" : "unix";
+
+      ipfs::bench::measure(name + " block/get", iterations, [&]() {
+        std::stringstream contents;
+        client.BlockGet(cid, &contents);
+      });
+
+      ipfs::bench::measure(name + " block/get, 64 in flight", iterations / 64,
+                           [&]() {
+                             std::vector<std::stringstream> contents(64);
+                             std::vector<std::future<void>> requests;
+                             for (auto& c : contents) {
+                               requests.push_back(client.BlockGetAsync(cid, &c));
+                             }
+                             for (auto& request : requests) {
+                               request.get();
+                             }
+                           });
+    }
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
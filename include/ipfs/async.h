@@ -0,0 +1,305 @@
+/* Copyright (c) 2016-2023, The C++ IPFS client library developers
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#ifndef IPFS_ASYNC_H
+#define IPFS_ASYNC_H
+
+#include <chrono>
+#include <coroutine>
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+namespace ipfs {
+
+/** Result of an asynchronous `Client` call.
+ *
+ * It can be used as a `std::future<void>` (`get()`, `wait()`, ... or converted
+ * to one) or be `co_await`-ed from a C++20 coroutine:
+ * @snippet test_async.cc ipfs::Task
+ *
+ * An awaiting coroutine is resumed on the thread that completed the call, which
+ * is the transport's background thread (or the thread that runs the event loop,
+ * see `http::TransportCurl::SetEventLoop()`). That thread drives all the
+ * outstanding transfers, so the code between two `co_await`s should be short
+ * and must not block.
+ *
+ * @since version 0.8.0 */
+class AsyncResult {
+ private:
+  struct State;
+
+ public:
+  /** Completes an `AsyncResult`, used by the side that runs the call. */
+  class Completion {
+   public:
+    /** Make the result ready and resume the coroutine that awaits it, if any.
+     * Must be called exactly once. */
+    void operator()(
+        /** [in] Error of the call, `nullptr` on success. */
+        std::exception_ptr error) const;
+
+   private:
+    friend class AsyncResult;
+
+    explicit Completion(std::shared_ptr<State> state);
+
+    std::shared_ptr<State> state_;
+  };
+
+  /** Create a result that is not ready yet, along with its completion. */
+  static std::pair<AsyncResult, Completion> Create();
+
+  /** Wait for the call to finish.
+   * @throw std::exception the error of the call, if any */
+  void get();
+
+  /** Wait for the call to finish, without throwing its error. */
+  void wait() const;
+
+  /** Wait for the call to finish for at most `duration`.
+   * @return Whether the call has finished, see `std::future::wait_for()`. */
+  template <class Rep, class Period>
+  std::future_status wait_for(
+      /** [in] Maximum time to wait. */
+      const std::chrono::duration<Rep, Period>& duration) const {
+    return future_.wait_for(duration);
+  }
+
+  /** Check whether the result refers to a call, see `std::future::valid()`. */
+  bool valid() const;
+
+  /** Convert to a plain `std::future`, which takes over the result. */
+  operator std::future<void>() &&;
+
+  /** @name Awaitable interface for `co_await`.
+   * @{ */
+  bool await_ready() const;
+  bool await_suspend(std::coroutine_handle<> awaiting);
+  void await_resume();
+  /** @} */
+
+ private:
+  AsyncResult(std::shared_ptr<State> state, std::future<void> future);
+
+  /** Shared between the result and its completion. */
+  struct State {
+    /** Makes the future ready. */
+    std::promise<void> promise;
+
+    /** Protects `done` and `awaiting`. */
+    std::mutex mutex;
+
+    /** Whether the completion has run. */
+    bool done = false;
+
+    /** Coroutine to resume on completion, if any. */
+    std::coroutine_handle<> awaiting;
+  };
+
+  std::shared_ptr<State> state_;
+
+  std::future<void> future_;
+};
+
+template <typename T>
+class Task;
+
+namespace detail {
+
+/** Parts of the promise of a `Task` that do not depend on its value type. */
+class TaskPromiseBase {
+ public:
+  std::suspend_always initial_suspend() noexcept { return {}; }
+
+  /** Hand over to the awaiting coroutine, without growing the stack. */
+  struct FinalAwaiter {
+    bool await_ready() noexcept { return false; }
+
+    template <typename Promise>
+    std::coroutine_handle<> await_suspend(
+        std::coroutine_handle<Promise> finished) noexcept {
+      return finished.promise().continuation_;
+    }
+
+    void await_resume() noexcept {}
+  };
+
+  FinalAwaiter final_suspend() noexcept { return {}; }
+
+  void unhandled_exception() { error_ = std::current_exception(); }
+
+ protected:
+  template <typename T>
+  friend class ipfs::Task;
+
+  std::coroutine_handle<> continuation_ = std::noop_coroutine();
+
+  std::exception_ptr error_;
+};
+
+template <typename T>
+class TaskPromise : public TaskPromiseBase {
+ public:
+  Task<T> get_return_object();
+
+  template <typename U>
+  void return_value(U&& value) {
+    value_.emplace(std::forward<U>(value));
+  }
+
+  T Result() {
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+    return std::move(*value_);
+  }
+
+ private:
+  std::optional<T> value_;
+};
+
+template <>
+class TaskPromise<void> : public TaskPromiseBase {
+ public:
+  Task<void> get_return_object();
+
+  void return_void() {}
+
+  void Result() {
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+  }
+};
+
+/** Coroutine that runs to completion on its own, used by `Task::Start()`. */
+struct Detached {
+  struct promise_type {
+    Detached get_return_object() { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+} /* namespace detail */
+
+/** Minimal lazy coroutine type to chain asynchronous `Client` calls with
+ * `co_await`.
+ *
+ * A task does not run until it is awaited by another task or started with
+ * `Start()`. An exception that escapes the coroutine is rethrown to whoever
+ * awaits it.
+ *
+ * An example usage:
+ * @snippet test_async.cc ipfs::Task
+ *
+ * @since version 0.8.0 */
+template <typename T = void>
+class Task {
+ public:
+  using promise_type = detail::TaskPromise<T>;
+
+  Task(Task&& other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+
+  Task& operator=(Task&& other) noexcept {
+    if (this != &other) {
+      if (handle_) {
+        handle_.destroy();
+      }
+      handle_ = std::exchange(other.handle_, {});
+    }
+    return *this;
+  }
+
+  ~Task() {
+    if (handle_) {
+      handle_.destroy();
+    }
+  }
+
+  /** Run the task without awaiting it, eg. from `main()` or a thread that is
+   * not a coroutine.
+   * @return Future with the value of the task or the exception that escaped
+   * it. */
+  std::future<T> Start() && {
+    auto promise = std::make_shared<std::promise<T>>();
+    std::future<T> future = promise->get_future();
+    Run(std::move(*this), std::move(promise));
+    return future;
+  }
+
+  /** @name Awaitable interface for `co_await`.
+   * @{ */
+  bool await_ready() const noexcept { return false; }
+
+  std::coroutine_handle<> await_suspend(
+      std::coroutine_handle<> awaiting) noexcept {
+    handle_.promise().continuation_ = awaiting;
+    return handle_;
+  }
+
+  T await_resume() { return handle_.promise().Result(); }
+  /** @} */
+
+ private:
+  friend class detail::TaskPromise<T>;
+
+  explicit Task(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+
+  static detail::Detached Run(Task task,
+                              std::shared_ptr<std::promise<T>> promise) {
+    try {
+      if constexpr (std::is_void_v<T>) {
+        co_await task;
+        promise->set_value();
+      } else {
+        promise->set_value(co_await task);
+      }
+    } catch (...) {
+      promise->set_exception(std::current_exception());
+    }
+  }
+
+  std::coroutine_handle<promise_type> handle_;
+};
+
+namespace detail {
+
+template <typename T>
+Task<T> TaskPromise<T>::get_return_object() {
+  return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() {
+  return Task<void>(
+      std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+} /* namespace detail */
+
+} /* namespace ipfs */
+
+#endif /* IPFS_ASYNC_H */
@@ -20,11 +20,19 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
 #ifndef IPFS_CLIENT_H
 #define IPFS_CLIENT_H
 
+#include <ipfs/async.h>
+#include <ipfs/http/fd-sink.h>
 #include <ipfs/http/transport.h>
+#include <ipfs/json-arena.h>
 
+#include <cstdint>
+#include <functional>
+#include <future>
 #include <iostream>
 #include <memory>
+#include <memory_resource>
 #include <nlohmann/json.hpp>
+#include <sstream>
 #include <string>
 #include <utility>
 #include <vector>
@@ -36,6 +44,114 @@ namespace ipfs {
  * @see https://github.com/nlohmann/json */
 using Json = nlohmann::json;
 
+/** Function that is handed the records of a response that consists of one JSON
+ * per line, each one as soon as it has arrived. It is called from the thread
+ * that runs the transfer, an exception thrown from it fails the call with it.
+ * @since version 0.8.0 */
+using JsonRecordCallback = std::function<void(const Json& record)>;
+
+/** Like `JsonRecordCallback`, but returns false to end the call early, which
+ * ends the transfer and stops the work on the daemon.
+ * @since version 0.8.0 */
+using JsonRecordVisitor = std::function<bool(const Json& record)>;
+
+/** How an object is pinned, see `Client::PinLs()`.
+ * @since version 0.8.0 */
+enum class PinType : uint8_t {
+  /** Pinned by itself, without its descendants. */
+  kDirect,
+  /** Pinned as a descendant of a recursively pinned object. */
+  kIndirect,
+  /** Pinned together with all its descendants. */
+  kRecursive,
+  /** A type that this version of the library does not know. */
+  kOther,
+};
+
+/** A pinned object, see `Client::PinLs()`.
+ * @since version 0.8.0 */
+struct PinInfo {
+  /** Id of the object (CID). */
+  std::string cid;
+
+  /** How it is pinned. */
+  PinType type = PinType::kOther;
+};
+
+/** Function that is handed the pinned objects one by one, see
+ * `Client::PinLs()`. Returns false to end the listing early.
+ * @since version 0.8.0 */
+using PinVisitor = std::function<bool(const PinInfo& pin)>;
+
+/** Information about a raw IPFS block, see `Client::BlockStat()`.
+ * @since version 0.8.0 */
+struct BlockStatResult {
+  /** Id of the block (CID). */
+  std::string cid;
+
+  /** Size of the block in bytes. */
+  uint64_t size = 0;
+};
+
+/** Type of a Unix filesystem object, see `LsEntry`.
+ * @since version 0.8.0 */
+enum class FileType : uint8_t {
+  /** A file. */
+  kFile,
+  /** A directory. */
+  kDirectory,
+  /** A symbolic link. */
+  kSymlink,
+  /** A type that this version of the library does not know. */
+  kOther,
+};
+
+/** An entry of a directory, see `Client::FilesLs()`.
+ * @since version 0.8.0 */
+struct LsEntry {
+  /** Name of the entry in the directory. */
+  std::string name;
+
+  /** Id of the object (multihash). */
+  std::string hash;
+
+  /** Size in bytes, 0 for a directory. */
+  uint64_t size = 0;
+
+  /** What the object is. */
+  FileType type = FileType::kOther;
+};
+
+/** A peer that we have a connection with, see `Client::SwarmPeers()`.
+ * @since version 0.8.0 */
+struct PeerInfo {
+  /** Address of the connection, eg. `"/ip4/104.131.131.82/tcp/4001"`. */
+  std::string addr;
+
+  /** Id of the peer. */
+  std::string peer;
+
+  /** Latency to the peer as the daemon formats it, eg. `"23.4ms"`, empty if
+   * it is not known yet. */
+  std::string latency;
+};
+
+/** IPFS bandwidth information, see `Client::StatsBw()`.
+ * @since version 0.8.0 */
+struct BandwidthInfo {
+  /** Bytes received so far. */
+  uint64_t total_in = 0;
+
+  /** Bytes sent so far. */
+  uint64_t total_out = 0;
+
+  /** Bytes received per second, recently. */
+  double rate_in = 0;
+
+  /** Bytes sent per second, recently. */
+  double rate_out = 0;
+};
+
 /** IPFS client.
  *
  * It implements the interface described in
@@ -44,6 +160,17 @@ using Json = nlohmann::json;
  * The methods of this class may throw some variant of `std::exception` if a
  * connectivity error occurs or if the response cannot be parsed. Be prepared!
  *
+ * All methods (except the constructors, the destructor and the assignment
+ * operators) are thread-safe, so a single client can be shared between
+ * threads instead of making a copy per thread:
+ * @snippet test_threading.cc ipfs::Client::Client__shared
+ *
+ * Every method also has an asynchronous twin with an `Async` suffix. It returns
+ * an `AsyncResult` (a future that can also be `co_await`-ed) right away and
+ * lets the transport run many requests at once, so a single thread can keep
+ * hundreds of them outstanding. The result holds the exception that the
+ * blocking method would have thrown, if any.
+ *
  * @since version 0.1.0 */
 class Client {
  public:
@@ -68,6 +195,29 @@ class Client {
       /** [in] [Optional] Enable cURL Verbose Mode (default: false) */
       bool verbose = false);
 
+  /** Constructor with a custom transport, for example a `TransportCurl` that
+   * talks to the daemon over a Unix domain socket. `host` and `port` are then
+   * only used to build the request URLs.
+   *
+   * An example usage:
+   * @snippet test_generic.cc ipfs::Client::Client__transport
+   *
+   * @since version 0.8.0 */
+  Client(
+      /** [in] Transport to send all requests through. */
+      std::unique_ptr<http::Transport> transport,
+      /** [in] Hostname or IP address of the server to connect to. */
+      const std::string& host = "localhost",
+      /** [in] Port to connect to. */
+      long port = 5001,
+      /** [in] [Optional] set server-side time-out, which should be string (eg.
+         "6s") */
+      const std::string& timeout = "",
+      /** [in] [Optional] protocol (default: http://) */
+      const std::string& protocol = "http://",
+      /** [in] [Optional] API Path (default: /api/v0) */
+      const std::string& apiPath = "/api/v0");
+
   /** Copy-constructor. */
   Client(
       /** [in] Other client connection to be copied. */
@@ -94,6 +244,24 @@ class Client {
    * @since version 0.1.0 */
   ~Client();
 
+  /** Return a client whose calls are made with the given settings, for example
+   * a token to cancel them with. Unlike a copy, the returned client shares the
+   * transport (and thus the connections) of this one, so it is cheap to make
+   * one per call:
+   * @snippet test_threading.cc ipfs::Client::WithOptions
+   *
+   * With a deadline, the time that is left until it is sent to the daemon as
+   * the `timeout` argument of each call, instead of the time-out given to the
+   * constructor:
+   * @snippet test_threading.cc ipfs::Client::WithOptions__deadline
+   *
+   * @return Client that uses `options` for all its calls.
+   *
+   * @since version 0.8.0 */
+  Client WithOptions(
+      /** [in] Settings of the calls, see `http::FetchOptions`. */
+      const http::FetchOptions& options) const;
+
   /** Return the identity of the peer.
    *
    * Implements
@@ -177,6 +345,9 @@ class Client {
       const Json& config);
 
   /** Retrieve the peer info of a reachable node in the network.
+   *
+   * Returns as soon as the peer's addresses have arrived, which ends the DHT
+   * query on the daemon, too.
    *
    * Implements
    * https://github.com/ipfs/js-ipfs/blob/master/docs/core-api/DHT.md#dhtfindpeer.
@@ -210,6 +381,61 @@ class Client {
       /** [out] List of providers of `hash`. */
       Json* providers);
 
+  /** Retrieve the providers for a content that is addressed by a hash, and
+   * hand over each record of the response as soon as the DHT query has
+   * produced it, instead of collecting all of them first.
+   *
+   * An example usage:
+   * @snippet test_dht.cc ipfs::Client::DhtFindProvs__records
+   *
+   * @throw std::exception if any error occurs
+   *
+   * @since version 0.8.0 */
+  void DhtFindProvs(
+      /** [in] Multihash whose providers to find. */
+      const std::string& hash,
+      /** [in] Called with every record, like one element of the list of the
+       * other overload. */
+      const JsonRecordCallback& on_record);
+
+  /** Retrieve the first providers for a content that is addressed by a hash.
+   * Returns as soon as `num_providers` of them have turned up, which ends
+   * the DHT query on the daemon, too.
+   *
+   * An example usage:
+   * @snippet test_dht.cc ipfs::Client::DhtFindProvs__first
+   *
+   * @throw std::exception if any error occurs
+   *
+   * @since version 0.8.0 */
+  void DhtFindProvs(
+      /** [in] Multihash whose providers to find. */
+      const std::string& hash,
+      /** [in] Number of providers to find, 0 for the daemon's default. */
+      size_t num_providers,
+      /** [out] List of the providers, for example:
+       * [{"ID": "QmZSb7...", "Addrs": ["/ip4/1.2.3.4/tcp/4001", ...]}, ...]
+       */
+      Json* providers);
+
+  /** Retrieve the providers for a content that is addressed by a hash, and
+   * hand over each one as soon as the DHT query has found it, until
+   * `on_provider` returns false or `num_providers` have turned up. Then the
+   * DHT query ends on the daemon, too, so the caller can start to fetch from
+   * the first providers while it would still be running.
+   *
+   * @throw std::exception if any error occurs
+   *
+   * @since version 0.8.0 */
+  void DhtFindProvs(
+      /** [in] Multihash whose providers to find. */
+      const std::string& hash,
+      /** [in] Number of providers to find, 0 for the daemon's default. */
+      size_t num_providers,
+      /** [in] Called with every provider, like one element of the list of
+       * the other overload. Returns false to stop. */
+      const JsonRecordVisitor& on_provider);
+
   /** Get a raw IPFS block.
    *
    * Implements
@@ -228,6 +454,22 @@ class Client {
        * retrieved. */
       std::iostream* block);
 
+  /** Get a raw IPFS block and hand it to a sink as it is retrieved, without
+   * buffering it.
+   *
+   * An example usage:
+   * @snippet test_block.cc ipfs::Client::BlockGet__sink
+   *
+   * @throw std::exception if any error occurs
+   *
+   * @since version 0.8.0 */
+  void BlockGet(
+      /** [in] Id of the block (multihash). */
+      const std::string& block_id,
+      /** [in] Consumer of the raw contents of the block. It may end the
+       * transfer early, see `http::ResponseSink`. */
+      http::ResponseSink* block);
+
   /** Store a raw block in IPFS.
    *
    * Implements
@@ -262,6 +504,19 @@ class Client {
       /** [out] Retrieved information about the block. */
       Json* stat);
 
+  /** Get information for a raw IPFS block, like the `Json` overload, but
+   * into a struct. The fields are parsed straight from the response, without
+   * building a `Json` for it.
+   *
+   * @throw std::exception if any error occurs
+   *
+   * @since version 0.8.0 */
+  void BlockStat(
+      /** [in] Id of the block (multihash). */
+      const std::string& block_id,
+      /** [out] Retrieved information about the block. */
+      BlockStatResult* stat);
+
   /** Get a file from IPFS.
    *
    * Implements
@@ -281,6 +536,40 @@ class Client {
        * from IPFS. */
       std::iostream* response);
 
+  /** Get a file from IPFS and hand it to a sink as it is retrieved, without
+   * buffering it. Suits files that are too big to keep in memory.
+   *
+   * An example usage:
+   * @snippet test_files.cc ipfs::Client::FilesGet__sink
+   *
+   * @throw std::exception if any error occurs
+   *
+   * @since version 0.8.0 */
+  void FilesGet(
+      /** [in] Path of the file in IPFS. */
+      const std::string& path,
+      /** [in] Consumer of the file's contents. It may end the transfer early,
+       * see `http::ResponseSink`. */
+      http::ResponseSink* response);
+
+  /** Get a file from IPFS and write it to a file descriptor, see
+   * `http::FdSink`.
+   *
+   * An example usage:
+   * @snippet test_files.cc ipfs::Client::FilesGetToFd
+   *
+   * @throw std::exception if any error occurs
+   *
+   * @since version 0.8.0 */
+  void FilesGetToFd(
+      /** [in] Path of the file in IPFS. */
+      const std::string& path,
+      /** [in] File descriptor to write the file's contents to, starting at its
+       * current offset. It is not closed. */
+      int fd,
+      /** [in] [Optional] Buffering and file system hints. */
+      const http::FdSinkOptions& options = {});
+
   /** Add files to IPFS.
    *
    * Implements
@@ -300,6 +589,24 @@ class Client {
        */
       Json* result);
 
+  /** Add files to IPFS, and hand over each progress record of the response as
+   * soon as it has arrived, instead of collecting the results first. Useful
+   * for adds of many files.
+   *
+   * An example usage:
+   * @snippet test_files.cc ipfs::Client::FilesAdd__records
+   *
+   * @throw std::exception if any error occurs
+   *
+   * @since version 0.8.0 */
+  void FilesAdd(
+      /** [in] List of files to add. */
+      const std::vector<http::FileUpload>& files,
+      /** [in] Called with every record, for example
+       * `{"Name": "foo.txt", "Bytes": 123}` while a file is being added, and
+       * `{"Name": "foo.txt", "Hash": "Qm...", "Size": "131"}` once it is. */
+      const JsonRecordCallback& on_record);
+
   /** List directory contents for Unix filesystem objects.
    *
    * Implements
@@ -343,6 +650,37 @@ class Client {
       */
       Json* result);
 
+  /** List directory contents for Unix filesystem objects, like the
+   * `Json` overload, but with every node and string of the result allocated
+   * from `arena`. See the `ArenaJson` `PinLs()`.
+   *
+   * @throw std::exception if any error occurs
+   *
+   * @since version 0.8.0 */
+  void FilesLs(
+      /** [in] The path to an IPFS object. */
+      const std::string& path,
+      /** [in] Memory resource to allocate the result from. It must outlive
+       * the result. */
+      std::pmr::memory_resource* arena,
+      /** [out] List of results (files). */
+      ArenaJson* json);
+
+  /** List the entries of a directory, like the `Json` overload, but into a
+   * list of structs. The fields are parsed straight from the response,
+   * without building a `Json` for it. The elements already in the list are
+   * overwritten in place, so a list that is passed in again and again does
+   * not allocate once it has grown to size.
+   *
+   * @throw std::exception if any error occurs
+   *
+   * @since version 0.8.0 */
+  void FilesLs(
+      /** [in] The path to an IPFS object. */
+      const std::string& path,
+      /** [out] Entries of the directory, empty if `path` is a file. */
+      std::vector<LsEntry>* entries);
+
   /** Generate a new key.
    *
    * Implements
@@ -491,6 +829,52 @@ class Client {
       /** [out] List of pinned objects. */
       Json* pinned);
 
+  /** List all the objects pinned to local storage, like the `Json`
+   * overload, but with every node and string of the result allocated from
+   * `arena`. That is typically a `std::pmr::monotonic_buffer_resource` that
+   * is released as a whole.
+   *
+   * An example usage:
+   * @snippet test_pin.cc ipfs::ArenaScope
+   *
+   * @throw std::exception if any error occurs
+   *
+   * @since version 0.8.0 */
+  void PinLs(
+      /** [in] Memory resource to allocate the result from. It must outlive
+       * the result. */
+      std::pmr::memory_resource* arena,
+      /** [out] List of pinned objects. */
+      ArenaJson* pinned);
+
+  /** List all the objects pinned to local storage, handing over each one as
+   * soon as the daemon has streamed it. Every record is parsed straight into
+   * a `PinInfo` that is reused for the next one, without building a `Json`
+   * for it, so the memory use stays the same however many objects are pinned.
+   *
+   * An example usage:
+   * @snippet test_pin.cc ipfs::Client::PinLs__visitor
+   *
+   * @throw std::exception if any error occurs
+   *
+   * @since version 0.8.0 */
+  void PinLs(
+      /** [in] Called with every pinned object, which is only valid during the
+       * call. Returns false to stop. */
+      const PinVisitor& on_pin);
+
+  /** List all the objects pinned to local storage into a compact list: the id
+   * of each object and a one byte tag for its type, with none of the overhead
+   * of a `Json`. Parsed as the daemon streams it, like the `PinVisitor`
+   * overload.
+   *
+   * @throw std::exception if any error occurs
+   *
+   * @since version 0.8.0 */
+  void PinLs(
+      /** [out] List of pinned objects. */
+      std::vector<PinInfo>* pins);
+
   /** List the objects pinned under a specific hash.
    *
    * Implements
@@ -552,6 +936,35 @@ class Client {
       /** [out] Resultant CAR */
       std::iostream* output);
 
+  /** Export node as CAR and hand it to a sink as it is retrieved, without
+   * buffering it.
+   *
+   * An example usage:
+   * @snippet test_dag.cc ipfs::Client::DagExport__sink
+   *
+   * @throw std::exception if any error occurs
+   *
+   * @since version 0.8.0 */
+  void DagExport(
+      /** [in] Root node ID */
+      const std::string& cid,
+      /** [in] Consumer of the resultant CAR */
+      http::ResponseSink* output);
+
+  /** Export node as CAR and write it to a file descriptor, see `http::FdSink`.
+   *
+   * @throw std::exception if any error occurs
+   *
+   * @since version 0.8.0 */
+  void DagExportToFd(
+      /** [in] Root node ID */
+      const std::string& cid,
+      /** [in] File descriptor to write the CAR to, starting at its current
+       * offset. It is not closed. */
+      int fd,
+      /** [in] [Optional] Buffering and file system hints. */
+      const http::FdSinkOptions& options = {});
+
   /** Add a CAR to the node repo
    *
    * Implements
@@ -607,6 +1020,22 @@ class Client {
       /** [out] DAG-JSON object */
       Json* data);
 
+  /** Get the data field of a MerkleDAG node, like the `Json` overload, but
+   * with every node and string of the result allocated from `arena`. See the
+   * `ArenaJson` `PinLs()`.
+   *
+   * @throw std::exception if any error occurs
+   *
+   * @since version 0.8.0 */
+  void DagGet(
+      /** [in] IPFS path */
+      const std::string& path,
+      /** [in] Memory resource to allocate the result from. It must outlive
+       * the result. */
+      std::pmr::memory_resource* arena,
+      /** [out] DAG-JSON object */
+      ArenaJson* data);
+
   /** Get the CID and remaining path of the node at the end of a given IPFS path
    *
    * Implements
@@ -681,6 +1110,17 @@ class Client {
        */
       Json* bandwidth_info);
 
+  /** Get IPFS bandwidth information, like the `Json` overload, but into a
+   * struct. The fields are parsed straight from the response, without
+   * building a `Json` for it.
+   *
+   * @throw std::exception if any error occurs
+   *
+   * @since version 0.8.0 */
+  void StatsBw(
+      /** [out] The bandwidth information. */
+      BandwidthInfo* bandwidth_info);
+
   /** Get IPFS Repo Stats.
    *
    * Implements
@@ -768,6 +1208,807 @@ class Client {
       /** [out] The retrieved list. */
       Json* peers);
 
+  /** List the peers that we have connections with, like the `Json`
+   * overload, but with every node and string of the result allocated from
+   * `arena`. See the `ArenaJson` `PinLs()`.
+   *
+   * @throw std::exception if any error occurs
+   *
+   * @since version 0.8.0 */
+  void SwarmPeers(
+      /** [in] Memory resource to allocate the result from. It must outlive
+       * the result. */
+      std::pmr::memory_resource* arena,
+      /** [out] The retrieved list. */
+      ArenaJson* peers);
+
+  /** List the peers that we have connections with, like the `Json`
+   * overload, but into a list of structs. The fields are parsed straight from
+   * the response, without building a `Json` for it. The elements already in
+   * the list are overwritten in place, so polling into the same list does not
+   * allocate once it has grown to size.
+   *
+   * An example usage:
+   * @snippet test_swarm.cc ipfs::Client::SwarmPeers__typed
+   *
+   * @throw std::exception if any error occurs
+   *
+   * @since version 0.8.0 */
+  void SwarmPeers(
+      /** [out] The retrieved list, with the latencies. */
+      std::vector<PeerInfo>* peers);
+
+  /** Asynchronous version of `Id()`.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult IdAsync(
+      /** [out] See `Id()`. Must stay valid until the call has finished. */
+      Json* id,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `Version()`.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult VersionAsync(
+      /** [out] See `Version()`. Must stay valid until the call has finished. */
+      Json* version,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `ConfigGet()`.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult ConfigGetAsync(
+      /** [in] See `ConfigGet()`. */
+      const std::string& key,
+      /** [out] See `ConfigGet()`. Must stay valid until the call has
+       * finished. */
+      Json* config,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `ConfigSet()`.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult ConfigSetAsync(
+      /** [in] See `ConfigSet()`. */
+      const std::string& key,
+      /** [in] See `ConfigSet()`. */
+      const Json& value,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `ConfigReplace()`.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult ConfigReplaceAsync(
+      /** [in] See `ConfigReplace()`. */
+      const Json& config,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `DhtFindPeer()`.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult DhtFindPeerAsync(
+      /** [in] See `DhtFindPeer()`. */
+      const std::string& peer_id,
+      /** [out] See `DhtFindPeer()`. Must stay valid until the call has
+       * finished. */
+      Json* addresses,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `DhtFindProvs()`.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult DhtFindProvsAsync(
+      /** [in] See `DhtFindProvs()`. */
+      const std::string& hash,
+      /** [out] See `DhtFindProvs()`. Must stay valid until the call has
+       * finished. */
+      Json* providers,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `DhtFindProvs()` with a callback per record.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult DhtFindProvsAsync(
+      /** [in] See `DhtFindProvs()`. */
+      const std::string& hash,
+      /** [in] See `DhtFindProvs()`. */
+      JsonRecordCallback on_record,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `DhtFindProvs()` for the first providers.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult DhtFindProvsAsync(
+      /** [in] See `DhtFindProvs()`. */
+      const std::string& hash,
+      /** [in] See `DhtFindProvs()`. */
+      size_t num_providers,
+      /** [out] See `DhtFindProvs()`. Must stay valid until the call has
+       * finished. */
+      Json* providers,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `DhtFindProvs()` with a callback per provider.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult DhtFindProvsAsync(
+      /** [in] See `DhtFindProvs()`. */
+      const std::string& hash,
+      /** [in] See `DhtFindProvs()`. */
+      size_t num_providers,
+      /** [in] See `DhtFindProvs()`. */
+      JsonRecordVisitor on_provider,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `BlockGet()`.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult BlockGetAsync(
+      /** [in] See `BlockGet()`. */
+      const std::string& block_id,
+      /** [out] See `BlockGet()`. Must stay valid until the call has
+       * finished. */
+      std::iostream* block,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `BlockGet()` with a sink.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult BlockGetAsync(
+      /** [in] See `BlockGet()`. */
+      const std::string& block_id,
+      /** [in] See `BlockGet()`. It is called from the transport's thread and
+       * must stay valid until the call has finished. */
+      http::ResponseSink* block,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `BlockPut()`.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult BlockPutAsync(
+      /** [in] See `BlockPut()`. */
+      const http::FileUpload& block,
+      /** [out] See `BlockPut()`. Must stay valid until the call has
+       * finished. */
+      Json* stat,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `BlockStat()`.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult BlockStatAsync(
+      /** [in] See `BlockStat()`. */
+      const std::string& block_id,
+      /** [out] See `BlockStat()`. Must stay valid until the call has
+       * finished. */
+      Json* stat,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `BlockStat()`.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult BlockStatAsync(
+      /** [in] See `BlockStat()`. */
+      const std::string& block_id,
+      /** [out] See `BlockStat()`. Must stay valid until the call has
+       * finished. */
+      BlockStatResult* stat,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `FilesGet()`.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult FilesGetAsync(
+      /** [in] See `FilesGet()`. */
+      const std::string& path,
+      /** [out] See `FilesGet()`. Must stay valid until the call has
+       * finished. */
+      std::iostream* response,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `FilesGet()` with a sink.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult FilesGetAsync(
+      /** [in] See `FilesGet()`. */
+      const std::string& path,
+      /** [in] See `FilesGet()`. It is called from the transport's thread and
+       * must stay valid until the call has finished. */
+      http::ResponseSink* response,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `FilesGetToFd()`.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult FilesGetToFdAsync(
+      /** [in] See `FilesGetToFd()`. */
+      const std::string& path,
+      /** [in] See `FilesGetToFd()`. Must stay open until the call has finished. */
+      int fd,
+      /** [in] See `FilesGetToFd()`. */
+      const http::FdSinkOptions& options = {},
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `FilesAdd()`.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult FilesAddAsync(
+      /** [in] See `FilesAdd()`. */
+      const std::vector<http::FileUpload>& files,
+      /** [out] See `FilesAdd()`. Must stay valid until the call has
+       * finished. */
+      Json* result,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `FilesAdd()` with a callback per record.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult FilesAddAsync(
+      /** [in] See `FilesAdd()`. */
+      const std::vector<http::FileUpload>& files,
+      /** [in] See `FilesAdd()`. */
+      JsonRecordCallback on_record,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `FilesLs()`.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult FilesLsAsync(
+      /** [in] See `FilesLs()`. */
+      const std::string& path,
+      /** [out] See `FilesLs()`. Must stay valid until the call has finished. */
+      Json* result,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `FilesLs()`.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult FilesLsAsync(
+      /** [in] See `FilesLs()`. */
+      const std::string& path,
+      /** [in] See `FilesLs()`. */
+      std::pmr::memory_resource* arena,
+      /** [out] See `FilesLs()`. Must stay valid until the call has finished. */
+      ArenaJson* json,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `FilesLs()`.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult FilesLsAsync(
+      /** [in] See `FilesLs()`. */
+      const std::string& path,
+      /** [out] See `FilesLs()`. Must stay valid until the call has finished.
+       */
+      std::vector<LsEntry>* entries,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `KeyGen()`.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult KeyGenAsync(
+      /** [in] See `KeyGen()`. */
+      const std::string& key_name,
+      /** [in] See `KeyGen()`. */
+      const std::string& key_type,
+      /** [in] See `KeyGen()`. */
+      size_t key_size,
+      /** [out] See `KeyGen()`. Must stay valid until the call has finished. */
+      std::string* key_id,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `KeyList()`.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult KeyListAsync(
+      /** [out] See `KeyList()`. Must stay valid until the call has finished. */
+      Json* key_list,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `KeyRm()`.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult KeyRmAsync(
+      /** [in] See `KeyRm()`. */
+      const std::string& key_name,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `KeyRename()`.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult KeyRenameAsync(
+      /** [in] See `KeyRename()`. */
+      const std::string& old_key,
+      /** [in] See `KeyRename()`. */
+      const std::string& new_key,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `NamePublish()`.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult NamePublishAsync(
+      /** [in] See `NamePublish()`. */
+      const std::string& object_id,
+      /** [in] See `NamePublish()`. */
+      const std::string& key_name,
+      /** [in] See `NamePublish()`. */
+      const Json& options,
+      /** [out] See `NamePublish()`. Must stay valid until the call has
+       * finished. */
+      std::string* name_id,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `NameResolve()`.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult NameResolveAsync(
+      /** [in] See `NameResolve()`. */
+      const std::string& name_id,
+      /** [out] See `NameResolve()`. Must stay valid until the call has
+       * finished. */
+      std::string* path_string,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `PinAdd()`.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult PinAddAsync(
+      /** [in] See `PinAdd()`. */
+      const std::string& object_id,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `PinLs()`.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult PinLsAsync(
+      /** [out] See `PinLs()`. Must stay valid until the call has finished. */
+      Json* pinned,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `PinLs()`.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult PinLsAsync(
+      /** [in] See `PinLs()`. */
+      std::pmr::memory_resource* arena,
+      /** [out] See `PinLs()`. Must stay valid until the call has finished. */
+      ArenaJson* pinned,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `PinLs()`.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult PinLsAsync(
+      /** [in] See `PinLs()`. */
+      const std::string& object_id,
+      /** [out] See `PinLs()`. Must stay valid until the call has finished. */
+      Json* pinned,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `PinLs()`.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult PinLsAsync(
+      /** [in] See `PinLs()`. Called from the thread that runs the transfer. */
+      PinVisitor on_pin,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `PinLs()`.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult PinLsAsync(
+      /** [out] See `PinLs()`. Must stay valid until the call has finished. */
+      std::vector<PinInfo>* pins,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `PinRm()`.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult PinRmAsync(
+      /** [in] See `PinRm()`. */
+      const std::string& object_id,
+      /** [in] See `PinRm()`. */
+      PinRmOptions options,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `DagExport()`.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult DagExportAsync(
+      /** [in] See `DagExport()`. */
+      const std::string& cid,
+      /** [out] See `DagExport()`. Must stay valid until the call has
+       * finished. */
+      std::iostream* output,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `DagExport()` with a sink.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult DagExportAsync(
+      /** [in] See `DagExport()`. */
+      const std::string& cid,
+      /** [in] See `DagExport()`. It is called from the transport's thread and
+       * must stay valid until the call has finished. */
+      http::ResponseSink* output,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `DagExportToFd()`.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult DagExportToFdAsync(
+      /** [in] See `DagExportToFd()`. */
+      const std::string& cid,
+      /** [in] See `DagExportToFd()`. Must stay open until the call has finished. */
+      int fd,
+      /** [in] See `DagExportToFd()`. */
+      const http::FdSinkOptions& options = {},
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `DagImport()`.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult DagImportAsync(
+      /** [in] See `DagImport()`. */
+      const http::FileUpload& data,
+      /** [in] See `DagImport()`. */
+      bool pin,
+      /** [out] See `DagImport()`. Must stay valid until the call has
+       * finished. */
+      std::string* cid,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `DagPut()`.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult DagPutAsync(
+      /** [in] See `DagPut()`. */
+      const Json& input,
+      /** [in] See `DagPut()`. */
+      bool pin,
+      /** [out] See `DagPut()`. Must stay valid until the call has finished. */
+      std::string* cid,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `DagGet()`.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult DagGetAsync(
+      /** [in] See `DagGet()`. */
+      const std::string& path,
+      /** [out] See `DagGet()`. Must stay valid until the call has finished. */
+      Json* data,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `DagGet()`.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult DagGetAsync(
+      /** [in] See `DagGet()`. */
+      const std::string& path,
+      /** [in] See `DagGet()`. */
+      std::pmr::memory_resource* arena,
+      /** [out] See `DagGet()`. Must stay valid until the call has finished. */
+      ArenaJson* data,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `DagResolve()`.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult DagResolveAsync(
+      /** [in] See `DagResolve()`. */
+      const std::string& path,
+      /** [out] See `DagResolve()`. Must stay valid until the call has
+       * finished. */
+      Json* json,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `DagStat()`.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult DagStatAsync(
+      /** [in] See `DagStat()`. */
+      const std::string& root_id,
+      /** [out] See `DagStat()`. Must stay valid until the call has finished. */
+      Json* json,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `StatsBw()`.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult StatsBwAsync(
+      /** [out] See `StatsBw()`. Must stay valid until the call has finished. */
+      Json* bandwidth_info,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `StatsBw()`.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult StatsBwAsync(
+      /** [out] See `StatsBw()`. Must stay valid until the call has finished.
+       */
+      BandwidthInfo* bandwidth_info,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `StatsRepo()`.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult StatsRepoAsync(
+      /** [out] See `StatsRepo()`. Must stay valid until the call has
+       * finished. */
+      Json* repo_stats,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `SwarmAddrs()`.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult SwarmAddrsAsync(
+      /** [out] See `SwarmAddrs()`. Must stay valid until the call has
+       * finished. */
+      Json* addresses,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `SwarmConnect()`.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult SwarmConnectAsync(
+      /** [in] See `SwarmConnect()`. */
+      const std::string& peer,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `SwarmDisconnect()`.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult SwarmDisconnectAsync(
+      /** [in] See `SwarmDisconnect()`. */
+      const std::string& peer,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `SwarmPeers()`.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult SwarmPeersAsync(
+      /** [out] See `SwarmPeers()`. Must stay valid until the call has
+       * finished. */
+      Json* peers,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `SwarmPeers()`.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult SwarmPeersAsync(
+      /** [in] See `SwarmPeers()`. */
+      std::pmr::memory_resource* arena,
+      /** [out] See `SwarmPeers()`. Must stay valid until the call has
+       * finished. */
+      ArenaJson* peers,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
+  /** Asynchronous version of `SwarmPeers()`.
+   *
+   * @return Future that becomes ready when the call has finished.
+   *
+   * @since version 0.8.0 */
+  AsyncResult SwarmPeersAsync(
+      /** [out] See `SwarmPeers()`. Must stay valid until the call has
+       * finished. */
+      std::vector<PeerInfo>* peers,
+      /** [in] [Optional] Called when the call has finished, just before the
+       * returned future becomes ready. */
+      http::FetchCallback on_done = {});
+
   /** Abort any current running IPFS API request.
    *
    * Very useful if you were using the IPFS client API calls inside seperate
@@ -799,6 +2040,45 @@ class Client {
   void Reset();
 
  private:
+  /** Constructor of `WithOptions()`. */
+  Client(
+      /** [in] Transport to share. */
+      std::shared_ptr<http::Transport> transport,
+      /** [in] See `url_prefix_`. */
+      const std::string& url_prefix,
+      /** [in] See `timeout_value_`. */
+      const std::string& timeout,
+      /** [in] See `options_`. */
+      const http::FetchOptions& options);
+
+  /** Fetch an URL with the settings of this client. */
+  void Fetch(
+      /** [in] URL to fetch. */
+      const std::string& url,
+      /** [in] List of files to submit. */
+      const std::vector<http::FileUpload>& files,
+      /** [out] Output to save the response body to. */
+      std::iostream* response);
+
+  /** Fetch an URL into a sink with the settings of this client. */
+  void Fetch(
+      /** [in] URL to fetch. */
+      const std::string& url,
+      /** [in] List of files to submit. */
+      const std::vector<http::FileUpload>& files,
+      /** [in] Consumer of the response body. */
+      http::ResponseSink* sink);
+
+  /** Fetch an URL into a string with the settings of this client, which is
+   * sized for the response once and then parsed in place. */
+  void Fetch(
+      /** [in] URL to fetch. */
+      const std::string& url,
+      /** [in] List of files to submit. */
+      const std::vector<http::FileUpload>& files,
+      /** [out] String to append the response body to. */
+      std::string* response);
+
   /** Fetch any URL that returns JSON and parse it into `response`. */
   void FetchAndParseJson(
       /** [in] URL to fetch. For example:
@@ -817,8 +2097,199 @@ class Client {
       /** [out] Parsed JSON response. */
       Json* response);
 
+  /** Fetch an URL on the asynchronous path of the transport.
+   * @return Future that becomes ready when the transfer and `then` are done. */
+  AsyncResult FetchAsync(
+      /** [in] URL to fetch. */
+      const std::string& url,
+      /** [in] List of files to submit. */
+      const std::vector<http::FileUpload>& files,
+      /** [out] Output to save the response body to. */
+      std::iostream* response,
+      /** [in] Post-processing of a successful response, may throw. It is run
+       * on the transport's thread and should own any temporaries it uses. */
+      std::function<void()> then,
+      /** [in] Caller's completion callback, may be empty. */
+      http::FetchCallback on_done);
+
+  /** Fetch an URL into a sink on the asynchronous path of the transport.
+   * @return Future that becomes ready when the transfer and `then` are done. */
+  AsyncResult FetchAsync(
+      /** [in] URL to fetch. */
+      const std::string& url,
+      /** [in] List of files to submit. */
+      const std::vector<http::FileUpload>& files,
+      /** [in] Consumer of the response body. */
+      http::ResponseSink* sink,
+      /** [in] Post-processing of a successful response, may throw. It is run
+       * on the transport's thread and should own any temporaries it uses. */
+      std::function<void()> then,
+      /** [in] Caller's completion callback, may be empty. */
+      http::FetchCallback on_done);
+
+  /** Fetch an URL into a string on the asynchronous path of the transport,
+   * see the string `Fetch()`.
+   * @return Future that becomes ready when the transfer and `then` are done. */
+  AsyncResult FetchAsync(
+      /** [in] URL to fetch. */
+      const std::string& url,
+      /** [in] List of files to submit. */
+      const std::vector<http::FileUpload>& files,
+      /** [out] String to append the response body to, `then` should own it. */
+      std::string* response,
+      /** [in] Post-processing of a successful response, may throw. It is run
+       * on the transport's thread and should own any temporaries it uses. */
+      std::function<void()> then,
+      /** [in] Caller's completion callback, may be empty. */
+      http::FetchCallback on_done);
+
+  /** Asynchronous version of `FetchAndParseJson()`.
+   * @return Future that becomes ready when the transfer and `then` are done. */
+  AsyncResult FetchAndParseJsonAsync(
+      /** [in] URL to submit the files to. */
+      const std::string& url,
+      /** [in] List of files to submit. */
+      const std::vector<http::FileUpload>& files,
+      /** [out] Parsed JSON response. */
+      Json* response,
+      /** [in] Post-processing of the parsed response, may be empty. */
+      std::function<void()> then,
+      /** [in] Caller's completion callback, may be empty. */
+      http::FetchCallback on_done);
+
+  /** Fetch any URL that returns JSON and parse it into `response`, with the
+   * nodes and strings allocated from `arena`. */
+  void FetchAndParseJson(
+      /** [in] URL to fetch. */
+      const std::string& url,
+      /** [in] Memory resource to allocate the response from. */
+      std::pmr::memory_resource* arena,
+      /** [out] Parsed JSON response. */
+      ArenaJson* response);
+
+  /** Asynchronous version of the `ArenaJson` `FetchAndParseJson()`.
+   * @return Future that becomes ready when the transfer and parsing are done.
+   */
+  AsyncResult FetchAndParseJsonAsync(
+      /** [in] URL to fetch. */
+      const std::string& url,
+      /** [in] Memory resource to allocate the response from. */
+      std::pmr::memory_resource* arena,
+      /** [out] Parsed JSON response, must outlive the call. */
+      ArenaJson* response,
+      /** [in] Caller's completion callback, may be empty. */
+      http::FetchCallback on_done);
+
+  /** @return Sink that parses a response that consists of one JSON per line
+   * as it arrives, and hands each record to `on_record`. */
+  static std::shared_ptr<http::ResponseSink> JsonRecordSink(
+      /** [in] Called with every record. */
+      JsonRecordCallback on_record);
+
+  /** @return Sink like `JsonRecordSink()`, that ends the transfer as soon as
+   * `on_record` returns false. */
+  static std::shared_ptr<http::ResponseSink> JsonRecordSinkWhile(
+      /** [in] Called with every record until it returns false. */
+      JsonRecordVisitor on_record);
+
+  /** @return Sink that parses a streamed `pin/ls` response as it arrives,
+   * and hands each pinned object to `on_pin`. */
+  static std::shared_ptr<http::ResponseSink> PinSink(
+      /** [in] Called with every pinned object until it returns false. */
+      PinVisitor on_pin);
+
+  /** Parse a `block/stat` response.
+   *
+   * @throw std::exception if it is not valid or lacks a property */
+  static void ParseBlockStat(
+      /** [in] The response, for example `{"Key":"bafk...","Size":12}`. */
+      const std::string& input,
+      /** [out] Parse result. */
+      BlockStatResult* stat);
+
+  /** Parse the links of a `file/ls` response.
+   *
+   * @throw std::exception if it is not valid */
+  static void ParseFilesLs(
+      /** [in] The response, for example `{"Arguments":{...},"Objects":{"Qm...":
+       * {"Hash":"Qm...","Links":[{"Name":"a","Hash":"Qm...","Size":5,
+       * "Type":"File"}],...}}}`. */
+      const std::string& input,
+      /** [in,out] Parse result, its elements are reused. */
+      std::vector<LsEntry>* entries);
+
+  /** Parse a `stats/bw` response.
+   *
+   * @throw std::exception if it is not valid */
+  static void ParseStatsBw(
+      /** [in] The response, for example
+       * `{"RateIn":4541.4,"RateOut":677.3,"TotalIn":15994960,...}`. */
+      const std::string& input,
+      /** [out] Parse result. */
+      BandwidthInfo* bandwidth_info);
+
+  /** Parse a `swarm/peers` response.
+   *
+   * @throw std::exception if it is not valid */
+  static void ParseSwarmPeers(
+      /** [in] The response, for example `{"Peers":[{"Addr":"/ip4/...",
+       * "Peer":"Qm...","Latency":"23.4ms",...}]}`. */
+      const std::string& input,
+      /** [in,out] Parse result, its elements are reused. */
+      std::vector<PeerInfo>* peers);
+
+  /** @return Record visitor for a `routing/findprovs` response, that hands
+   * the providers in its records to `on_provider` and stops after
+   * `num_providers` of them. */
+  static JsonRecordVisitor ProvidersOf(
+      /** [in] Number of providers to find, 0 for no limit. */
+      size_t num_providers,
+      /** [in] Called with every provider until it returns false. */
+      JsonRecordVisitor on_provider);
+
+  /** Look for the addresses of a peer in a record of a `routing/findpeer`
+   * response.
+   * @return Whether the record has them. */
+  static bool FindPeerAddresses(
+      /** [in] The record, for example
+       * `{..., "Responses":[{"Addrs":["...","..."],"ID":"peer_id"}], ...}`. */
+      const Json& record,
+      /** [in] Id of the peer to look for. */
+      const std::string& peer_id,
+      /** [out] List of the peer's addresses, if found. */
+      Json* addresses);
+
+  /** Merge a progress record of an `add` response into the results, one per
+   * file. See `FilesAdd()`.
+   *
+   * @throw std::exception if the record has no name */
+  static void CollectFilesAdd(
+      /** [in] The record. */
+      const Json& record,
+      /** [in] Line number of the record, for the error message. */
+      size_t line_number,
+      /** [in,out] Results so far, by path. */
+      Json* by_path);
+
+  /** Turn the results by path of `CollectFilesAdd()` into a list. */
+  static void FinishFilesAdd(
+      /** [in] Results by path. */
+      const Json& by_path,
+      /** [out] List of results. */
+      Json* result);
+
+  /** Check that a `pin/add` response lists an object as pinned.
+   *
+   * @throw std::exception if it does not */
+  static void CheckPinned(
+      /** [in] The `pin/add` response. */
+      const Json& response,
+      /** [in] Id of the object that should be pinned. */
+      const std::string& object_id);
+
   /** Parse a string into a JSON. It just calls Json::parse() and appends the
-   * input to the error message in case of an error.
+   * part of the input around the error to the error message in case of an
+   * error.
    *
    * @throw std::exception if any error occurs */
   static void ParseJson(
@@ -842,6 +2313,11 @@ class Client {
       /** [out] Property value. */
       PropertyType* property_value);
 
+  /** @return `options_`, marked as idempotent if the endpoint of `url` is. */
+  http::FetchOptions OptionsFor(
+      /** [in] URL that is about to be fetched. */
+      const std::string& url) const;
+
   /** Construct a full URL. The URL is constructed from url_prefix_, path and
    * the provided parameters (if any). For example:
    * http://localhost:5001/api/v0 / block/get ?stream-channels=true& foo = bar
@@ -858,11 +2334,15 @@ class Client {
    * arguments. For example: `"http://localhost:5001/api/v0"`. */
   std::string url_prefix_;
 
-  /** The underlying transport. */
-  std::unique_ptr<http::Transport> http_;
+  /** The underlying transport, shared with the clients made by
+   * `WithOptions()`. */
+  std::shared_ptr<http::Transport> http_;
 
   /** Server-side time-out setting */
   std::string timeout_value_;
+
+  /** Settings of every fetch, see `WithOptions()`. */
+  http::FetchOptions options_;
 };
 } /* namespace ipfs */
 
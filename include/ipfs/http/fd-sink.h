@@ -0,0 +1,126 @@
+/* Copyright (c) 2016-2023, The C++ IPFS client library developers
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#ifndef IPFS_HTTP_FD_SINK_H
+#define IPFS_HTTP_FD_SINK_H
+
+#include <ipfs/http/transport.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace ipfs {
+
+namespace http {
+
+/** Options of an `FdSink`.
+ * @since version 0.8.0 */
+struct FdSinkOptions {
+  /** Size of the write buffer, rounded up to a multiple of 4 KiB. The body is
+   * written to the file descriptor in writes of this size. */
+  size_t buffer_size = 1 << 20;
+
+  /** Reserve disk space for the whole body before writing it, if the server
+   * announces its size (or `expected_size` is set). Avoids fragmentation of
+   * big files. Only on Linux, ignored elsewhere. */
+  bool preallocate = true;
+
+  /** Size of the body when the server does not announce it (the IPFS daemon
+   * streams `cat` responses without a Content-Length), 0 if unknown. */
+  uint64_t expected_size = 0;
+
+  /** Flush the written data to disk at the end and drop it from the page cache,
+   * so that a multi-GB download does not push everything else out of it. Only
+   * where `posix_fadvise()` is available, ignored elsewhere. */
+  bool drop_cache = false;
+};
+
+/** Sink that writes the body to a file descriptor, eg. of a file opened with
+ * `open()`. Chunks are collected in a page aligned buffer and written with
+ * large writes of `FdSinkOptions::buffer_size`, which suits also descriptors
+ * opened with `O_DIRECT`. Writing starts at the current offset of the
+ * descriptor, which the sink does not close.
+ *
+ * An example usage:
+ * @snippet test_files.cc ipfs::http::FdSink
+ *
+ * @since version 0.8.0 */
+class FdSink : public ResponseSink {
+ public:
+  /** Constructor. */
+  explicit FdSink(
+      /** [in] File descriptor to write to, must stay open while the sink is
+       * in use. */
+      int fd,
+      /** [in] Options. */
+      const FdSinkOptions& options = {});
+
+  /** Reserve space for the body if requested.
+   * @throw std::exception if the space can not be reserved */
+  void OnBegin(int64_t content_length) override;
+
+  /** Buffer a chunk and write the buffer once it is full.
+   * @return Always true.
+   * @throw std::exception if writing fails */
+  bool OnData(const char* data, size_t size) override;
+
+  /** Write what is left in the buffer.
+   * @throw std::exception if writing fails */
+  void OnEnd() override;
+
+  /** @return Number of bytes written to the descriptor so far. */
+  uint64_t BytesWritten() const { return written_; }
+
+ private:
+  /** Write the buffer to the descriptor and empty it. */
+  void Flush();
+
+  /** File descriptor to write to. */
+  const int fd_;
+
+  /** Options. */
+  const FdSinkOptions options_;
+
+  /** Size of `buffer_`, `options_.buffer_size` rounded up. */
+  const size_t buffer_size_;
+
+  /** Frees the buffer. */
+  struct AlignedDelete {
+    void operator()(char* p) const;
+  };
+
+  /** Page aligned write buffer of `buffer_size_` bytes. */
+  std::unique_ptr<char, AlignedDelete> buffer_;
+
+  /** Number of bytes in `buffer_`. */
+  size_t buffered_ = 0;
+
+  /** Offset of the descriptor before the first write, -1 if it is not
+   * seekable (eg. a pipe). */
+  int64_t start_offset_ = -1;
+
+  /** Number of bytes written so far. */
+  uint64_t written_ = 0;
+};
+
+} /* namespace http */
+} /* namespace ipfs */
+
+#endif /* IPFS_HTTP_FD_SINK_H */
@@ -0,0 +1,240 @@
+/* Copyright (c) 2016-2023, The C++ IPFS client library developers
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#ifndef IPFS_HTTP_TRANSPORT_BALANCER_H
+#define IPFS_HTTP_TRANSPORT_BALANCER_H
+
+#include <ipfs/http/transport.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ipfs {
+
+namespace http {
+
+/** Settings of a `TransportBalancer`.
+ * @since version 0.8.0 */
+struct BalancerOptions {
+  /** How to pick the daemon for a request. */
+  enum class Policy {
+    /** The daemon with the fewest requests in flight. */
+    kLeastOutstanding,
+    /** The one with fewer requests in flight out of two daemons picked at
+     * random. Nearly as good as `kLeastOutstanding`, without looking at every
+     * daemon. */
+    kPowerOfTwoChoices,
+    /** The daemon that the CID in the `arg` of the request hashes to, so that
+     * the requests for a CID keep going to the daemon that has it cached
+     * already. Adding or removing a daemon only moves the CIDs of that
+     * daemon. Requests without an `arg` go to the daemon with the fewest
+     * requests in flight. */
+    kConsistentHash,
+  };
+
+  /** How to pick the daemon for a request. */
+  Policy policy = Policy::kLeastOutstanding;
+
+  /** A daemon is taken out of rotation after this many failures in a row. A
+   * failure is a request that did not get an answer (no connection, time-out,
+   * broken transfer) or got a 502, 503 or 504. */
+  int failure_threshold = 3;
+
+  /** How long a daemon stays out of rotation the first time. It doubles with
+   * every further time in a row, up to `max_ejection_time`. */
+  std::chrono::milliseconds ejection_time{5000};
+
+  /** Upper bound of the time out of rotation. */
+  std::chrono::milliseconds max_ejection_time{60000};
+
+  /** Points per daemon on the hash ring of `Policy::kConsistentHash`. More
+   * points spread the CIDs more evenly. */
+  int virtual_nodes = 100;
+};
+
+/** Transport that spreads the requests across several IPFS daemons, each of
+ * them reached through a transport of its own. The scheme, host and port of
+ * the URL of a request are replaced by the endpoint of the chosen daemon, so
+ * the host and port that the `Client` was created with do not matter.
+ *
+ * The health of the daemons is tracked passively, from the outcome of the
+ * requests: a daemon that keeps failing is taken out of rotation for a while,
+ * see `BalancerOptions::failure_threshold`. If all of them are out, the one
+ * that comes back first is used anyway. A request with
+ * `FetchOptions::idempotent` set that did not get an answer is sent to
+ * another daemon, if there is a healthy one and none of the response has
+ * reached the sink yet.
+ *
+ * An example usage:
+ * @snippet test_transport_balancer.cc ipfs::http::TransportBalancer
+ *
+ * @since version 0.8.0 */
+class TransportBalancer : public Transport {
+ public:
+  /** One of the daemons. */
+  struct Backend {
+    /** Scheme, host and port of the daemon, eg. `"http://10.0.0.1:5001"`. */
+    std::string endpoint;
+
+    /** Transport to reach the daemon through. */
+    std::unique_ptr<Transport> transport;
+  };
+
+  /** Constructor. */
+  TransportBalancer(
+      /** [in] The daemons, at least one. */
+      std::vector<Backend> backends,
+      /** [in] Settings. */
+      const BalancerOptions& options = {});
+
+  /** Constructor that reaches every daemon through a `TransportCurl`. */
+  TransportBalancer(
+      /** [in] Scheme, host and port of the daemons, at least one. */
+      const std::vector<std::string>& endpoints,
+      /** [in] Settings. */
+      const BalancerOptions& options = {},
+      /** [in] Enable cURL verbose mode, useful for debugging. */
+      bool curl_verbose = false);
+
+  /** Destructor. */
+  ~TransportBalancer();
+
+  /** Make a copy with clones of the transports of the daemons. The copy
+   * shares the requests in flight and the health of the daemons with the
+   * original, so that both spread their requests together.
+   * @return Unique pointer to the copy. */
+  std::unique_ptr<Transport> Clone() const override;
+
+  /** Fetch a URL from one of the daemons, see `Transport::Fetch()`. */
+  void Fetch(
+      /** [in] URL to get. */
+      const std::string& url,
+      /** [in] List of files to upload. */
+      const std::vector<FileUpload>& files,
+      /** [out] Output to save the response body to. */
+      std::iostream* response) override;
+
+  /** Fetch a URL from one of the daemons into a sink, see
+   * `Transport::Fetch()`. */
+  void Fetch(
+      /** [in] URL to get. */
+      const std::string& url,
+      /** [in] List of files to upload. */
+      const std::vector<FileUpload>& files,
+      /** [in] Consumer of the response body. */
+      ResponseSink* sink,
+      /** [in] Settings of this fetch. */
+      const FetchOptions& options) override;
+
+  /** Start fetching a URL from one of the daemons, see
+   * `Transport::FetchAsync()`. */
+  void FetchAsync(
+      /** [in] URL to get. */
+      const std::string& url,
+      /** [in] List of files to upload. */
+      const std::vector<FileUpload>& files,
+      /** [out] Output to save the response body to. */
+      std::iostream* response,
+      /** [in] Called when the transfer has finished. */
+      FetchCallback on_done) override;
+
+  /** Start fetching a URL from one of the daemons into a sink, see
+   * `Transport::FetchAsync()`. */
+  void FetchAsync(
+      /** [in] URL to get. */
+      const std::string& url,
+      /** [in] List of files to upload. */
+      const std::vector<FileUpload>& files,
+      /** [in] Consumer of the response body. */
+      ResponseSink* sink,
+      /** [in] Settings of this fetch. */
+      const FetchOptions& options,
+      /** [in] Called when the transfer has finished. */
+      FetchCallback on_done) override;
+
+  /** Stop the fetches of all daemons, see `Transport::StopFetch()`. */
+  void StopFetch() override;
+
+  /** Reset the transports of all daemons, see `Transport::ResetFetch()`. */
+  void ResetFetch() override;
+
+  /** URL encode a string, with the transport of the first daemon. */
+  void UrlEncode(
+      /** [in] Input string to encode. */
+      const std::string& raw,
+      /** [out] URL encoded result. */
+      std::string* encoded) override;
+
+  /** @return The transport of a daemon, eg. to configure it. */
+  Transport& BackendTransport(
+      /** [in] Index of the daemon in the constructor's list. */
+      size_t index);
+
+  /** @return Whether a daemon is in rotation, ie. not taken out for failing.
+   */
+  bool IsHealthy(
+      /** [in] Index of the daemon in the constructor's list. */
+      size_t index) const;
+
+ private:
+  /** Load and health of the daemons, and the hash ring. Shared with the
+   * copies. Defined in the .cc file. */
+  class State;
+
+  /** A request on its way to one of the daemons. Defined in the .cc file. */
+  struct Attempt;
+
+  /** Constructor for `Clone()`. */
+  TransportBalancer(
+      /** [in] The daemons. */
+      std::vector<Backend> backends,
+      /** [in] State shared with the original. */
+      std::shared_ptr<State> state);
+
+  /** Send an asynchronous request to a daemon, and to the next one if it
+   * fails over. */
+  void Dispatch(
+      /** [in] The request. */
+      std::shared_ptr<Attempt> attempt,
+      /** [in] List of files to upload. */
+      const std::vector<FileUpload>& files,
+      /** [in] Index of the daemon, counted as in flight already. */
+      size_t index);
+
+  /** State shared with the copies. */
+  std::shared_ptr<State> state_;
+
+  /** Set by `StopFetch()` and the destructor, the requests that they abort
+   * are not failures of the daemons. */
+  std::atomic<bool> stopped_{false};
+
+  /** The daemons. Declared last, so that the requests that their transports
+   * abort when they are destroyed still find the members above. */
+  std::vector<Backend> backends_;
+};
+
+} /* namespace http */
+} /* namespace ipfs */
+
+#endif /* IPFS_HTTP_TRANSPORT_BALANCER_H */
@@ -0,0 +1,233 @@
+/* Copyright (c) 2016-2023, The C++ IPFS client library developers
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#ifndef IPFS_HTTP_TRANSPORT_CIRCUIT_BREAKER_H
+#define IPFS_HTTP_TRANSPORT_CIRCUIT_BREAKER_H
+
+#include <ipfs/http/transport.h>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace ipfs {
+
+namespace http {
+
+/** Settings of a `TransportCircuitBreaker`.
+ * @since version 0.8.0 */
+struct CircuitBreakerOptions {
+  /** Number of recent requests per endpoint that the rates are taken over. */
+  int window = 20;
+
+  /** The circuit does not open before this many requests of the window have
+   * finished. */
+  int min_requests = 10;
+
+  /** Open the circuit once this share of the recent requests failed. A
+   * failure is a request that did not get an answer (no connection, broken
+   * transfer) or got a 429, 502, 503 or 504. */
+  double failure_rate = 0.5;
+
+  /** A request that takes longer than this to its first byte, or that runs
+   * into its deadline, is slow. */
+  std::chrono::milliseconds slow_call_duration{5000};
+
+  /** Open the circuit once this share of the recent requests was slow. */
+  double slow_call_rate = 0.8;
+
+  /** How long an open circuit fails fast before the first probe. */
+  std::chrono::milliseconds open_time{5000};
+
+  /** Time between the probes while the circuit stays open. */
+  std::chrono::milliseconds probe_interval{2000};
+
+  /** A probe that takes longer than this has failed. */
+  std::chrono::milliseconds probe_timeout{2000};
+
+  /** API path of the probe, a cheap call. */
+  std::string probe_path = "/api/v0/version";
+};
+
+/** Error of a request that was not sent because the circuit of its endpoint
+ * is open, see `TransportCircuitBreaker`.
+ * @since version 0.8.0 */
+class CircuitOpenError : public std::runtime_error {
+ public:
+  /** Constructor. */
+  explicit CircuitOpenError(
+      /** [in] Scheme, host and port of the endpoint. */
+      const std::string& endpoint)
+      : std::runtime_error("Circuit breaker is open for " + endpoint),
+        endpoint_(endpoint) {}
+
+  /** @return Scheme, host and port of the endpoint. */
+  const std::string& Endpoint() const { return endpoint_; }
+
+ private:
+  /** Scheme, host and port of the endpoint. */
+  std::string endpoint_;
+};
+
+/** Transport that stops sending requests to an overloaded daemon. It passes
+ * the requests on to another transport and keeps the failure rate and the
+ * share of slow requests per endpoint (scheme, host and port). Once either
+ * goes above its threshold, the circuit of the endpoint opens: its requests
+ * fail right away with `CircuitOpenError` instead of each waiting for its own
+ * time-out, and the retries of the callers stop adding to the load.
+ *
+ * While the circuit is open, the daemon is probed with a cheap call (see
+ * `CircuitBreakerOptions::probe_path`), first after `open_time` and then every
+ * `probe_interval`. The probes are sent asynchronously when requests for the
+ * endpoint come in, or when `IsOpen()` is asked. The first probe that gets an
+ * answer in time closes the circuit.
+ *
+ * Cancelled requests and exceptions of the caller's sink are not held against
+ * the daemon, and neither are HTTP errors other than the ones listed at
+ * `CircuitBreakerOptions::failure_rate`: the daemon answered.
+ *
+ * An example usage:
+ * @snippet test_transport_circuit_breaker.cc ipfs::http::TransportCircuitBreaker
+ *
+ * @since version 0.8.0 */
+class TransportCircuitBreaker : public Transport {
+ public:
+  /** Constructor. */
+  TransportCircuitBreaker(
+      /** [in] Transport to pass the requests on to. */
+      std::unique_ptr<Transport> transport,
+      /** [in] Settings. */
+      const CircuitBreakerOptions& options = {});
+
+  /** Destructor. */
+  ~TransportCircuitBreaker();
+
+  /** Make a copy with a clone of the inner transport. The copy shares the
+   * circuits with the original.
+   * @return Unique pointer to the copy. */
+  std::unique_ptr<Transport> Clone() const override;
+
+  /** Fetch a URL unless its circuit is open, see `Transport::Fetch()`. */
+  void Fetch(
+      /** [in] URL to get. */
+      const std::string& url,
+      /** [in] List of files to upload. */
+      const std::vector<FileUpload>& files,
+      /** [out] Output to save the response body to. */
+      std::iostream* response) override;
+
+  /** Fetch a URL into a sink unless its circuit is open, see
+   * `Transport::Fetch()`. */
+  void Fetch(
+      /** [in] URL to get. */
+      const std::string& url,
+      /** [in] List of files to upload. */
+      const std::vector<FileUpload>& files,
+      /** [in] Consumer of the response body. */
+      ResponseSink* sink,
+      /** [in] Settings of this fetch. */
+      const FetchOptions& options) override;
+
+  /** Start fetching a URL unless its circuit is open, see
+   * `Transport::FetchAsync()`. */
+  void FetchAsync(
+      /** [in] URL to get. */
+      const std::string& url,
+      /** [in] List of files to upload. */
+      const std::vector<FileUpload>& files,
+      /** [out] Output to save the response body to. */
+      std::iostream* response,
+      /** [in] Called when the transfer has finished. */
+      FetchCallback on_done) override;
+
+  /** Start fetching a URL into a sink unless its circuit is open, see
+   * `Transport::FetchAsync()`. */
+  void FetchAsync(
+      /** [in] URL to get. */
+      const std::string& url,
+      /** [in] List of files to upload. */
+      const std::vector<FileUpload>& files,
+      /** [in] Consumer of the response body. */
+      ResponseSink* sink,
+      /** [in] Settings of this fetch. */
+      const FetchOptions& options,
+      /** [in] Called when the transfer has finished. */
+      FetchCallback on_done) override;
+
+  /** Stop the fetches of the inner transport, see `Transport::StopFetch()`. */
+  void StopFetch() override;
+
+  /** Reset the inner transport, see `Transport::ResetFetch()`. */
+  void ResetFetch() override;
+
+  /** URL encode a string, with the inner transport. */
+  void UrlEncode(
+      /** [in] Input string to encode. */
+      const std::string& raw,
+      /** [out] URL encoded result. */
+      std::string* encoded) override;
+
+  /** @return Whether the circuit of an endpoint is open. Starts a probe if
+   * one is due. */
+  bool IsOpen(
+      /** [in] Scheme, host and port, eg. `"http://localhost:5001"`. */
+      const std::string& endpoint);
+
+ private:
+  /** The circuits of the endpoints. Shared with the copies, and with the
+   * probes in flight. Defined in the .cc file. */
+  class State;
+
+  /** A request that is let through. Defined in the .cc file. */
+  struct Call;
+
+  /** Constructor for `Clone()`. */
+  TransportCircuitBreaker(
+      /** [in] Transport to pass the requests on to. */
+      std::unique_ptr<Transport> transport,
+      /** [in] State shared with the original. */
+      std::shared_ptr<State> state);
+
+  /** Check the circuit of an endpoint, and start a probe if one is due.
+   * @throw CircuitOpenError if the circuit is open. */
+  void Admit(
+      /** [in] Scheme, host and port of the endpoint. */
+      const std::string& endpoint);
+
+  /** State shared with the copies. */
+  std::shared_ptr<State> state_;
+
+  /** Set by `StopFetch()` and the destructor, the requests that they abort
+   * are not held against the daemons. */
+  std::atomic<bool> stopped_{false};
+
+  /** The transport that the requests are passed on to. Declared last, so
+   * that the requests that it aborts when it is destroyed still find the
+   * members above. */
+  std::unique_ptr<Transport> transport_;
+};
+
+} /* namespace http */
+} /* namespace ipfs */
+
+#endif /* IPFS_HTTP_TRANSPORT_CIRCUIT_BREAKER_H */
@@ -0,0 +1,170 @@
+/* Copyright (c) 2016-2023, The C++ IPFS client library developers
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#ifndef IPFS_HTTP_TRANSPORT_COALESCER_H
+#define IPFS_HTTP_TRANSPORT_COALESCER_H
+
+#include <ipfs/http/transport.h>
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ipfs {
+
+namespace http {
+
+/** Transport that lets identical reads that are in flight at the same time
+ * share one transfer. Requests with `FetchOptions::idempotent` set and no
+ * files to upload are keyed on their URL: while the response to a URL has not
+ * started to arrive, further requests for it wait for that transfer instead
+ * of starting their own, and every chunk of the body is handed to all of
+ * their sinks. Requests that come in after the first byte start a new
+ * transfer, so nothing is buffered. All other requests are passed on as they
+ * are.
+ *
+ * Each request keeps its own sink: one that throws or returns `false` from
+ * `ResponseSink::OnData()` only leaves the shared transfer, which is stopped
+ * once no one is left. A request only joins a transfer whose deadline is no
+ * earlier than its own, no deadline being the latest; if its own is earlier,
+ * it leaves the transfer with a "Deadline exceeded" error once that passes.
+ * A cancelled request leaves the transfer right away if it is synchronous,
+ * otherwise with the next chunk or at the end; the transfer itself is
+ * cancelled once all of its requests are.
+ *
+ * An example usage:
+ * @snippet test_transport_coalescer.cc ipfs::http::TransportCoalescer
+ *
+ * @since version 0.8.0 */
+class TransportCoalescer : public Transport {
+ public:
+  /** Constructor. */
+  explicit TransportCoalescer(
+      /** [in] Transport to pass the requests on to. */
+      std::unique_ptr<Transport> transport);
+
+  /** Destructor. */
+  ~TransportCoalescer();
+
+  /** Make a copy with a clone of the inner transport. The copy has transfers
+   * of its own, so that `StopFetch()` on one does not end the requests of the
+   * other.
+   * @return Unique pointer to the copy. */
+  std::unique_ptr<Transport> Clone() const override;
+
+  /** Fetch a URL, see `Transport::Fetch()`. Not coalesced, because it has no
+   * `FetchOptions`. */
+  void Fetch(
+      /** [in] URL to get. */
+      const std::string& url,
+      /** [in] List of files to upload. */
+      const std::vector<FileUpload>& files,
+      /** [out] Output to save the response body to. */
+      std::iostream* response) override;
+
+  /** Fetch a URL into a sink, sharing the transfer with identical reads, see
+   * `Transport::Fetch()`. */
+  void Fetch(
+      /** [in] URL to get. */
+      const std::string& url,
+      /** [in] List of files to upload. */
+      const std::vector<FileUpload>& files,
+      /** [in] Consumer of the response body. */
+      ResponseSink* sink,
+      /** [in] Settings of this fetch. */
+      const FetchOptions& options) override;
+
+  /** Start fetching a URL, see `Transport::FetchAsync()`. Not coalesced,
+   * because it has no `FetchOptions`. */
+  void FetchAsync(
+      /** [in] URL to get. */
+      const std::string& url,
+      /** [in] List of files to upload. */
+      const std::vector<FileUpload>& files,
+      /** [out] Output to save the response body to. */
+      std::iostream* response,
+      /** [in] Called when the transfer has finished. */
+      FetchCallback on_done) override;
+
+  /** Start fetching a URL into a sink, sharing the transfer with identical
+   * reads, see `Transport::FetchAsync()`. */
+  void FetchAsync(
+      /** [in] URL to get. */
+      const std::string& url,
+      /** [in] List of files to upload. */
+      const std::vector<FileUpload>& files,
+      /** [in] Consumer of the response body. */
+      ResponseSink* sink,
+      /** [in] Settings of this fetch. */
+      const FetchOptions& options,
+      /** [in] Called when the transfer has finished. */
+      FetchCallback on_done) override;
+
+  /** Stop the fetches of the inner transport, see `Transport::StopFetch()`. */
+  void StopFetch() override;
+
+  /** Reset the inner transport, see `Transport::ResetFetch()`. */
+  void ResetFetch() override;
+
+  /** URL encode a string, with the inner transport. */
+  void UrlEncode(
+      /** [in] Input string to encode. */
+      const std::string& raw,
+      /** [out] URL encoded result. */
+      std::string* encoded) override;
+
+  /** @return Number of requests so far that joined a transfer in flight
+   * instead of starting their own. */
+  uint64_t CoalescedCount() const;
+
+ private:
+  /** The transfers in flight, by URL. Defined in the .cc file. */
+  class State;
+
+  /** Runs tasks at given times. Defined in the .cc file. */
+  class Timer;
+
+  /** A shared transfer. Defined in the .cc file. */
+  struct Flight;
+
+  /** A request waiting for a shared transfer. Defined in the .cc file. */
+  struct Waiter;
+
+  /** Join the transfer in flight for `url`, or start one. */
+  void Join(
+      /** [in] URL to get. */
+      const std::string& url,
+      /** [in] Settings of this fetch. */
+      const FetchOptions& options,
+      /** [in] The request. */
+      std::shared_ptr<Waiter> waiter);
+
+  /** The transport that the requests are passed on to. */
+  std::unique_ptr<Transport> transport_;
+
+  /** The transfers in flight, shared with them. */
+  std::shared_ptr<State> state_;
+};
+
+} /* namespace http */
+} /* namespace ipfs */
+
+#endif /* IPFS_HTTP_TRANSPORT_COALESCER_H */
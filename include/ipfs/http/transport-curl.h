@@ -24,7 +24,11 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
 #include <ipfs/http/transport.h>
 
 #include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <functional>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -35,12 +39,91 @@ namespace http {
 /** Convenience class for talking basic HTTP, implemented using CURL. */
 class TransportCurl : public Transport {
  public:
+  /** Readiness of a socket, exchanged with an external event loop. The values
+   * can be combined.
+   * @since version 0.8.0 */
+  enum SocketEvent : int {
+    /** Readable. */
+    kSocketRead = CURL_CSELECT_IN,
+    /** Writable. */
+    kSocketWrite = CURL_CSELECT_OUT,
+    /** In an error state, only reported to `OnSocketEvent()`. */
+    kSocketError = CURL_CSELECT_ERR,
+  };
+
+  /** Hooks through which an external event loop (epoll, kqueue, libuv, ...)
+   * learns what to wait for on behalf of the asynchronous transfers, see
+   * `SetEventLoop()`.
+   * @since version 0.8.0 */
+  struct EventLoop {
+    /** Start, change or stop watching a socket. `events` is a combination of
+     * `kSocketRead` and `kSocketWrite`, or 0 to stop watching it. When the
+     * socket becomes ready call `OnSocketEvent()`. */
+    std::function<void(curl_socket_t socket, int events)> watch_socket;
+
+    /** Arm the single timer of the transport to call `OnTimeout()` after
+     * `timeout_ms` milliseconds, replacing any earlier timeout, or disarm it
+     * if `timeout_ms` is -1. A timeout of 0 means as soon as possible, but
+     * `OnTimeout()` must not be called from within this hook. */
+    std::function<void(long timeout_ms)> set_timer;
+  };
+
+  /** When and how often to send a failed request again, see
+   * `SetRetryPolicy()`.
+   * @since version 0.8.0 */
+  struct RetryPolicy {
+    /** Attempts per fetch, the first one included. 1 disables retrying. */
+    int max_attempts = 1;
+
+    /** Wait before the first retry. */
+    std::chrono::milliseconds initial_backoff{100};
+
+    /** Upper bound of the wait before a retry. */
+    std::chrono::milliseconds max_backoff{2000};
+
+    /** Factor by which the wait grows with every further retry. */
+    double backoff_multiplier = 2.0;
+
+    /** Retries allowed per fetch on average. Every fetch adds this much to the
+     * retry budget and every retry takes 1 from it, so a daemon that is down
+     * does not get flooded with retries. */
+    double budget_ratio = 0.2;
+
+    /** Size of the retry budget, which starts full. */
+    double budget_max = 10;
+  };
+
+  /** When and where to send the duplicate of a slow read, see
+   * `SetHedgePolicy()`.
+   * @since version 0.8.0 */
+  struct HedgePolicy {
+    /** Send the duplicate once a fetch has waited longer for its first byte
+     * than this share of the recent fetches did, eg. 0.95. 0 disables
+     * hedging. */
+    double percentile = 0;
+
+    /** Wait for the first byte until enough fetches have been seen to tell
+     * the percentile. */
+    std::chrono::milliseconds initial_delay{200};
+
+    /** Lower bound of the wait, so that a fast daemon is not asked twice for
+     * every little stall. */
+    std::chrono::milliseconds min_delay{5};
+
+    /** Where to send the duplicate, eg. `"http://10.0.0.2:5001"`. It replaces
+     * the scheme, host and port of the URL, and the duplicate goes over TCP
+     * then. If empty, the duplicate goes where the original went. */
+    std::string endpoint;
+  };
+
   /** Constructor. */
   TransportCurl(
       /** [in] Enable cURL verbose mode, useful for debugging. */
       bool curlVerbose);
 
-  /** Copy Constructor. */
+  /** Copy Constructor. The copy shares the DNS cache, TLS sessions and idle
+   * connections of `other`, but has its own asynchronous engine and abort
+   * state. */
   TransportCurl(
       /** [in] Other TransportCurl object to be copied. */
       const TransportCurl& other);
@@ -50,7 +133,7 @@ class TransportCurl : public Transport {
       /** [in] TransportCurl object to be moved. */
       TransportCurl&& other) noexcept;
 
-  /** Copy assignment operator.
+  /** Copy assignment operator. Shares like the copy constructor does.
    * @return *this */
   TransportCurl& operator=(
       /** [in] Other TransportCurl object to be copied. */
@@ -63,7 +146,7 @@ class TransportCurl : public Transport {
       TransportCurl&&) noexcept;
 
   /**
-   *Return a deep copy of this object.
+   * Return a copy of this object, see the copy constructor.
    * @return Unique pointer of the Transport object.
    */
   std::unique_ptr<Transport> Clone() const override;
@@ -74,7 +157,9 @@ class TransportCurl : public Transport {
   /** Fetch the contents of a given URL. If any files are provided in `files`,
    * they are submitted using "Content-Type: multipart/form-data".
    *
-   * Fetch method is thread-safe. Therefor, can be used within a thread.
+   * Fetch method is thread-safe. Each call checks out a cURL handle from an
+   * internal pool, so any number of threads can fetch through the same
+   * transport at the same time.
    *
    * @throw std::exception if any error occurs including erroneous HTTP status
    * code */
@@ -86,6 +171,167 @@ class TransportCurl : public Transport {
       /** [out] Output to save the response body to. */
       std::iostream* response) override;
 
+  /** Fetch the contents of a given URL into a sink. The body is handed to the
+   * sink as it arrives, without being buffered, see `ResponseSink`.
+   *
+   * Cancelling `options.cancellation` wakes up the transfer at once and makes
+   * it fail, see `CancellationToken`.
+   *
+   * Fetch method is thread-safe.
+   *
+   * @throw std::exception if any error occurs including erroneous HTTP status
+   * code, or whatever the sink threw */
+  void Fetch(
+      /** [in] URL to get. */
+      const std::string& url,
+      /** [in] List of files to upload. */
+      const std::vector<FileUpload>& files,
+      /** [in] Consumer of the response body. */
+      ResponseSink* sink,
+      /** [in] Settings of this fetch. */
+      const FetchOptions& options) override;
+
+  /** Start fetching the contents of a given URL without waiting for it.
+   *
+   * The transfer is queued to a background thread, which keeps up to
+   * `SetMaxConcurrentFetches()` transfers in flight on a single cURL multi
+   * handle. `on_done` is called from that thread once the transfer finished.
+   *
+   * FetchAsync method is thread-safe. */
+  void FetchAsync(
+      /** [in] URL to get. */
+      const std::string& url,
+      /** [in] List of files to upload. */
+      const std::vector<FileUpload>& files,
+      /** [out] Output to save the response body to. Must stay valid until
+       * `on_done` is called. */
+      std::iostream* response,
+      /** [in] Called when the transfer has finished. */
+      FetchCallback on_done) override;
+
+  /** Start fetching the contents of a given URL into a sink, see the stream
+   * version of `FetchAsync()`. The sink is called from the background thread.
+   *
+   * Cancelling `options.cancellation` takes the transfer off the background
+   * thread at once and fails it, without disturbing the other transfers. With
+   * an external event loop (see `SetEventLoop()`) the token must be cancelled
+   * from the thread that runs the loop, and the transfer is failed from the
+   * next `OnTimeout()`.
+   *
+   * FetchAsync method is thread-safe. */
+  void FetchAsync(
+      /** [in] URL to get. */
+      const std::string& url,
+      /** [in] List of files to upload. */
+      const std::vector<FileUpload>& files,
+      /** [in] Consumer of the response body. Must stay valid until `on_done`
+       * is called. */
+      ResponseSink* sink,
+      /** [in] Settings of this fetch. */
+      const FetchOptions& options,
+      /** [in] Called when the transfer has finished. */
+      FetchCallback on_done) override;
+
+  /** Send all requests over a Unix domain socket instead of TCP, for talking
+   * to a daemon on the same host (eg. one with `Addresses.API` set to
+   * "/unix/run/ipfs/api.sock"). The host and port of the request URLs are then
+   * only used for the "Host" header. Copies of this transport inherit the
+   * setting.
+   *
+   * Call this before the transport is used by other threads.
+   *
+   * @since version 0.8.0 */
+  void SetUnixSocketPath(
+      /** [in] Path of the socket, an empty string switches back to TCP. */
+      const std::string& path);
+
+  /** Have the asynchronous transfers driven by an external event loop instead
+   * of by a background thread of the transport. cURL then tells the loop which
+   * sockets to watch and when to time out through `loop`, and the loop reports
+   * back with `OnSocketEvent()` and `OnTimeout()`. No thread is started.
+   *
+   * From then on `FetchAsync()`, `StopFetch()`, `OnSocketEvent()` and
+   * `OnTimeout()` must all be called from the thread that runs the loop, and
+   * the completion callbacks run on it too, from within `OnSocketEvent()` and
+   * `OnTimeout()`. The blocking `Fetch()` is not affected. Copies of the
+   * transport start without an event loop.
+   *
+   * An example usage:
+   * @snippet test_transport_curl.cc ipfs::http::TransportCurl::SetEventLoop
+   *
+   * @throw std::exception if called after the first `FetchAsync()`
+   *
+   * @since version 0.8.0 */
+  void SetEventLoop(
+      /** [in] Hooks of the event loop. */
+      EventLoop loop);
+
+  /** Let cURL act on a socket that the event loop found ready, see
+   * `SetEventLoop()`.
+   * @since version 0.8.0 */
+  void OnSocketEvent(
+      /** [in] The socket. */
+      curl_socket_t socket,
+      /** [in] Combination of `SocketEvent`, what the socket is ready for. */
+      int events);
+
+  /** Let cURL act on the expired timer of the event loop, see
+   * `SetEventLoop()`.
+   * @since version 0.8.0 */
+  void OnTimeout();
+
+  /** Retry fetches that failed for a transient reason: the connection could
+   * not be made or broke down, or the server answered 429, 502, 503 or 504.
+   * A fetch is only retried if `FetchOptions::idempotent` is set, none of the
+   * body has been handed to its sink yet, its files can be sent again (no
+   * `FileUpload::Type::kReader`) and its deadline leaves time for the wait.
+   *
+   * The wait before a retry is drawn at random between zero and the
+   * exponential backoff of `policy` ("full jitter"). Retries are limited by a
+   * budget, see `RetryPolicy::budget_ratio`. Cancelling a fetch also cancels
+   * its pending retry.
+   *
+   * The policy and its budget are shared with the copies of this transport.
+   * Call this before the transport is used by other threads.
+   *
+   * An example usage:
+   * @snippet test_generic.cc ipfs::http::TransportCurl::SetRetryPolicy
+   *
+   * @since version 0.8.0 */
+  void SetRetryPolicy(
+      /** [in] The policy. */
+      const RetryPolicy& policy);
+
+  /** Hedge reads against a daemon that stalls: if a fetch has not received
+   * the first byte of its body after a delay, a duplicate is sent, possibly
+   * to another endpoint. Whichever of the two starts receiving its body first
+   * hands it to the sink, the other one is cancelled. The delay follows the
+   * times to the first byte of the recent fetches, see
+   * `HedgePolicy::percentile`, so about that share of the fetches is never
+   * duplicated.
+   *
+   * Only fetches with `FetchOptions::idempotent` set and no files to upload
+   * are hedged. Both copies run on the asynchronous engine, also for
+   * `Fetch()`, except when an external event loop drives it.
+   *
+   * The policy and the recorded times are shared with the copies of this
+   * transport. Call this before the transport is used by other threads.
+   *
+   * An example usage:
+   * @snippet test_generic.cc ipfs::http::TransportCurl::SetHedgePolicy
+   *
+   * @since version 0.8.0 */
+  void SetHedgePolicy(
+      /** [in] The policy. */
+      const HedgePolicy& policy);
+
+  /** Set how many asynchronous transfers may be in flight at the same time.
+   * Further transfers are queued until one of the running ones finishes. The
+   * default is 64. */
+  void SetMaxConcurrentFetches(
+      /** [in] Maximum number of concurrent transfers, at least 1. */
+      size_t max_fetches);
+
   /**
    * Stop the fetch method abruptly, useful whenever the
    * Fetch method is used within a thead, but you want to stop the thread
@@ -123,32 +369,70 @@ class TransportCurl : public Transport {
    * this method is called. The method will also check for successful HTTP
    * status code and throw an exception if something goes wrong.
    *
-   * This method is thread-safe. However, you need to be sure your response
-   * object is also thread safe. */
+   * This method is thread-safe, as long as the handles are not used by another
+   * thread. However, you need to be sure your sink is also thread safe. */
   void Perform(
+      /** [in] Configured easy handle. */
+      CURL* curl,
+      /** [in] Multi handle to drive `curl` with. */
+      CURLM* multi_handle,
       /** [in] URL to retrieve. */
       const std::string& url,
-      /** [in,out] Response from the web server. */
-      std::iostream* response);
+      /** [in] Consumer of the response body. */
+      ResponseSink* sink,
+      /** [in] Token that cancels the transfer, may be null. */
+      CancellationToken* cancellation,
+      /** [out] Set if the transfer failed for a reason that a retry may
+       * overcome. */
+      bool* retryable);
 
   /** Initialize cURL. */
   void InitCurl();
 
+  /** cURL share object and its locks. Defined in the .cc file. */
+  class Share;
+
+  /** Pool of handles for the blocking `Fetch()`. Defined in the .cc file. */
+  class HandlePool;
+
+  /** Background thread and multi handle that run `FetchAsync()` transfers.
+   * Defined in the .cc file. */
+  class AsyncEngine;
+
+  /** Retry policy and budget. Defined in the .cc file. */
+  class Retrier;
+
+  /** Hedge policy and the recent times to the first byte. Defined in the .cc
+   * file. */
+  class Hedger;
+
+  /** Data shared by all handles of this transport and its copies. */
+  std::shared_ptr<Share> share_;
+
+  /** Handles for the blocking transfers, shared with the copies. */
+  std::shared_ptr<HandlePool> pool_;
+
+  /** Retry policy, shared with the copies. */
+  std::shared_ptr<Retrier> retrier_;
+
+  /** Hedge policy, shared with the copies. */
+  std::shared_ptr<Hedger> hedger_;
+
+  /** Engine for the asynchronous transfers. */
+  std::unique_ptr<AsyncEngine> async_;
+
+  /** Unix domain socket to connect to, empty to use TCP. */
+  std::string unix_socket_path_;
+
   /** Atomic boolean for stopping a running fetch/perform, thread-safe */
   std::atomic<bool> keep_perform_running_;
 
   /** Result code of the cURL global init */
   CURLcode global_init_result_;
 
-  /** cURL easy handle. */
+  /** cURL easy handle, only used by `UrlEncode()`. */
   CURL* curl_;
 
-  /** cURL multi handle. */
-  CURLM* multi_handle_;
-
-  /** cURL mime structure for post requests */
-  curl_mime* multipart_;
-
   /** Flag for enabling CURL verbose mode, useful for debugging */
   bool curl_verbose_;
 
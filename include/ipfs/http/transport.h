@@ -20,9 +20,22 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
 #ifndef IPFS_HTTP_TRANSPORT_H
 #define IPFS_HTTP_TRANSPORT_H
 
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
 #include <iostream>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace ipfs {
@@ -37,6 +50,22 @@ struct FileUpload {
     kFileContents,
     /** File whose contents is streamed to the web server. For big files. */
     kFileName,
+    /** Memory owned by the caller, referenced by `memory`. It is uploaded
+     * without being copied first and must stay valid until the fetch has
+     * finished. `data` is not used.
+     * @since version 0.8.0 */
+    kMemory,
+    /** File (`data` is its name), or a region of it, that is mapped into
+     * memory and uploaded from the mapping for the duration of the fetch. See
+     * `offset` and `size`.
+     * @since version 0.8.0 */
+    kMappedFile,
+    /** Contents produced on the fly by `reader`, with constant memory and
+     * while the upload runs. `size` is the total size if known in advance,
+     * otherwise -1 and the request is sent with chunked transfer encoding.
+     * `data` is not used.
+     * @since version 0.8.0 */
+    kReader,
   };
 
   /** File name to pretend to the web server. */
@@ -48,8 +77,327 @@ struct FileUpload {
   /** The data to be added. Either a file name from which to read the data or
    * the contents itself. */
   const std::string data;
+
+  /** The contents for `Type::kMemory`.
+   * @since version 0.8.0 */
+  std::span<const std::byte> memory = {};
+
+  /** Start of the region to upload for `Type::kMappedFile`.
+   * @since version 0.8.0 */
+  uint64_t offset = 0;
+
+  /** Size of the region to upload for `Type::kMappedFile`, -1 for up to the
+   * end of the file. Total size of the contents for `Type::kReader`, -1 if
+   * unknown.
+   * @since version 0.8.0 */
+  int64_t size = -1;
+
+  /** Producer of the contents for `Type::kReader`. It fills `buffer` with up
+   * to `max_size` bytes and returns how many it wrote, 0 at the end of the
+   * contents. An exception thrown from it fails the fetch with it. It is
+   * called from the thread that runs the transfer, the transport keeps its
+   * own copy of it.
+   * @since version 0.8.0 */
+  std::function<size_t(char* buffer, size_t max_size)> reader = {};
+};
+
+/** Consumer of a response body, which is handed the bytes as they arrive
+ * instead of having them buffered. Only the body of a successful (2xx) response
+ * goes to the sink, the body of an error response ends up in the exception.
+ * @since version 0.8.0 */
+class ResponseSink {
+ public:
+  /** Destructor. */
+  virtual ~ResponseSink() = default;
+
+  /** Called once before the first chunk of the body, if there is any.
+   * An exception thrown from here fails the fetch with it. */
+  virtual void OnBegin(
+      /** [in] Size of the body as announced by the server, -1 if unknown. */
+      int64_t content_length) {
+    (void)content_length;
+  }
+
+  /** Consume the next chunk of the body. Called from the thread that runs the
+   * transfer. An exception thrown from here fails the fetch with it.
+   * @return true to continue, false to end the transfer early. Ending early is
+   * not an error, the fetch succeeds with what was received so far. */
+  virtual bool OnData(
+      /** [in] The chunk, only valid during the call. */
+      const char* data,
+      /** [in] Size of the chunk in bytes. */
+      size_t size) = 0;
+
+  /** Called once after the last chunk of a successful fetch, also when the
+   * sink ended it early. Not called if the fetch fails. An exception thrown
+   * from here fails the fetch with it. */
+  virtual void OnEnd() {}
+};
+
+/** Sink that writes the body to a stream.
+ * @since version 0.8.0 */
+class StreamSink : public ResponseSink {
+ public:
+  /** Constructor. */
+  explicit StreamSink(
+      /** [out] Stream to write to, must outlive the sink. */
+      std::ostream* stream)
+      : stream_(stream) {}
+
+  /** Write the chunk to the stream.
+   * @return Always true. */
+  bool OnData(const char* data, size_t size) override {
+    stream_->write(data, static_cast<std::streamsize>(size));
+    return true;
+  }
+
+ private:
+  /** Stream to write to. */
+  std::ostream* stream_;
+};
+
+/** Sink that appends the body to a string. Unlike a `std::stringstream`, the
+ * string can be parsed where it is, without copying it out first, and it is
+ * allocated once if the server announces the size of the body.
+ * @since version 0.8.0 */
+class StringSink : public ResponseSink {
+ public:
+  /** Constructor. */
+  explicit StringSink(
+      /** [out] String to append to, must outlive the sink. */
+      std::string* body,
+      /** [in] Capacity to reserve beyond the body, eg. for a parser that
+       * reads ahead of its input. */
+      size_t extra_capacity = 0)
+      : body_(body), extra_capacity_(extra_capacity) {}
+
+  /** Reserve the announced size of the body. */
+  void OnBegin(int64_t content_length) override {
+    if (content_length > 0) {
+      body_->reserve(body_->size() + static_cast<size_t>(content_length) +
+                     extra_capacity_);
+    }
+  }
+
+  /** Append the chunk to the string.
+   * @return Always true. */
+  bool OnData(const char* data, size_t size) override {
+    body_->append(data, size);
+    return true;
+  }
+
+  /** Make sure of the capacity beyond the body, which `OnBegin()` could not
+   * reserve if the size of the body was not announced. */
+  void OnEnd() override {
+    if (body_->capacity() - body_->size() < extra_capacity_) {
+      body_->reserve(body_->size() + extra_capacity_);
+    }
+  }
+
+ private:
+  /** String to append to. */
+  std::string* body_;
+
+  /** Capacity to reserve beyond the body. */
+  size_t extra_capacity_;
+};
+
+/** Sink that hands the body to a function.
+ * @since version 0.8.0 */
+class CallbackSink : public ResponseSink {
+ public:
+  /** Constructor. */
+  explicit CallbackSink(
+      /** [in] Called for every chunk, see `ResponseSink::OnData()`. */
+      std::function<bool(const char* data, size_t size)> on_data)
+      : on_data_(std::move(on_data)) {}
+
+  /** Call the function.
+   * @return Whatever the function returned. */
+  bool OnData(const char* data, size_t size) override {
+    return on_data_(data, size);
+  }
+
+ private:
+  /** The function. */
+  std::function<bool(const char* data, size_t size)> on_data_;
+};
+
+/** Sink that splits the body into lines as it arrives and hands each complete
+ * line to a function, eg. for responses that consist of one JSON per line.
+ * Only the line that is still incomplete is buffered. Empty lines are
+ * skipped, and a last line without a trailing newline is handed over at the
+ * end.
+ * @since version 0.8.0 */
+class LineSink : public ResponseSink {
+ public:
+  /** Constructor. */
+  explicit LineSink(
+      /** [in] Called for every line, without its newline. Returns false to
+       * end the transfer early, see `ResponseSink::OnData()`. */
+      std::function<bool(const std::string& line)> on_line)
+      : on_line_(std::move(on_line)) {}
+
+  /** Hand the lines that the chunk completes to the function.
+   * @return false once the function has returned false. */
+  bool OnData(const char* data, size_t size) override {
+    const char* end = data + size;
+    while (data != end) {
+      const char* newline = std::find(data, end, '\n');
+      line_.append(data, newline);
+      if (newline == end) {
+        break;
+      }
+      data = newline + 1;
+      if (!Flush()) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /** Hand the last line to the function, if it has no newline. */
+  void OnEnd() override {
+    if (!stopped_) {
+      Flush();
+    }
+  }
+
+ private:
+  /** Hand the buffered line to the function, unless it is empty.
+   * @return What the function returned. */
+  bool Flush() {
+    if (line_.empty()) {
+      return true;
+    }
+    stopped_ = !on_line_(line_);
+    line_.clear();
+    return !stopped_;
+  }
+
+  /** The function. */
+  std::function<bool(const std::string& line)> on_line_;
+
+  /** The line so far. */
+  std::string line_;
+
+  /** Set once the function has returned false. */
+  bool stopped_ = false;
+};
+
+/** Cancels the fetches that it was handed to (see `FetchOptions`), from any
+ * thread. Unlike `Transport::StopFetch()` it only affects those fetches, and
+ * the transport does not need to be reset afterwards.
+ *
+ * Fetches that are running when the token is cancelled fail with "Request was
+ * cancelled" right away, without waiting for the transfer to make progress.
+ * Fetches that are started with an already cancelled token fail immediately.
+ *
+ * @since version 0.8.0 */
+class CancellationToken {
+ public:
+  /** Cancel the fetches. Thread-safe, cancelling again has no effect. */
+  void Cancel() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (cancelled_) {
+      return;
+    }
+    cancelled_ = true;
+    for (const auto& subscriber : subscribers_) {
+      subscriber.second();
+    }
+  }
+
+  /** @return Whether `Cancel()` has been called. */
+  bool IsCancelled() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return cancelled_;
+  }
+
+  /** For transports: have `on_cancel` called by `Cancel()`, or right away if
+   * the token is cancelled already. It runs on the thread that cancels, must
+   * be quick and must not call back into the token.
+   * @return Id to pass to `Unsubscribe()`. */
+  uint64_t Subscribe(
+      /** [in] Wakes up the fetch, so that it notices the cancellation. */
+      std::function<void()> on_cancel) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (cancelled_) {
+      on_cancel();
+    }
+    const uint64_t id = next_id_++;
+    subscribers_.emplace(id, std::move(on_cancel));
+    return id;
+  }
+
+  /** For transports: stop calling a function passed to `Subscribe()`. Once
+   * this returns the function is not running and will not be called again. */
+  void Unsubscribe(
+      /** [in] Id returned by `Subscribe()`. */
+      uint64_t id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    subscribers_.erase(id);
+  }
+
+ private:
+  /** Protects all members below. Held while the subscribers are called. */
+  mutable std::mutex mutex_;
+
+  /** Set by `Cancel()`. */
+  bool cancelled_ = false;
+
+  /** Id for the next subscriber. */
+  uint64_t next_id_ = 0;
+
+  /** Functions to call on cancellation, by id. */
+  std::map<uint64_t, std::function<void()>> subscribers_;
+};
+
+/** Settings of a single fetch.
+ * @since version 0.8.0 */
+struct FetchOptions {
+  /** Token to cancel the fetch with, may be null. */
+  std::shared_ptr<CancellationToken> cancellation = {};
+
+  /** Point in time by which the fetch must have finished, including the time
+   * to connect. The fetch fails with "Deadline exceeded" if it has passed
+   * before the transfer starts, or times out once it passes during the
+   * transfer. No deadline if empty. */
+  std::optional<std::chrono::steady_clock::time_point> deadline = {};
+
+  /** Whether sending the request again does not change its outcome, which
+   * allows the transport to retry it after a transient failure. `Client` sets
+   * it for the endpoints that are, like `block/get` or `cat`. */
+  bool idempotent = false;
+};
+
+/** Error of a fetch that the server answered with a non-2xx HTTP status code,
+ * as opposed to one that did not get an answer at all.
+ * @since version 0.8.0 */
+class HttpStatusError : public std::runtime_error {
+ public:
+  /** Constructor. */
+  HttpStatusError(
+      /** [in] The HTTP status code. */
+      long status_code,
+      /** [in] Error message. */
+      const std::string& what)
+      : std::runtime_error(what), status_code_(status_code) {}
+
+  /** @return The HTTP status code. */
+  long StatusCode() const { return status_code_; }
+
+ private:
+  /** The HTTP status code. */
+  long status_code_;
 };
 
+/** Completion callback of an asynchronous fetch. It receives a null pointer on
+ * success, otherwise the exception that the synchronous `Fetch()` would have
+ * thrown. The callback must not throw and should not block, because it is
+ * usually called from the thread that drives all other transfers. */
+using FetchCallback = std::function<void(std::exception_ptr error)>;
+
 /** Convenience interface for talking basic HTTP. */
 class Transport {
  public:
@@ -77,6 +425,67 @@ class Transport {
       /** [out] Output to save the response body to. */
       std::iostream* response) = 0;
 
+  /** Fetch the contents of a given URL into a sink, see `ResponseSink`, with
+   * the settings of this particular fetch in `options`.
+   *
+   * The default implementation buffers the whole body with the stream version
+   * of `Fetch()` and then hands it to the sink at once. It only checks for
+   * cancellation and the deadline before it starts. Transports that can stream
+   * override it. Derived classes that override only some of the
+   * `Fetch()` overloads should pull in the others with `using Transport::Fetch`.
+   *
+   * @throw std::exception if any error occurs including erroneous HTTP status
+   * code
+   *
+   * @since version 0.8.0 */
+  virtual void Fetch(
+      /** [in] URL to get. */
+      const std::string& url,
+      /** [in] List of files to upload. */
+      const std::vector<FileUpload>& files,
+      /** [in] Consumer of the response body. */
+      ResponseSink* sink,
+      /** [in] Settings of this fetch. */
+      const FetchOptions& options);
+
+  /** Start fetching the contents of a given URL and return without waiting for
+   * the transfer to finish. `on_done` is called once it has finished.
+   *
+   * The files are handed over to the transport before this method returns,
+   * but `response` must stay valid until `on_done` has been called.
+   *
+   * The default implementation just calls `Fetch()` and then `on_done`, so it
+   * blocks. Transports that can overlap transfers override it. */
+  virtual void FetchAsync(
+      /** [in] URL to get. */
+      const std::string& url,
+      /** [in] List of files to upload. */
+      const std::vector<FileUpload>& files,
+      /** [out] Output to save the response body to. */
+      std::iostream* response,
+      /** [in] Called when the transfer has finished. */
+      FetchCallback on_done);
+
+  /** Start fetching the contents of a given URL into a sink, see `FetchAsync()`
+   * and `ResponseSink`, with the settings of this particular fetch in
+   * `options`. The sink must stay valid until `on_done` has been called.
+   *
+   * The default implementation calls the sink version of `Fetch()` and then
+   * `on_done`, so it blocks.
+   *
+   * @since version 0.8.0 */
+  virtual void FetchAsync(
+      /** [in] URL to get. */
+      const std::string& url,
+      /** [in] List of files to upload. */
+      const std::vector<FileUpload>& files,
+      /** [in] Consumer of the response body. */
+      ResponseSink* sink,
+      /** [in] Settings of this fetch. */
+      const FetchOptions& options,
+      /** [in] Called when the transfer has finished. */
+      FetchCallback on_done);
+
   /**
    * Stop the Fetch method abruptly.
    *
@@ -107,6 +516,53 @@ class Transport {
 
 inline Transport::~Transport() {}
 
+inline void Transport::FetchAsync(const std::string& url,
+                                  const std::vector<FileUpload>& files,
+                                  std::iostream* response,
+                                  FetchCallback on_done) {
+  std::exception_ptr error;
+  try {
+    Fetch(url, files, response);
+  } catch (...) {
+    error = std::current_exception();
+  }
+  on_done(error);
+}
+
+inline void Transport::Fetch(const std::string& url,
+                             const std::vector<FileUpload>& files,
+                             ResponseSink* sink, const FetchOptions& options) {
+  if (options.cancellation && options.cancellation->IsCancelled()) {
+    throw std::runtime_error("Request was cancelled");
+  }
+  if (options.deadline &&
+      std::chrono::steady_clock::now() >= *options.deadline) {
+    throw std::runtime_error("Deadline exceeded");
+  }
+  std::stringstream body;
+  Fetch(url, files, &body);
+  const std::string contents = body.str();
+  if (!contents.empty()) {
+    sink->OnBegin(static_cast<int64_t>(contents.size()));
+    sink->OnData(contents.data(), contents.size());
+  }
+  sink->OnEnd();
+}
+
+inline void Transport::FetchAsync(const std::string& url,
+                                  const std::vector<FileUpload>& files,
+                                  ResponseSink* sink,
+                                  const FetchOptions& options,
+                                  FetchCallback on_done) {
+  std::exception_ptr error;
+  try {
+    Fetch(url, files, sink, options);
+  } catch (...) {
+    error = std::current_exception();
+  }
+  on_done(error);
+}
+
 } /* namespace http */
 } /* namespace ipfs */
 
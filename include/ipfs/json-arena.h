@@ -0,0 +1,142 @@
+/* Copyright (c) 2016-2023, The C++ IPFS client library developers
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#ifndef IPFS_JSON_ARENA_H
+#define IPFS_JSON_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <memory_resource>
+#include <new>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace ipfs {
+
+/** Makes a memory resource, typically an arena such as a
+ * `std::pmr::monotonic_buffer_resource`, the one that `ArenaAllocator` takes
+ * memory from on the calling thread, for as long as the scope exists. Scopes
+ * nest, the innermost one wins.
+ *
+ * An example usage:
+ * @snippet test_pin.cc ipfs::ArenaScope
+ *
+ * @since version 0.8.0 */
+class ArenaScope {
+ public:
+  /** Constructor. */
+  explicit ArenaScope(
+      /** [in] Memory resource to allocate from. It must outlive everything
+       * that is allocated from it. */
+      std::pmr::memory_resource* arena);
+
+  /** Destructor, makes the previous memory resource current again. */
+  ~ArenaScope();
+
+  ArenaScope(const ArenaScope&) = delete;
+  ArenaScope& operator=(const ArenaScope&) = delete;
+
+  /** @return The memory resource of the innermost scope on the calling thread,
+   * or `std::pmr::get_default_resource()` outside of any scope. */
+  static std::pmr::memory_resource* Current();
+
+ private:
+  /** The memory resource of the enclosing scope, null if none. */
+  std::pmr::memory_resource* previous_;
+};
+
+/** Allocator that takes memory from `ArenaScope::Current()`.
+ *
+ * nlohmann::json creates its allocators on the spot rather than keeping them,
+ * so the allocator can't carry the memory resource. Instead every block
+ * remembers the resource it came from, and goes back to it when it is freed,
+ * no matter which scope is current by then.
+ *
+ * @since version 0.8.0 */
+template <class T>
+class ArenaAllocator {
+ public:
+  /** Type of the allocated objects. */
+  using value_type = T;
+
+  /** All the instances are interchangeable. */
+  using is_always_equal = std::true_type;
+
+  /** Constructor. */
+  ArenaAllocator() noexcept = default;
+
+  /** Converting constructor. */
+  template <class U>
+  ArenaAllocator(const ArenaAllocator<U>&) noexcept {}
+
+  /** @return Memory for `n` objects. */
+  T* allocate(std::size_t n) {
+    static_assert(alignof(T) <= kHeader,
+                  "over-aligned types are not supported");
+    if (n > (std::numeric_limits<std::size_t>::max() - kHeader) / sizeof(T)) {
+      throw std::bad_array_new_length();
+    }
+    std::pmr::memory_resource* resource = ArenaScope::Current();
+    void* block = resource->allocate(kHeader + n * sizeof(T), kHeader);
+    *static_cast<std::pmr::memory_resource**>(block) = resource;
+    return reinterpret_cast<T*>(static_cast<char*>(block) + kHeader);
+  }
+
+  /** Give back the memory of `n` objects. */
+  void deallocate(T* p, std::size_t n) noexcept {
+    void* block = reinterpret_cast<char*>(p) - kHeader;
+    std::pmr::memory_resource* resource =
+        *static_cast<std::pmr::memory_resource**>(block);
+    resource->deallocate(block, kHeader + n * sizeof(T), kHeader);
+  }
+
+  /** @return True, all the instances are interchangeable. */
+  template <class U>
+  bool operator==(const ArenaAllocator<U>&) const noexcept {
+    return true;
+  }
+
+ private:
+  /** Size of the header in front of every block, which holds the memory
+   * resource. It keeps the objects aligned as `operator new` would. */
+  static constexpr std::size_t kHeader = alignof(std::max_align_t);
+};
+
+/** String whose characters are allocated with `ArenaAllocator`, once they
+ * don't fit into the string itself.
+ * @since version 0.8.0 */
+using ArenaString =
+    std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>>;
+
+/** Like `Json`, but every node and string is allocated with `ArenaAllocator`,
+ * that is from the memory resource of the `ArenaScope` it was created in.
+ * Parsing a large response into an arena saves the allocation and freeing of
+ * each of its many small parts, and keeps them out of the heap at large.
+ * @since version 0.8.0 */
+using ArenaJson =
+    nlohmann::basic_json<std::map, std::vector, ArenaString, bool, int64_t,
+                         uint64_t, double, ArenaAllocator>;
+
+} /* namespace ipfs */
+
+#endif /* IPFS_JSON_ARENA_H */
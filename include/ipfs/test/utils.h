@@ -22,8 +22,12 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
 
 #include <ipfs/client.h>
 
+#include <cstddef>
+#include <exception>
 #include <functional>
+#include <future>
 #include <iomanip>
+#include <memory>
 #include <sstream>
 #include <stdexcept>
 #include <string>
@@ -99,6 +103,60 @@ inline void must_fail(
   }
 }
 
+/** Make a client that uses a transport, and keep a pointer to the transport
+ * for looking into it while the client owns it.
+ * @return The client. */
+template <class TransportType>
+inline ipfs::Client client_with(
+    /** [in] The transport. */
+    std::unique_ptr<TransportType> transport,
+    /** [out] Pointer to the transport, valid as long as the client is. */
+    TransportType** kept,
+    /** [in] Hostname of the daemon. */
+    const std::string& host = "localhost",
+    /** [in] Port of the daemon. */
+    long port = 5001) {
+  *kept = transport.get();
+  return ipfs::Client(std::move(transport), host, port);
+}
+
+/** Completion callbacks of a number of asynchronous fetches, which can be
+ * waited for. */
+class FetchCompletions {
+ public:
+  /** Constructor. */
+  explicit FetchCompletions(
+      /** [in] Number of fetches. */
+      size_t count)
+      : done_(count) {}
+
+  /** @return Completion callback of fetch `i`. */
+  ipfs::http::FetchCallback operator()(
+      /** [in] Index of the fetch. */
+      size_t i) {
+    return [this, i](std::exception_ptr error) {
+      if (error) {
+        done_[i].set_exception(error);
+      } else {
+        done_[i].set_value();
+      }
+    };
+  }
+
+  /** Wait for fetch `i` to complete.
+   *
+   * @throw std::exception the error of the fetch, if it failed */
+  void Wait(
+      /** [in] Index of the fetch. */
+      size_t i) {
+    done_[i].get_future().get();
+  }
+
+ private:
+  /** Completion of every fetch. */
+  std::vector<std::promise<void>> done_;
+};
+
 } /* namespace test */
 } /* namespace ipfs */
 #endif /* IPFS_TEST_UTILS_H */
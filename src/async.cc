@@ -0,0 +1,87 @@
+/* Copyright (c) 2016-2023, The C++ IPFS client library developers
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#include <ipfs/async.h>
+
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+namespace ipfs {
+
+AsyncResult::Completion::Completion(std::shared_ptr<State> state)
+    : state_(std::move(state)) {}
+
+void AsyncResult::Completion::operator()(std::exception_ptr error) const {
+  if (error) {
+    state_->promise.set_exception(error);
+  } else {
+    state_->promise.set_value();
+  }
+
+  std::coroutine_handle<> awaiting;
+  {
+    std::unique_lock<std::mutex> lock(state_->mutex);
+    state_->done = true;
+    awaiting = std::exchange(state_->awaiting, {});
+  }
+  /* Outside of the lock, the coroutine may well start another call. */
+  if (awaiting) {
+    awaiting.resume();
+  }
+}
+
+std::pair<AsyncResult, AsyncResult::Completion> AsyncResult::Create() {
+  auto state = std::make_shared<State>();
+  std::future<void> future = state->promise.get_future();
+  return {AsyncResult(state, std::move(future)), Completion(state)};
+}
+
+AsyncResult::AsyncResult(std::shared_ptr<State> state,
+                         std::future<void> future)
+    : state_(std::move(state)), future_(std::move(future)) {}
+
+void AsyncResult::get() { future_.get(); }
+
+void AsyncResult::wait() const { future_.wait(); }
+
+bool AsyncResult::valid() const { return future_.valid(); }
+
+AsyncResult::operator std::future<void>() && { return std::move(future_); }
+
+bool AsyncResult::await_ready() const {
+  std::unique_lock<std::mutex> lock(state_->mutex);
+  return state_->done;
+}
+
+bool AsyncResult::await_suspend(std::coroutine_handle<> awaiting) {
+  std::unique_lock<std::mutex> lock(state_->mutex);
+  if (state_->done) {
+    /* Finished in the meantime, carry on without suspending. */
+    return false;
+  }
+  state_->awaiting = awaiting;
+  return true;
+}
+
+void AsyncResult::await_resume() { future_.get(); }
+
+} /* namespace ipfs */
@@ -18,19 +18,241 @@ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
 CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
 
 #include <ipfs/client.h>
+#include <ipfs/http/fd-sink.h>
 #include <ipfs/http/transport-curl.h>
 #include <ipfs/http/transport.h>
+#include <ipfs/json-arena.h>
 
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <memory>
+#include <memory_resource>
 #include <nlohmann/json.hpp>
+#include <set>
 #include <sstream>
 #include <stdexcept>
 #include <string>
 #include <utility>
 #include <vector>
 
+#ifdef IPFS_WITH_SIMDJSON
+#include <simdjson.h>
+#endif
+
 namespace ipfs {
 
+/** Capacity that is reserved beyond a response body, so that the parser can
+ * read ahead of it without copying the body into a larger buffer first. */
+#ifdef IPFS_WITH_SIMDJSON
+static constexpr size_t kParsePadding = simdjson::SIMDJSON_PADDING;
+#else
+static constexpr size_t kParsePadding = 0;
+#endif
+
+/** Most of a response that goes into an error message. */
+static constexpr size_t kMaxExcerpt = 1024;
+
+/** @return The response for an error message, or just the part of it around
+ * `position` if it is long. */
+static std::string excerpt(
+    /** [in] The response. */
+    const std::string& input,
+    /** [in] Offset of the byte that the error is about. */
+    size_t position = 0) {
+  if (input.size() <= kMaxExcerpt) {
+    return input;
+  }
+  const size_t begin = std::min(
+      position > kMaxExcerpt / 2 ? position - kMaxExcerpt / 2 : 0,
+      input.size() - kMaxExcerpt);
+  return input.substr(begin, kMaxExcerpt) + "\n[bytes " +
+         std::to_string(begin) + "-" + std::to_string(begin + kMaxExcerpt) +
+         " of " + std::to_string(input.size()) + "]";
+}
+
+/** @return The message of a parse error, without the end of it if it is long.
+ * nlohmann::json quotes the last token that it has read, which can be a
+ * string of any size. */
+static std::string parse_error_message(
+    /** [in] The parse error. */
+    const std::exception& e) {
+  const std::string message = e.what();
+  return message.size() <= kMaxExcerpt ? message
+                                       : message.substr(0, kMaxExcerpt) + "...";
+}
+
+#ifdef IPFS_WITH_SIMDJSON
+/** Largest document that is parsed with simdjson. The buffers of the parser
+ * grow to the largest document it has parsed and are kept, and its document
+ * is alive next to the one it is converted into. Larger documents are left to
+ * nlohmann::json, which is slower but needs neither. */
+static constexpr size_t kMaxSimdjsonInput = 1024 * 1024;
+
+/** Parse a document with simdjson, with a parser per thread that keeps its
+ * buffers from one document to the next. The result is only valid until the
+ * thread parses the next one.
+ * @return Whether simdjson accepts the document. It rejects some valid JSON
+ * that nlohmann::json accepts, eg. integers beyond 64 bits, and documents
+ * larger than `kMaxSimdjsonInput`. */
+static bool simdjson_parse(
+    /** [in] The document. */
+    const std::string& input,
+    /** [out] Its root. */
+    simdjson::dom::element* root) {
+  if (input.size() > kMaxSimdjsonInput) {
+    return false;
+  }
+  thread_local simdjson::dom::parser parser(kMaxSimdjsonInput);
+  return parser.parse(input).get(*root) == simdjson::SUCCESS;
+}
+
+/** Convert a document parsed by simdjson into a `Json` or `ArenaJson`, with
+ * the same types of numbers as `parse()` would have picked. */
+template <class JsonType>
+static void simdjson_to_json(
+    /** [in] The document, or a value in it. */
+    simdjson::dom::element element,
+    /** [out] The converted document. */
+    JsonType* result) {
+  using String = typename JsonType::string_t;
+  switch (element.type()) {
+    case simdjson::dom::element_type::ARRAY: {
+      simdjson::dom::array array = element.get_array().value_unsafe();
+      *result = JsonType::array();
+      auto& elements = result->template get_ref<typename JsonType::array_t&>();
+      elements.reserve(array.size());
+      for (simdjson::dom::element child : array) {
+        elements.emplace_back();
+        simdjson_to_json(child, &elements.back());
+      }
+      break;
+    }
+    case simdjson::dom::element_type::OBJECT: {
+      simdjson::dom::object object = element.get_object().value_unsafe();
+      *result = JsonType::object();
+      auto& members = result->template get_ref<typename JsonType::object_t&>();
+      for (simdjson::dom::key_value_pair member : object) {
+        simdjson_to_json(member.value, &members[String(member.key)]);
+      }
+      break;
+    }
+    case simdjson::dom::element_type::INT64: {
+      const int64_t value = element.get_int64().value_unsafe();
+      if (value < 0) {
+        *result = value;
+      } else {
+        *result = static_cast<uint64_t>(value);
+      }
+      break;
+    }
+    case simdjson::dom::element_type::UINT64:
+      *result = element.get_uint64().value_unsafe();
+      break;
+    case simdjson::dom::element_type::DOUBLE:
+      *result = element.get_double().value_unsafe();
+      break;
+    case simdjson::dom::element_type::STRING:
+      *result = String(element.get_string().value_unsafe());
+      break;
+    case simdjson::dom::element_type::BOOL:
+      *result = element.get_bool().value_unsafe();
+      break;
+    case simdjson::dom::element_type::NULL_VALUE:
+      *result = nullptr;
+      break;
+  }
+}
+
+/** Hand a document parsed by simdjson to a SAX handler, with the same events
+ * as `Json::sax_parse()` would have sent. */
+static void simdjson_to_sax(
+    /** [in] The document, or a value in it. */
+    simdjson::dom::element element,
+    /** [in] The handler. */
+    nlohmann::json_sax<Json>* sax,
+    /** [in,out] Buffer for the keys and strings. */
+    std::string* scratch) {
+  switch (element.type()) {
+    case simdjson::dom::element_type::ARRAY: {
+      simdjson::dom::array array = element.get_array().value_unsafe();
+      sax->start_array(array.size());
+      for (simdjson::dom::element child : array) {
+        simdjson_to_sax(child, sax, scratch);
+      }
+      sax->end_array();
+      break;
+    }
+    case simdjson::dom::element_type::OBJECT: {
+      simdjson::dom::object object = element.get_object().value_unsafe();
+      sax->start_object(object.size());
+      for (simdjson::dom::key_value_pair member : object) {
+        scratch->assign(member.key);
+        sax->key(*scratch);
+        simdjson_to_sax(member.value, sax, scratch);
+      }
+      sax->end_object();
+      break;
+    }
+    case simdjson::dom::element_type::INT64: {
+      const int64_t value = element.get_int64().value_unsafe();
+      if (value < 0) {
+        sax->number_integer(value);
+      } else {
+        sax->number_unsigned(static_cast<uint64_t>(value));
+      }
+      break;
+    }
+    case simdjson::dom::element_type::UINT64:
+      sax->number_unsigned(element.get_uint64().value_unsafe());
+      break;
+    case simdjson::dom::element_type::DOUBLE:
+      scratch->clear();
+      sax->number_float(element.get_double().value_unsafe(), *scratch);
+      break;
+    case simdjson::dom::element_type::STRING:
+      scratch->assign(element.get_string().value_unsafe());
+      sax->string(*scratch);
+      break;
+    case simdjson::dom::element_type::BOOL:
+      sax->boolean(element.get_bool().value_unsafe());
+      break;
+    case simdjson::dom::element_type::NULL_VALUE:
+      sax->null();
+      break;
+  }
+}
+#endif
+
+/** Parse a string into a `Json` or `ArenaJson`, see `Client::ParseJson()`. */
+template <class JsonType>
+static void parse_json(
+    /** [in] String to parse. */
+    const std::string& input,
+    /** [out] Parse result. */
+    JsonType* result) {
+#ifdef IPFS_WITH_SIMDJSON
+  simdjson::dom::element root;
+  if (simdjson_parse(input, &root)) {
+    simdjson_to_json(root, result);
+    return;
+  }
+  /* nlohmann::json either accepts it after all or explains what is wrong. */
+#endif
+  try {
+    *result = JsonType::parse(input);
+  } catch (const typename JsonType::parse_error& e) {
+    throw std::runtime_error(parse_error_message(e) + "\nInput JSON:\n" +
+                             excerpt(input, e.byte));
+  } catch (const std::exception& e) {
+    throw std::runtime_error(parse_error_message(e) + "\nInput JSON:\n" +
+                             excerpt(input));
+  }
+}
+
 Client::Client(const std::string& host, long port, const std::string& timeout,
                const std::string& protocol, const std::string& apiPath,
                bool verbose)
@@ -40,8 +262,25 @@ Client::Client(const std::string& host, long port, const std::string& timeout,
       std::unique_ptr<http::TransportCurl>(new http::TransportCurl(verbose));
 }
 
+Client::Client(std::unique_ptr<http::Transport> transport,
+               const std::string& host, long port, const std::string& timeout,
+               const std::string& protocol, const std::string& apiPath)
+    : url_prefix_(protocol + host + ":" + std::to_string(port) + apiPath),
+      http_(std::move(transport)),
+      timeout_value_(timeout) {}
+
+Client::Client(std::shared_ptr<http::Transport> transport,
+               const std::string& url_prefix, const std::string& timeout,
+               const http::FetchOptions& options)
+    : url_prefix_(url_prefix),
+      http_(std::move(transport)),
+      timeout_value_(timeout),
+      options_(options) {}
+
 Client::Client(const Client& other)
-    : url_prefix_(other.url_prefix_), timeout_value_(other.timeout_value_) {
+    : url_prefix_(other.url_prefix_),
+      timeout_value_(other.timeout_value_),
+      options_(other.options_) {
   http_ = nullptr;
   if (other.http_) {
     http_ = other.http_->Clone();
@@ -50,7 +289,8 @@ Client::Client(const Client& other)
 
 Client::Client(Client&& other) noexcept
     : url_prefix_(std::move(other.url_prefix_)),
-      http_(std::move(other.http_)) {}
+      http_(std::move(other.http_)),
+      options_(std::move(other.options_)) {}
 
 Client& Client::operator=(const Client& other) {
   if (this == &other) {
@@ -59,6 +299,7 @@ Client& Client::operator=(const Client& other) {
 
   url_prefix_ = other.url_prefix_;
   timeout_value_ = other.timeout_value_;
+  options_ = other.options_;
 
   http_ = nullptr;
   if (other.http_) {
@@ -75,6 +316,7 @@ Client& Client::operator=(Client&& other) noexcept {
 
   url_prefix_ = std::move(other.url_prefix_);
   timeout_value_ = std::move(other.timeout_value_);
+  options_ = std::move(other.options_);
 
   http_ = std::move(other.http_);
 
@@ -83,12 +325,26 @@ Client& Client::operator=(Client&& other) noexcept {
 
 Client::~Client() = default;
 
+Client Client::WithOptions(const http::FetchOptions& options) const {
+  return Client(http_, url_prefix_, timeout_value_, options);
+}
+
 void Client::Id(Json* id) { FetchAndParseJson(MakeUrl("id"), id); }
 
+AsyncResult Client::IdAsync(Json* id, http::FetchCallback on_done) {
+  return FetchAndParseJsonAsync(MakeUrl("id"), {}, id, nullptr,
+                                std::move(on_done));
+}
+
 void Client::Version(Json* version) {
   FetchAndParseJson(MakeUrl("version"), version);
 }
 
+AsyncResult Client::VersionAsync(Json* version, http::FetchCallback on_done) {
+  return FetchAndParseJsonAsync(MakeUrl("version"), {}, version, nullptr,
+                                std::move(on_done));
+}
+
 void Client::ConfigGet(const std::string& key, Json* config) {
   std::string url;
 
@@ -115,56 +371,88 @@ void Client::ConfigGet(const std::string& key, Json* config) {
   }
 }
 
+AsyncResult Client::ConfigGetAsync(const std::string& key, Json* config,
+                                   http::FetchCallback on_done) {
+  if (key.empty()) {
+    return FetchAndParseJsonAsync(MakeUrl("config/show"), {}, config, nullptr,
+                                  std::move(on_done));
+  }
+
+  return FetchAndParseJsonAsync(
+      MakeUrl("config", {{"arg", key}}), {}, config,
+      [config]() { GetProperty(*config, "Value", 0, config); },
+      std::move(on_done));
+}
+
 void Client::ConfigSet(const std::string& key, const Json& value) {
   Json unused;
   FetchAndParseJson(MakeUrl("config", {{"arg", key}, {"arg", value.dump()}}),
                     &unused);
 }
 
+AsyncResult Client::ConfigSetAsync(const std::string& key, const Json& value,
+                                   http::FetchCallback on_done) {
+  auto unused = std::make_shared<Json>();
+  return FetchAndParseJsonAsync(
+      MakeUrl("config", {{"arg", key}, {"arg", value.dump()}}), {},
+      unused.get(), [unused]() {}, std::move(on_done));
+}
+
 void Client::ConfigReplace(const Json& config) {
   std::stringstream unused;
-  http_->Fetch(MakeUrl("config/replace"),
-               {{"new_config.json", http::FileUpload::Type::kFileContents,
-                 config.dump()}},
-               &unused);
+  Fetch(MakeUrl("config/replace"),
+        {{"new_config.json", http::FileUpload::Type::kFileContents,
+          config.dump()}},
+        &unused);
 }
 
-void Client::DhtFindPeer(const std::string& peer_id, Json* addresses) {
-  std::stringstream body;
-
-  http_->Fetch(MakeUrl("routing/findpeer", {{"arg", peer_id}}), {}, &body);
-
-  /* Find the addresses of the requested peer in the response. It consists
-  of many lines like this:
-
-  {..., "Responses":[{"Addrs":["...","..."],"ID":"peer_id"}], ...}
-
-  */
-  std::string line;
-  while (std::getline(body, line)) {
-    Json json_chunk;
-
-    ParseJson(line, &json_chunk);
+AsyncResult Client::ConfigReplaceAsync(const Json& config,
+                                       http::FetchCallback on_done) {
+  auto unused = std::make_shared<std::stringstream>();
+  return FetchAsync(MakeUrl("config/replace"),
+                    {{"new_config.json", http::FileUpload::Type::kFileContents,
+                      config.dump()}},
+                    unused.get(), [unused]() {}, std::move(on_done));
+}
 
-    if (json_chunk["Responses"].is_array()) {
-      for (auto& r : json_chunk["Responses"]) {
-        if (r["ID"] == peer_id) {
-          *addresses = r["Addrs"];
-          return;
-        }
-      }
-    }
+void Client::DhtFindPeer(const std::string& peer_id, Json* addresses) {
+  /* The DHT query goes on for a while after the peer has turned up, but
+  there is no need to wait for it. */
+  bool found = false;
+  auto sink = JsonRecordSinkWhile([&](const Json& record) {
+    found = FindPeerAddresses(record, peer_id, addresses);
+    return !found;
+  });
+
+  Fetch(MakeUrl("routing/findpeer", {{"arg", peer_id}}), {}, sink.get());
+
+  if (!found) {
+    throw std::runtime_error("Could not find info for peer " + peer_id +
+                             " in the response");
   }
+}
 
-  throw std::runtime_error("Could not find info for peer " + peer_id +
-                           " in response: " + body.str());
+AsyncResult Client::DhtFindPeerAsync(const std::string& peer_id,
+                                     Json* addresses,
+                                     http::FetchCallback on_done) {
+  auto found = std::make_shared<bool>(false);
+  auto sink =
+      JsonRecordSinkWhile([found, peer_id, addresses](const Json& record) {
+        *found = FindPeerAddresses(record, peer_id, addresses);
+        return !*found;
+      });
+  return FetchAsync(
+      MakeUrl("routing/findpeer", {{"arg", peer_id}}), {}, sink.get(),
+      [sink, found, peer_id]() {
+        if (!*found) {
+          throw std::runtime_error("Could not find info for peer " + peer_id +
+                                   " in the response");
+        }
+      },
+      std::move(on_done));
 }
 
 void Client::DhtFindProvs(const std::string& hash, Json* providers) {
-  std::stringstream body;
-
-  http_->Fetch(MakeUrl("routing/findprovs", {{"arg", hash}}), {}, &body);
-
   /* The reply consists of multiple lines, each one of which is a JSON, for
   example:
 
@@ -180,39 +468,224 @@ void Client::DhtFindProvs(const std::string& hash, Json* providers) {
     {"Extra":"","ID":"QmWmJvCpjMuBZX4MYWupb9GB3qNYVa1igYCsAQfSHmFJde","Responses":null,"Type":0}
   ]
   */
+  DhtFindProvs(hash, [providers](const Json& record) {
+    providers->push_back(record);
+  });
+}
+
+void Client::DhtFindProvs(const std::string& hash,
+                          const JsonRecordCallback& on_record) {
+  auto sink = JsonRecordSink(on_record);
+  Fetch(MakeUrl("routing/findprovs", {{"arg", hash}}), {}, sink.get());
+}
 
-  std::string line;
-  while (std::getline(body, line)) {
-    Json json_chunk;
+AsyncResult Client::DhtFindProvsAsync(const std::string& hash, Json* providers,
+                                      http::FetchCallback on_done) {
+  return DhtFindProvsAsync(
+      hash, [providers](const Json& record) { providers->push_back(record); },
+      std::move(on_done));
+}
 
-    ParseJson(line, &json_chunk);
+AsyncResult Client::DhtFindProvsAsync(const std::string& hash,
+                                      JsonRecordCallback on_record,
+                                      http::FetchCallback on_done) {
+  auto sink = JsonRecordSink(std::move(on_record));
+  return FetchAsync(MakeUrl("routing/findprovs", {{"arg", hash}}), {},
+                    sink.get(), [sink]() {}, std::move(on_done));
+}
 
-    providers->push_back(json_chunk);
+/** @return Parameters of a `routing/findprovs` request. */
+static std::vector<std::pair<std::string, std::string>> findprovs_parameters(
+    /** [in] Multihash whose providers to find. */
+    const std::string& hash,
+    /** [in] Number of providers to find, 0 for the daemon's default. */
+    size_t num_providers) {
+  std::vector<std::pair<std::string, std::string>> parameters = {
+      {"arg", hash}};
+  if (num_providers > 0) {
+    parameters.push_back({"num-providers", std::to_string(num_providers)});
   }
+  return parameters;
+}
+
+void Client::DhtFindProvs(const std::string& hash, size_t num_providers,
+                          Json* providers) {
+  DhtFindProvs(hash, num_providers, [providers](const Json& provider) {
+    providers->push_back(provider);
+    return true;
+  });
+}
+
+void Client::DhtFindProvs(const std::string& hash, size_t num_providers,
+                          const JsonRecordVisitor& on_provider) {
+  auto sink = JsonRecordSinkWhile(ProvidersOf(num_providers, on_provider));
+  Fetch(MakeUrl("routing/findprovs", findprovs_parameters(hash, num_providers)),
+        {}, sink.get());
+}
+
+AsyncResult Client::DhtFindProvsAsync(const std::string& hash,
+                                      size_t num_providers, Json* providers,
+                                      http::FetchCallback on_done) {
+  return DhtFindProvsAsync(
+      hash, num_providers,
+      [providers](const Json& provider) {
+        providers->push_back(provider);
+        return true;
+      },
+      std::move(on_done));
+}
+
+AsyncResult Client::DhtFindProvsAsync(const std::string& hash,
+                                      size_t num_providers,
+                                      JsonRecordVisitor on_provider,
+                                      http::FetchCallback on_done) {
+  auto sink =
+      JsonRecordSinkWhile(ProvidersOf(num_providers, std::move(on_provider)));
+  return FetchAsync(
+      MakeUrl("routing/findprovs", findprovs_parameters(hash, num_providers)),
+      {}, sink.get(), [sink]() {}, std::move(on_done));
 }
 
 void Client::BlockGet(const std::string& block_id, std::iostream* block) {
-  http_->Fetch(MakeUrl("block/get", {{"arg", block_id}}), {}, block);
+  Fetch(MakeUrl("block/get", {{"arg", block_id}}), {}, block);
+}
+
+AsyncResult Client::BlockGetAsync(const std::string& block_id,
+                                  std::iostream* block,
+                                  http::FetchCallback on_done) {
+  return FetchAsync(MakeUrl("block/get", {{"arg", block_id}}), {}, block,
+                    nullptr, std::move(on_done));
+}
+
+void Client::BlockGet(const std::string& block_id, http::ResponseSink* block) {
+  Fetch(MakeUrl("block/get", {{"arg", block_id}}), {}, block);
+}
+
+AsyncResult Client::BlockGetAsync(const std::string& block_id,
+                                  http::ResponseSink* block,
+                                  http::FetchCallback on_done) {
+  return FetchAsync(MakeUrl("block/get", {{"arg", block_id}}), {}, block,
+                    nullptr, std::move(on_done));
 }
 
 void Client::BlockPut(const http::FileUpload& block, Json* stat) {
   FetchAndParseJson(MakeUrl("block/put"), {block}, stat);
 }
 
+AsyncResult Client::BlockPutAsync(const http::FileUpload& block, Json* stat,
+                                  http::FetchCallback on_done) {
+  return FetchAndParseJsonAsync(MakeUrl("block/put"), {block}, stat, nullptr,
+                                std::move(on_done));
+}
+
 void Client::BlockStat(const std::string& block_id, Json* stat) {
   FetchAndParseJson(MakeUrl("block/stat", {{"arg", block_id}}), stat);
 }
 
+AsyncResult Client::BlockStatAsync(const std::string& block_id, Json* stat,
+                                   http::FetchCallback on_done) {
+  return FetchAndParseJsonAsync(MakeUrl("block/stat", {{"arg", block_id}}), {},
+                                stat, nullptr, std::move(on_done));
+}
+
+void Client::BlockStat(const std::string& block_id, BlockStatResult* stat) {
+  std::string body;
+
+  Fetch(MakeUrl("block/stat", {{"arg", block_id}}), {}, &body);
+
+  ParseBlockStat(body, stat);
+}
+
+AsyncResult Client::BlockStatAsync(const std::string& block_id,
+                                   BlockStatResult* stat,
+                                   http::FetchCallback on_done) {
+  auto body = std::make_shared<std::string>();
+  return FetchAsync(
+      MakeUrl("block/stat", {{"arg", block_id}}), {}, body.get(),
+      [body, stat]() { ParseBlockStat(*body, stat); },
+      std::move(on_done));
+}
+
 void Client::FilesGet(const std::string& path, std::iostream* response) {
-  http_->Fetch(MakeUrl("cat", {{"arg", path}}), {}, response);
+  Fetch(MakeUrl("cat", {{"arg", path}}), {}, response);
+}
+
+AsyncResult Client::FilesGetAsync(const std::string& path,
+                                  std::iostream* response,
+                                  http::FetchCallback on_done) {
+  return FetchAsync(MakeUrl("cat", {{"arg", path}}), {}, response, nullptr,
+                    std::move(on_done));
+}
+
+void Client::FilesGet(const std::string& path, http::ResponseSink* response) {
+  Fetch(MakeUrl("cat", {{"arg", path}}), {}, response);
+}
+
+AsyncResult Client::FilesGetAsync(const std::string& path,
+                                  http::ResponseSink* response,
+                                  http::FetchCallback on_done) {
+  return FetchAsync(MakeUrl("cat", {{"arg", path}}), {}, response, nullptr,
+                    std::move(on_done));
+}
+
+void Client::FilesGetToFd(const std::string& path, int fd,
+                          const http::FdSinkOptions& options) {
+  http::FdSink sink(fd, options);
+  FilesGet(path, &sink);
+}
+
+AsyncResult Client::FilesGetToFdAsync(const std::string& path, int fd,
+                                      const http::FdSinkOptions& options,
+                                      http::FetchCallback on_done) {
+  auto sink = std::make_shared<http::FdSink>(fd, options);
+  return FetchAsync(MakeUrl("cat", {{"arg", path}}), {}, sink.get(),
+                    [sink]() {}, std::move(on_done));
 }
 
 void Client::FilesAdd(const std::vector<http::FileUpload>& files,
                       Json* result) {
-  std::stringstream body;
+  /* A temporary JSON object to facilitate creating the result in case the
+  reply lines are out of order, see CollectFilesAdd(). */
+  Json by_path;
+  size_t line_number = 0;
 
-  http_->Fetch(MakeUrl("add", {{"progress", "true"}}), files, &body);
+  FilesAdd(files, [&](const Json& record) {
+    CollectFilesAdd(record, ++line_number, &by_path);
+  });
 
+  FinishFilesAdd(by_path, result);
+}
+
+void Client::FilesAdd(const std::vector<http::FileUpload>& files,
+                      const JsonRecordCallback& on_record) {
+  auto sink = JsonRecordSink(on_record);
+  Fetch(MakeUrl("add", {{"progress", "true"}}), files, sink.get());
+}
+
+AsyncResult Client::FilesAddAsync(
+    const std::vector<http::FileUpload>& files, Json* result,
+    http::FetchCallback on_done) {
+  auto by_path = std::make_shared<Json>();
+  auto line_number = std::make_shared<size_t>(0);
+  auto sink = JsonRecordSink([by_path, line_number](const Json& record) {
+    CollectFilesAdd(record, ++*line_number, by_path.get());
+  });
+  return FetchAsync(
+      MakeUrl("add", {{"progress", "true"}}), files, sink.get(),
+      [sink, by_path, result]() { FinishFilesAdd(*by_path, result); },
+      std::move(on_done));
+}
+
+AsyncResult Client::FilesAddAsync(const std::vector<http::FileUpload>& files,
+                                  JsonRecordCallback on_record,
+                                  http::FetchCallback on_done) {
+  auto sink = JsonRecordSink(std::move(on_record));
+  return FetchAsync(MakeUrl("add", {{"progress", "true"}}), files, sink.get(),
+                    [sink]() {}, std::move(on_done));
+}
+
+void Client::CollectFilesAdd(const Json& record, size_t line_number,
+                             Json* by_path) {
   /* The reply consists of multiple lines, each one of which is a JSON, for
   example:
 
@@ -228,40 +701,32 @@ void Client::FilesAdd(const std::vector<http::FileUpload>& files,
     { "path": "bar.txt", "hash": "QmVj...", "size": 1176 }
   ]
 
-  and return it to the caller. */
-
-  /* A temporary JSON object to facilitate creating the result in case the
-  reply lines are out of order. This one looks like:
+  and return it to the caller. On the way, the results are kept by path in
+  case the reply lines are out of order:
   {
     "foo.txt": { "path": "foo.txt", "hash": "QmWP...", "size": 4 }
     "bar.txt": { "path": "foo.txt", "hash": "QmVj...", "size": 1176 }
   }
   */
-  Json temp;
-
-  std::string line;
-  for (size_t i = 1; std::getline(body, line); ++i) {
-    Json json_chunk;
+  std::string path;
+  GetProperty(record, "Name", line_number, &path);
 
-    ParseJson(line, &json_chunk);
+  Json& entry = (*by_path)[path];
+  entry["path"] = path;
 
-    std::string path;
-    GetProperty(json_chunk, "Name", i, &path);
-
-    temp[path]["path"] = path;
-
-    static const char* hash = "Hash";
-    if (json_chunk.find(hash) != json_chunk.end()) {
-      temp[path]["hash"] = json_chunk[hash];
-    }
+  static const char* hash = "Hash";
+  if (record.find(hash) != record.end()) {
+    entry["hash"] = record[hash];
+  }
 
-    static const char* bytes = "Bytes";
-    if (json_chunk.find(bytes) != json_chunk.end()) {
-      temp[path]["size"] = json_chunk[bytes];
-    }
+  static const char* bytes = "Bytes";
+  if (record.find(bytes) != record.end()) {
+    entry["size"] = record[bytes];
   }
+}
 
-  for (Json::iterator it = temp.begin(); it != temp.end(); ++it) {
+void Client::FinishFilesAdd(const Json& by_path, Json* result) {
+  for (Json::const_iterator it = by_path.begin(); it != by_path.end(); ++it) {
     result->push_back(it.value());
   }
 }
@@ -270,6 +735,42 @@ void Client::FilesLs(const std::string& path, Json* json) {
   FetchAndParseJson(MakeUrl("file/ls", {{"arg", path}}), {}, json);
 }
 
+AsyncResult Client::FilesLsAsync(const std::string& path, Json* result,
+                                 http::FetchCallback on_done) {
+  return FetchAndParseJsonAsync(MakeUrl("file/ls", {{"arg", path}}), {},
+                                result, nullptr, std::move(on_done));
+}
+
+void Client::FilesLs(const std::string& path, std::pmr::memory_resource* arena,
+                     ArenaJson* json) {
+  FetchAndParseJson(MakeUrl("file/ls", {{"arg", path}}), arena, json);
+}
+
+AsyncResult Client::FilesLsAsync(const std::string& path,
+                                 std::pmr::memory_resource* arena,
+                                 ArenaJson* json, http::FetchCallback on_done) {
+  return FetchAndParseJsonAsync(MakeUrl("file/ls", {{"arg", path}}), arena,
+                                json, std::move(on_done));
+}
+
+void Client::FilesLs(const std::string& path, std::vector<LsEntry>* entries) {
+  std::string body;
+
+  Fetch(MakeUrl("file/ls", {{"arg", path}}), {}, &body);
+
+  ParseFilesLs(body, entries);
+}
+
+AsyncResult Client::FilesLsAsync(const std::string& path,
+                                 std::vector<LsEntry>* entries,
+                                 http::FetchCallback on_done) {
+  auto body = std::make_shared<std::string>();
+  return FetchAsync(
+      MakeUrl("file/ls", {{"arg", path}}), {}, body.get(),
+      [body, entries]() { ParseFilesLs(*body, entries); },
+      std::move(on_done));
+}
+
 void Client::KeyGen(const std::string& key_name, const std::string& key_type,
                     size_t key_size, std::string* generated_key) {
   Json response;
@@ -281,21 +782,58 @@ void Client::KeyGen(const std::string& key_name, const std::string& key_type,
   *generated_key = response["Id"];
 }
 
+AsyncResult Client::KeyGenAsync(const std::string& key_name,
+                                const std::string& key_type, size_t key_size,
+                                std::string* key_id,
+                                http::FetchCallback on_done) {
+  auto response = std::make_shared<Json>();
+  return FetchAndParseJsonAsync(
+      MakeUrl("key/gen", {{"arg", key_name},
+                          {"type", key_type},
+                          {"size", std::to_string(key_size)}}),
+      {}, response.get(), [response, key_id]() { *key_id = (*response)["Id"]; },
+      std::move(on_done));
+}
+
 void Client::KeyList(Json* key_list) {
   Json response;
   FetchAndParseJson(MakeUrl("key/list", {}), &response);
   *key_list = response["Keys"];
 }
 
+AsyncResult Client::KeyListAsync(Json* key_list, http::FetchCallback on_done) {
+  auto response = std::make_shared<Json>();
+  return FetchAndParseJsonAsync(
+      MakeUrl("key/list", {}), {}, response.get(),
+      [response, key_list]() { *key_list = (*response)["Keys"]; },
+      std::move(on_done));
+}
+
 void Client::KeyRm(const std::string& key_name) {
   std::stringstream body;
-  http_->Fetch(MakeUrl("key/rm", {{"arg", key_name}}), {}, &body);
+  Fetch(MakeUrl("key/rm", {{"arg", key_name}}), {}, &body);
+}
+
+AsyncResult Client::KeyRmAsync(const std::string& key_name,
+                               http::FetchCallback on_done) {
+  auto body = std::make_shared<std::stringstream>();
+  return FetchAsync(MakeUrl("key/rm", {{"arg", key_name}}), {}, body.get(),
+                    [body]() {}, std::move(on_done));
 }
 
 void Client::KeyRename(const std::string& old_key, const std::string& new_key) {
   std::stringstream body;
-  http_->Fetch(MakeUrl("key/rename", {{"arg", old_key}, {"arg", new_key}}), {},
-               &body);
+  Fetch(MakeUrl("key/rename", {{"arg", old_key}, {"arg", new_key}}), {},
+        &body);
+}
+
+AsyncResult Client::KeyRenameAsync(const std::string& old_key,
+                                   const std::string& new_key,
+                                   http::FetchCallback on_done) {
+  auto body = std::make_shared<std::stringstream>();
+  return FetchAsync(
+      MakeUrl("key/rename", {{"arg", old_key}, {"arg", new_key}}), {},
+      body.get(), [body]() {}, std::move(on_done));
 }
 
 void Client::NamePublish(const std::string& object_id,
@@ -314,6 +852,23 @@ void Client::NamePublish(const std::string& object_id,
   GetProperty(response, "Name", 0, name_id);
 }
 
+AsyncResult Client::NamePublishAsync(const std::string& object_id,
+                                     const std::string& key_name,
+                                     const Json& options, std::string* name_id,
+                                     http::FetchCallback on_done) {
+  std::vector<std::pair<std::string, std::string>> args;
+  args = {{"arg", object_id}, {"key", key_name}};
+  for (auto& elt : options.items()) {
+    args.push_back({elt.key(), elt.value()});
+  }
+
+  auto response = std::make_shared<Json>();
+  return FetchAndParseJsonAsync(
+      MakeUrl("name/publish", args), {}, response.get(),
+      [response, name_id]() { GetProperty(*response, "Name", 0, name_id); },
+      std::move(on_done));
+}
+
 void Client::NameResolve(const std::string& name_id, std::string* path_string) {
   Json response;
 
@@ -322,8 +877,53 @@ void Client::NameResolve(const std::string& name_id, std::string* path_string) {
   GetProperty(response, "Path", 0, path_string);
 }
 
+AsyncResult Client::NameResolveAsync(const std::string& name_id,
+                                     std::string* path_string,
+                                     http::FetchCallback on_done) {
+  auto response = std::make_shared<Json>();
+  return FetchAndParseJsonAsync(
+      MakeUrl("name/resolve", {{"arg", name_id}}), {}, response.get(),
+      [response, path_string]() {
+        GetProperty(*response, "Path", 0, path_string);
+      },
+      std::move(on_done));
+}
+
 void Client::DagExport(std::string& cid, std::iostream* output) {
-  http_->Fetch(MakeUrl("dag/export", {{"arg", cid}, {"progress", "false"}}), {}, output);
+  Fetch(MakeUrl("dag/export", {{"arg", cid}, {"progress", "false"}}), {}, output);
+}
+
+AsyncResult Client::DagExportAsync(const std::string& cid,
+                                   std::iostream* output,
+                                   http::FetchCallback on_done) {
+  return FetchAsync(MakeUrl("dag/export", {{"arg", cid}, {"progress", "false"}}),
+                    {}, output, nullptr, std::move(on_done));
+}
+
+void Client::DagExport(const std::string& cid, http::ResponseSink* output) {
+  Fetch(MakeUrl("dag/export", {{"arg", cid}, {"progress", "false"}}), {},
+        output);
+}
+
+AsyncResult Client::DagExportAsync(const std::string& cid,
+                                   http::ResponseSink* output,
+                                   http::FetchCallback on_done) {
+  return FetchAsync(MakeUrl("dag/export", {{"arg", cid}, {"progress", "false"}}),
+                    {}, output, nullptr, std::move(on_done));
+}
+
+void Client::DagExportToFd(const std::string& cid, int fd,
+                           const http::FdSinkOptions& options) {
+  http::FdSink sink(fd, options);
+  DagExport(cid, &sink);
+}
+
+AsyncResult Client::DagExportToFdAsync(const std::string& cid, int fd,
+                                       const http::FdSinkOptions& options,
+                                       http::FetchCallback on_done) {
+  auto sink = std::make_shared<http::FdSink>(fd, options);
+  return FetchAsync(MakeUrl("dag/export", {{"arg", cid}, {"progress", "false"}}),
+                    {}, sink.get(), [sink]() {}, std::move(on_done));
 }
 
 void Client::DagImport(const http::FileUpload& data, bool pin, std::string* cid) {
@@ -332,29 +932,95 @@ void Client::DagImport(const http::FileUpload& data, bool pin, std::string* cid)
   response.at("Root").at("Cid").at("/").get_to(*cid);
 }
 
+AsyncResult Client::DagImportAsync(const http::FileUpload& data, bool pin,
+                                   std::string* cid,
+                                   http::FetchCallback on_done) {
+  auto response = std::make_shared<Json>();
+  return FetchAndParseJsonAsync(
+      MakeUrl("dag/import", {{"pin-roots", std::to_string(pin)}}), {data},
+      response.get(),
+      [response, cid]() { response->at("Root").at("Cid").at("/").get_to(*cid); },
+      std::move(on_done));
+}
+
 void Client::DagPut(Json* input, bool pin, std::string* cid) {
   Json response;
   FetchAndParseJson(MakeUrl("dag/put", {{"pin", std::to_string(pin)}}), {{"file", http::FileUpload::Type::kFileContents, input->dump()}}, &response);
   response.at("Cid").at("/").get_to(*cid);
 }
 
+AsyncResult Client::DagPutAsync(const Json& input, bool pin, std::string* cid,
+                                http::FetchCallback on_done) {
+  auto response = std::make_shared<Json>();
+  return FetchAndParseJsonAsync(
+      MakeUrl("dag/put", {{"pin", std::to_string(pin)}}),
+      {{"file", http::FileUpload::Type::kFileContents, input.dump()}},
+      response.get(),
+      [response, cid]() { response->at("Cid").at("/").get_to(*cid); },
+      std::move(on_done));
+}
+
 void Client::DagGet(const std::string& path, Json* data) {
   FetchAndParseJson(MakeUrl("dag/get", {{"arg", path}}), data);
 }
 
+AsyncResult Client::DagGetAsync(const std::string& path, Json* data,
+                                http::FetchCallback on_done) {
+  return FetchAndParseJsonAsync(MakeUrl("dag/get", {{"arg", path}}), {}, data,
+                                nullptr, std::move(on_done));
+}
+
+void Client::DagGet(const std::string& path, std::pmr::memory_resource* arena,
+                    ArenaJson* data) {
+  FetchAndParseJson(MakeUrl("dag/get", {{"arg", path}}), arena, data);
+}
+
+AsyncResult Client::DagGetAsync(const std::string& path,
+                                std::pmr::memory_resource* arena,
+                                ArenaJson* data, http::FetchCallback on_done) {
+  return FetchAndParseJsonAsync(MakeUrl("dag/get", {{"arg", path}}), arena,
+                                data, std::move(on_done));
+}
+
 void Client::DagResolve(const std::string& path, Json* json) {
   FetchAndParseJson(MakeUrl("dag/resolve", {{"arg", path}}), json);
 }
 
+AsyncResult Client::DagResolveAsync(const std::string& path, Json* json,
+                                    http::FetchCallback on_done) {
+  return FetchAndParseJsonAsync(MakeUrl("dag/resolve", {{"arg", path}}), {},
+                                json, nullptr, std::move(on_done));
+}
+
 void Client::DagStat(const std::string& root_id, Json* json) {
   FetchAndParseJson(MakeUrl("dag/stat", {{"arg", root_id}, {"progress", "false"}}), json);
 }
 
+AsyncResult Client::DagStatAsync(const std::string& root_id, Json* json,
+                                 http::FetchCallback on_done) {
+  return FetchAndParseJsonAsync(
+      MakeUrl("dag/stat", {{"arg", root_id}, {"progress", "false"}}), {}, json,
+      nullptr, std::move(on_done));
+}
+
 void Client::PinAdd(const std::string& object_id) {
   Json response;
 
   FetchAndParseJson(MakeUrl("pin/add", {{"arg", object_id}}), &response);
 
+  CheckPinned(response, object_id);
+}
+
+AsyncResult Client::PinAddAsync(const std::string& object_id,
+                                http::FetchCallback on_done) {
+  auto response = std::make_shared<Json>();
+  return FetchAndParseJsonAsync(
+      MakeUrl("pin/add", {{"arg", object_id}}), {}, response.get(),
+      [response, object_id]() { CheckPinned(*response, object_id); },
+      std::move(on_done));
+}
+
+void Client::CheckPinned(const Json& response, const std::string& object_id) {
   Json pins_array;
   GetProperty(response, "Pins", 0, &pins_array);
 
@@ -366,17 +1032,69 @@ void Client::PinAdd(const std::string& object_id) {
 
   throw std::runtime_error(
       "Request to pin \"" + object_id +
-      "\" got a result that does not contain it as pinned: " + response.dump());
+      "\" got a result that does not contain it as pinned: " +
+      excerpt(response.dump()));
 }
 
 void Client::PinLs(Json* pinned) {
   FetchAndParseJson(MakeUrl("pin/ls"), pinned);
 }
 
+AsyncResult Client::PinLsAsync(Json* pinned, http::FetchCallback on_done) {
+  return FetchAndParseJsonAsync(MakeUrl("pin/ls"), {}, pinned, nullptr,
+                                std::move(on_done));
+}
+
+void Client::PinLs(std::pmr::memory_resource* arena, ArenaJson* pinned) {
+  FetchAndParseJson(MakeUrl("pin/ls"), arena, pinned);
+}
+
+AsyncResult Client::PinLsAsync(std::pmr::memory_resource* arena,
+                               ArenaJson* pinned, http::FetchCallback on_done) {
+  return FetchAndParseJsonAsync(MakeUrl("pin/ls"), arena, pinned,
+                                std::move(on_done));
+}
+
+void Client::PinLs(const PinVisitor& on_pin) {
+  auto sink = PinSink(on_pin);
+  Fetch(MakeUrl("pin/ls", {{"stream", "true"}}), {}, sink.get());
+}
+
+AsyncResult Client::PinLsAsync(PinVisitor on_pin, http::FetchCallback on_done) {
+  auto sink = PinSink(std::move(on_pin));
+  return FetchAsync(MakeUrl("pin/ls", {{"stream", "true"}}), {}, sink.get(),
+                    [sink]() {}, std::move(on_done));
+}
+
+void Client::PinLs(std::vector<PinInfo>* pins) {
+  pins->clear();
+  PinLs([pins](const PinInfo& pin) {
+    pins->push_back(pin);
+    return true;
+  });
+}
+
+AsyncResult Client::PinLsAsync(std::vector<PinInfo>* pins,
+                               http::FetchCallback on_done) {
+  pins->clear();
+  return PinLsAsync(
+      [pins](const PinInfo& pin) {
+        pins->push_back(pin);
+        return true;
+      },
+      std::move(on_done));
+}
+
 void Client::PinLs(const std::string& object_id, Json* pinned) {
   FetchAndParseJson(MakeUrl("pin/ls", {{"arg", object_id}}), pinned);
 }
 
+AsyncResult Client::PinLsAsync(const std::string& object_id, Json* pinned,
+                               http::FetchCallback on_done) {
+  return FetchAndParseJsonAsync(MakeUrl("pin/ls", {{"arg", object_id}}), {},
+                                pinned, nullptr, std::move(on_done));
+}
+
 void Client::PinRm(const std::string& object_id, PinRmOptions options) {
   Json response;
 
@@ -388,32 +1106,128 @@ void Client::PinRm(const std::string& object_id, PinRmOptions options) {
       &response);
 }
 
+AsyncResult Client::PinRmAsync(const std::string& object_id,
+                               PinRmOptions options,
+                               http::FetchCallback on_done) {
+  const std::string recursive =
+      options == PinRmOptions::RECURSIVE ? "true" : "false";
+
+  auto response = std::make_shared<Json>();
+  return FetchAndParseJsonAsync(
+      MakeUrl("pin/rm", {{"arg", object_id}, {"recursive", recursive}}), {},
+      response.get(), [response]() {}, std::move(on_done));
+}
+
 void Client::StatsBw(Json* bandwidth_info) {
   FetchAndParseJson(MakeUrl("stats/bw"), bandwidth_info);
 }
 
+AsyncResult Client::StatsBwAsync(Json* bandwidth_info,
+                                 http::FetchCallback on_done) {
+  return FetchAndParseJsonAsync(MakeUrl("stats/bw"), {}, bandwidth_info,
+                                nullptr, std::move(on_done));
+}
+
+void Client::StatsBw(BandwidthInfo* bandwidth_info) {
+  std::string body;
+
+  Fetch(MakeUrl("stats/bw"), {}, &body);
+
+  ParseStatsBw(body, bandwidth_info);
+}
+
+AsyncResult Client::StatsBwAsync(BandwidthInfo* bandwidth_info,
+                                 http::FetchCallback on_done) {
+  auto body = std::make_shared<std::string>();
+  return FetchAsync(
+      MakeUrl("stats/bw"), {}, body.get(),
+      [body, bandwidth_info]() { ParseStatsBw(*body, bandwidth_info); },
+      std::move(on_done));
+}
+
 void Client::StatsRepo(Json* repo_stats) {
   FetchAndParseJson(MakeUrl("stats/repo"), repo_stats);
 }
 
+AsyncResult Client::StatsRepoAsync(Json* repo_stats,
+                                   http::FetchCallback on_done) {
+  return FetchAndParseJsonAsync(MakeUrl("stats/repo"), {}, repo_stats, nullptr,
+                                std::move(on_done));
+}
+
 void Client::SwarmAddrs(Json* addresses) {
   FetchAndParseJson(MakeUrl("swarm/addrs"), addresses);
 }
 
+AsyncResult Client::SwarmAddrsAsync(Json* addresses,
+                                    http::FetchCallback on_done) {
+  return FetchAndParseJsonAsync(MakeUrl("swarm/addrs"), {}, addresses, nullptr,
+                                std::move(on_done));
+}
+
 void Client::SwarmConnect(const std::string& peer) {
   Json response;
   FetchAndParseJson(MakeUrl("swarm/connect", {{"arg", peer}}), &response);
 }
 
+AsyncResult Client::SwarmConnectAsync(const std::string& peer,
+                                      http::FetchCallback on_done) {
+  auto response = std::make_shared<Json>();
+  return FetchAndParseJsonAsync(MakeUrl("swarm/connect", {{"arg", peer}}), {},
+                                response.get(), [response]() {},
+                                std::move(on_done));
+}
+
 void Client::SwarmDisconnect(const std::string& peer) {
   Json response;
   FetchAndParseJson(MakeUrl("swarm/disconnect", {{"arg", peer}}), &response);
 }
 
+AsyncResult Client::SwarmDisconnectAsync(const std::string& peer,
+                                         http::FetchCallback on_done) {
+  auto response = std::make_shared<Json>();
+  return FetchAndParseJsonAsync(MakeUrl("swarm/disconnect", {{"arg", peer}}),
+                                {}, response.get(), [response]() {},
+                                std::move(on_done));
+}
+
 void Client::SwarmPeers(Json* peers) {
   FetchAndParseJson(MakeUrl("swarm/peers"), peers);
 }
 
+AsyncResult Client::SwarmPeersAsync(Json* peers, http::FetchCallback on_done) {
+  return FetchAndParseJsonAsync(MakeUrl("swarm/peers"), {}, peers, nullptr,
+                                std::move(on_done));
+}
+
+void Client::SwarmPeers(std::pmr::memory_resource* arena, ArenaJson* peers) {
+  FetchAndParseJson(MakeUrl("swarm/peers"), arena, peers);
+}
+
+AsyncResult Client::SwarmPeersAsync(std::pmr::memory_resource* arena,
+                                    ArenaJson* peers,
+                                    http::FetchCallback on_done) {
+  return FetchAndParseJsonAsync(MakeUrl("swarm/peers"), arena, peers,
+                                std::move(on_done));
+}
+
+void Client::SwarmPeers(std::vector<PeerInfo>* peers) {
+  std::string body;
+
+  Fetch(MakeUrl("swarm/peers", {{"latency", "true"}}), {}, &body);
+
+  ParseSwarmPeers(body, peers);
+}
+
+AsyncResult Client::SwarmPeersAsync(std::vector<PeerInfo>* peers,
+                                    http::FetchCallback on_done) {
+  auto body = std::make_shared<std::string>();
+  return FetchAsync(
+      MakeUrl("swarm/peers", {{"latency", "true"}}), {}, body.get(),
+      [body, peers]() { ParseSwarmPeers(*body, peers); },
+      std::move(on_done));
+}
+
 void Client::Abort() { http_->StopFetch(); }
 /**
  * @example threading_example.cc
@@ -423,6 +1237,26 @@ void Client::Abort() { http_->StopFetch(); }
 
 void Client::Reset() { http_->ResetFetch(); }
 
+void Client::Fetch(const std::string& url,
+                   const std::vector<http::FileUpload>& files,
+                   std::iostream* response) {
+  http::StreamSink sink(response);
+  Fetch(url, files, &sink);
+}
+
+void Client::Fetch(const std::string& url,
+                   const std::vector<http::FileUpload>& files,
+                   http::ResponseSink* sink) {
+  http_->Fetch(url, files, sink, OptionsFor(url));
+}
+
+void Client::Fetch(const std::string& url,
+                   const std::vector<http::FileUpload>& files,
+                   std::string* response) {
+  http::StringSink sink(response, kParsePadding);
+  Fetch(url, files, &sink);
+}
+
 void Client::FetchAndParseJson(const std::string& url, Json* response) {
   FetchAndParseJson(url, {}, response);
 }
@@ -430,19 +1264,610 @@ void Client::FetchAndParseJson(const std::string& url, Json* response) {
 void Client::FetchAndParseJson(const std::string& url,
                                const std::vector<http::FileUpload>& files,
                                Json* response) {
-  std::stringstream body;
+  std::string body;
 
-  http_->Fetch(url, files, &body);
+  Fetch(url, files, &body);
 
-  ParseJson(body.str(), response);
+  ParseJson(body, response);
 }
 
-void Client::ParseJson(const std::string& input, Json* result) {
-  try {
-    *result = Json::parse(input);
-  } catch (const std::exception& e) {
-    throw std::runtime_error(std::string(e.what()) + "\nInput JSON:\n" + input);
+void Client::FetchAndParseJson(const std::string& url,
+                               std::pmr::memory_resource* arena,
+                               ArenaJson* response) {
+  std::string body;
+
+  Fetch(url, {}, &body);
+
+  ArenaScope scope(arena);
+  parse_json(body, response);
+}
+
+AsyncResult Client::FetchAndParseJsonAsync(const std::string& url,
+                                           std::pmr::memory_resource* arena,
+                                           ArenaJson* response,
+                                           http::FetchCallback on_done) {
+  auto body = std::make_shared<std::string>();
+  return FetchAsync(
+      url, {}, body.get(),
+      [body, arena, response]() {
+        ArenaScope scope(arena);
+        parse_json(*body, response);
+      },
+      std::move(on_done));
+}
+
+AsyncResult Client::FetchAsync(const std::string& url,
+                               const std::vector<http::FileUpload>& files,
+                               std::iostream* response,
+                               std::function<void()> then,
+                               http::FetchCallback on_done) {
+  /* The sink lives as long as the completion callback. */
+  auto sink = std::make_shared<http::StreamSink>(response);
+  return FetchAsync(
+      url, files, sink.get(),
+      [sink, then = std::move(then)]() {
+        if (then) {
+          then();
+        }
+      },
+      std::move(on_done));
+}
+
+AsyncResult Client::FetchAsync(const std::string& url,
+                               const std::vector<http::FileUpload>& files,
+                               std::string* response,
+                               std::function<void()> then,
+                               http::FetchCallback on_done) {
+  /* The sink lives as long as the completion callback. */
+  auto sink = std::make_shared<http::StringSink>(response, kParsePadding);
+  return FetchAsync(
+      url, files, sink.get(),
+      [sink, then = std::move(then)]() {
+        if (then) {
+          then();
+        }
+      },
+      std::move(on_done));
+}
+
+AsyncResult Client::FetchAsync(const std::string& url,
+                               const std::vector<http::FileUpload>& files,
+                               http::ResponseSink* sink,
+                               std::function<void()> then,
+                               http::FetchCallback on_done) {
+  auto [result, complete] = AsyncResult::Create();
+
+  http_->FetchAsync(
+      url, files, sink, OptionsFor(url),
+      [complete = std::move(complete), then = std::move(then),
+       on_done = std::move(on_done)](std::exception_ptr error) {
+        if (!error && then) {
+          try {
+            then();
+          } catch (...) {
+            error = std::current_exception();
+          }
+        }
+        if (on_done) {
+          on_done(error);
+        }
+        complete(error);
+      });
+
+  return std::move(result);
+}
+
+AsyncResult Client::FetchAndParseJsonAsync(
+    const std::string& url, const std::vector<http::FileUpload>& files,
+    Json* response, std::function<void()> then, http::FetchCallback on_done) {
+  auto body = std::make_shared<std::string>();
+  return FetchAsync(
+      url, files, body.get(),
+      [body, response, then = std::move(then)]() {
+        ParseJson(*body, response);
+        if (then) {
+          then();
+        }
+      },
+      std::move(on_done));
+}
+
+std::shared_ptr<http::ResponseSink> Client::JsonRecordSinkWhile(
+    JsonRecordVisitor on_record) {
+  return std::make_shared<http::LineSink>(
+      [on_record = std::move(on_record)](const std::string& line) {
+        Json record;
+
+        ParseJson(line, &record);
+
+        return on_record(record);
+      });
+}
+
+std::shared_ptr<http::ResponseSink> Client::JsonRecordSink(
+    JsonRecordCallback on_record) {
+  return JsonRecordSinkWhile(
+      [on_record = std::move(on_record)](const Json& record) {
+        on_record(record);
+        return true;
+      });
+}
+
+/** @return Error for a response without a property that it should have. */
+static std::runtime_error missing_property(
+    /** [in] Name of the property. */
+    const std::string& name,
+    /** [in] The response. */
+    const std::string& input) {
+  return std::runtime_error(
+      "Unexpected reply: valid JSON, but without the \"" + name +
+      "\" property:\n" + excerpt(input));
+}
+
+/** SAX handler that keeps track of where the parser is in a document, so that
+ * the derived classes can pick the values that they need as they go by,
+ * without building a `Json`. The buffers of the keys are reused from one
+ * document to the next. */
+class JsonPicker : public nlohmann::json_sax<Json> {
+ public:
+  bool null() override { return true; }
+
+  bool boolean(bool) override { return true; }
+
+  bool number_integer(number_integer_t value) override {
+    OnNumber(value < 0 ? 0 : static_cast<uint64_t>(value),
+             static_cast<double>(value));
+    return true;
   }
+
+  bool number_unsigned(number_unsigned_t value) override {
+    OnNumber(value, static_cast<double>(value));
+    return true;
+  }
+
+  bool number_float(number_float_t value, const string_t&) override {
+    OnNumber(value < 0 ? 0 : static_cast<uint64_t>(value), value);
+    return true;
+  }
+
+  bool string(string_t& value) override {
+    OnString(value);
+    return true;
+  }
+
+  bool binary(binary_t&) override { return true; }
+
+  bool start_object(std::size_t) override {
+    OnObject();
+    Enter();
+    return true;
+  }
+
+  bool key(string_t& name) override {
+    keys_[depth_].assign(name);
+    return true;
+  }
+
+  bool end_object() override {
+    --depth_;
+    return true;
+  }
+
+  bool start_array(std::size_t) override {
+    Enter();
+    return true;
+  }
+
+  bool end_array() override {
+    --depth_;
+    return true;
+  }
+
+  bool parse_error(std::size_t position, const std::string&,
+                   const nlohmann::detail::exception& e) override {
+    error_ = parse_error_message(e);
+    error_position_ = position;
+    return false;
+  }
+
+ protected:
+  /** Parse a document, calling the `On...()` methods on the way.
+   *
+   * @throw std::runtime_error if it is not valid JSON */
+  void Walk(
+      /** [in] The document. */
+      const std::string& input) {
+    depth_ = 0;
+    keys_.resize(1);
+#ifdef IPFS_WITH_SIMDJSON
+    simdjson::dom::element root;
+    if (simdjson_parse(input, &root)) {
+      simdjson_to_sax(root, this, &scratch_);
+      return;
+    }
+#endif
+    if (!Json::sax_parse(input, this)) {
+      throw std::runtime_error(error_ + "\nInput JSON:\n" +
+                               excerpt(input, error_position_));
+    }
+  }
+
+  /** Called with every string. */
+  virtual void OnString(
+      /** [in] The string. */
+      const std::string&) {}
+
+  /** Called with every number. */
+  virtual void OnNumber(
+      /** [in] The number rounded towards zero, 0 if it is negative. */
+      uint64_t,
+      /** [in] The number. */
+      double) {}
+
+  /** Called at the start of every object, before its properties. */
+  virtual void OnObject() {}
+
+  /** @return Nesting level of the current value: 0 for the document itself,
+   * 1 for its properties or elements, and so on. */
+  size_t Depth() const { return depth_; }
+
+  /** @return Key of the value at a nesting level on the way to the current
+   * value, empty for an element of an array. `Key(Depth())` is the key of the
+   * current value. */
+  const std::string& Key(
+      /** [in] Nesting level, from 1 to `Depth()`. */
+      size_t level) const {
+    return keys_[level];
+  }
+
+ private:
+  /** Go one level deeper. */
+  void Enter() {
+    ++depth_;
+    if (keys_.size() <= depth_) {
+      keys_.emplace_back();
+    }
+    keys_[depth_].clear();
+  }
+
+  /** Nesting level of the current value. */
+  size_t depth_ = 0;
+
+  /** Keys on the way to the current value, by nesting level. */
+  std::vector<std::string> keys_;
+
+  /** Message of the parse error, if any. */
+  std::string error_;
+
+  /** Offset of the parse error in the document. */
+  size_t error_position_ = 0;
+
+#ifdef IPFS_WITH_SIMDJSON
+  /** Buffer for the keys and strings that simdjson has parsed. */
+  std::string scratch_;
+#endif
+};
+
+/** Reuse the next element of a list that is being parsed into, or append one.
+ * @return The element. */
+template <class Element>
+static Element& next_element(
+    /** [in,out] The list. */
+    std::vector<Element>* list,
+    /** [in,out] Number of elements parsed so far. */
+    size_t* count) {
+  if (*count == list->size()) {
+    list->emplace_back();
+  }
+  return (*list)[(*count)++];
+}
+
+/** Parses a record of a streamed `pin/ls` response, for example
+ * `{"Cid":"QmUNLLsPACCz1vL...","Name":"","Type":"recursive"}`. */
+class PinRecordParser : public JsonPicker {
+ public:
+  /** Parse a record.
+   *
+   * @throw std::runtime_error if it is not valid JSON or has no CID */
+  void Parse(
+      /** [in] The record. */
+      const std::string& line,
+      /** [out] The pinned object. */
+      PinInfo* pin) {
+    pin_ = pin;
+    pin_->cid.clear();
+    pin_->type = PinType::kOther;
+    has_cid_ = false;
+
+    Walk(line);
+
+    if (!has_cid_) {
+      throw missing_property("Cid", line);
+    }
+  }
+
+ protected:
+  void OnString(const std::string& value) override {
+    if (Depth() != 1) {
+      return;
+    }
+    if (Key(1) == "Cid") {
+      pin_->cid.assign(value);
+      has_cid_ = true;
+    } else if (Key(1) == "Type") {
+      if (value == "recursive") {
+        pin_->type = PinType::kRecursive;
+      } else if (value == "direct") {
+        pin_->type = PinType::kDirect;
+      } else if (value == "indirect") {
+        pin_->type = PinType::kIndirect;
+      }
+    }
+  }
+
+ private:
+  /** Where to parse into. */
+  PinInfo* pin_ = nullptr;
+
+  /** Whether the record had a CID. */
+  bool has_cid_ = false;
+};
+
+void Client::ParseBlockStat(const std::string& input, BlockStatResult* stat) {
+  class Parser : public JsonPicker {
+   public:
+    explicit Parser(BlockStatResult* stat) : stat_(stat) {}
+
+    void Parse(const std::string& input) {
+      Walk(input);
+      if (!has_key_) {
+        throw missing_property("Key", input);
+      }
+      if (!has_size_) {
+        throw missing_property("Size", input);
+      }
+    }
+
+   protected:
+    void OnString(const std::string& value) override {
+      if (Depth() == 1 && Key(1) == "Key") {
+        stat_->cid.assign(value);
+        has_key_ = true;
+      }
+    }
+
+    void OnNumber(uint64_t integer, double) override {
+      if (Depth() == 1 && Key(1) == "Size") {
+        stat_->size = integer;
+        has_size_ = true;
+      }
+    }
+
+   private:
+    /** Where to parse into. */
+    BlockStatResult* stat_;
+
+    /** Whether the response had the id of the block. */
+    bool has_key_ = false;
+
+    /** Whether the response had the size of the block. */
+    bool has_size_ = false;
+  };
+
+  Parser(stat).Parse(input);
+}
+
+void Client::ParseFilesLs(const std::string& input,
+                          std::vector<LsEntry>* entries) {
+  /* {"Arguments":{...},
+      "Objects":{"Qm...":{..., "Links":[{"Name":...}, ...]}}} */
+  class Parser : public JsonPicker {
+   public:
+    explicit Parser(std::vector<LsEntry>* entries) : entries_(entries) {}
+
+    void Parse(const std::string& input) {
+      Walk(input);
+      entries_->resize(count_);
+    }
+
+   protected:
+    void OnObject() override {
+      if (Depth() == 4 && Key(3) == "Links" && Key(1) == "Objects") {
+        entry_ = &next_element(entries_, &count_);
+        entry_->name.clear();
+        entry_->hash.clear();
+        entry_->size = 0;
+        entry_->type = FileType::kOther;
+      }
+    }
+
+    void OnString(const std::string& value) override {
+      if (!InLink()) {
+        return;
+      }
+      if (Key(5) == "Name") {
+        entry_->name.assign(value);
+      } else if (Key(5) == "Hash") {
+        entry_->hash.assign(value);
+      } else if (Key(5) == "Type") {
+        if (value == "File" || value == "Raw") {
+          entry_->type = FileType::kFile;
+        } else if (value == "Directory" || value == "HAMTShard") {
+          entry_->type = FileType::kDirectory;
+        } else if (value == "Symlink") {
+          entry_->type = FileType::kSymlink;
+        }
+      }
+    }
+
+    void OnNumber(uint64_t integer, double) override {
+      if (InLink() && Key(5) == "Size") {
+        entry_->size = integer;
+      }
+    }
+
+   private:
+    /** @return Whether the current value is a property of a link. */
+    bool InLink() const {
+      return entry_ != nullptr && Depth() == 5 && Key(3) == "Links" &&
+             Key(1) == "Objects";
+    }
+
+    /** Where to parse into. */
+    std::vector<LsEntry>* entries_;
+
+    /** Number of entries parsed so far. */
+    size_t count_ = 0;
+
+    /** The entry being parsed. */
+    LsEntry* entry_ = nullptr;
+  };
+
+  Parser(entries).Parse(input);
+}
+
+void Client::ParseStatsBw(const std::string& input,
+                          BandwidthInfo* bandwidth_info) {
+  class Parser : public JsonPicker {
+   public:
+    explicit Parser(BandwidthInfo* info) : info_(info) {}
+
+    void Parse(const std::string& input) {
+      *info_ = BandwidthInfo();
+      Walk(input);
+    }
+
+   protected:
+    void OnNumber(uint64_t integer, double real) override {
+      if (Depth() != 1) {
+        return;
+      }
+      if (Key(1) == "TotalIn") {
+        info_->total_in = integer;
+      } else if (Key(1) == "TotalOut") {
+        info_->total_out = integer;
+      } else if (Key(1) == "RateIn") {
+        info_->rate_in = real;
+      } else if (Key(1) == "RateOut") {
+        info_->rate_out = real;
+      }
+    }
+
+   private:
+    /** Where to parse into. */
+    BandwidthInfo* info_;
+  };
+
+  Parser(bandwidth_info).Parse(input);
+}
+
+void Client::ParseSwarmPeers(const std::string& input,
+                             std::vector<PeerInfo>* peers) {
+  /* {"Peers":[{"Addr":"/ip4/...","Peer":"Qm...","Latency":"23.4ms",...}]},
+     "Peers" is null if there are none. */
+  class Parser : public JsonPicker {
+   public:
+    explicit Parser(std::vector<PeerInfo>* peers) : peers_(peers) {}
+
+    void Parse(const std::string& input) {
+      Walk(input);
+      peers_->resize(count_);
+    }
+
+   protected:
+    void OnObject() override {
+      if (Depth() == 2 && Key(1) == "Peers") {
+        peer_ = &next_element(peers_, &count_);
+        peer_->addr.clear();
+        peer_->peer.clear();
+        peer_->latency.clear();
+      }
+    }
+
+    void OnString(const std::string& value) override {
+      if (peer_ == nullptr || Depth() != 3 || Key(1) != "Peers") {
+        return;
+      }
+      if (Key(3) == "Addr") {
+        peer_->addr.assign(value);
+      } else if (Key(3) == "Peer") {
+        peer_->peer.assign(value);
+      } else if (Key(3) == "Latency") {
+        peer_->latency.assign(value);
+      }
+    }
+
+   private:
+    /** Where to parse into. */
+    std::vector<PeerInfo>* peers_;
+
+    /** Number of peers parsed so far. */
+    size_t count_ = 0;
+
+    /** The peer being parsed. */
+    PeerInfo* peer_ = nullptr;
+  };
+
+  Parser(peers).Parse(input);
+}
+
+std::shared_ptr<http::ResponseSink> Client::PinSink(PinVisitor on_pin) {
+  return std::make_shared<http::LineSink>(
+      [on_pin = std::move(on_pin), parser = PinRecordParser(),
+       pin = PinInfo()](const std::string& line) mutable {
+        parser.Parse(line, &pin);
+        return on_pin(pin);
+      });
+}
+
+JsonRecordVisitor Client::ProvidersOf(size_t num_providers,
+                                      JsonRecordVisitor on_provider) {
+  /* The providers come in records of type 4 (routing.Provider), for example:
+
+  {"Extra":"","ID":"","Responses":[{"Addrs":[...],"ID":"QmZSb7..."}],"Type":4}
+
+  the other records tell about the progress of the query. */
+  static const int kProvider = 4;
+  return [num_providers, on_provider = std::move(on_provider),
+          found = size_t{0}](const Json& record) mutable {
+    auto type = record.find("Type");
+    auto responses = record.find("Responses");
+    if (type == record.end() || *type != kProvider ||
+        responses == record.end() || !responses->is_array()) {
+      return true;
+    }
+    for (const auto& provider : *responses) {
+      if (!on_provider(provider) || ++found == num_providers) {
+        return false;
+      }
+    }
+    return true;
+  };
+}
+
+bool Client::FindPeerAddresses(const Json& record, const std::string& peer_id,
+                               Json* addresses) {
+  /* Find the addresses of the requested peer in a record of the response.
+  It consists of many lines like this:
+
+  {..., "Responses":[{"Addrs":["...","..."],"ID":"peer_id"}], ...}
+
+  */
+  auto responses = record.find("Responses");
+  if (responses != record.end() && responses->is_array()) {
+    for (const auto& r : *responses) {
+      auto id = r.find("ID");
+      if (id != r.end() && *id == peer_id) {
+        *addresses = r.value("Addrs", Json());
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+void Client::ParseJson(const std::string& input, Json* result) {
+  parse_json(input, result);
 }
 
 template <class PropertyType>
@@ -452,12 +1877,32 @@ void Client::GetProperty(const Json& input, const std::string& property_name,
     throw std::runtime_error(
         std::string("Unexpected reply: valid JSON, but without the \"") +
         property_name + "\" property on line " + std::to_string(line_number) +
-        ":\n" + input.dump());
+        ":\n" + excerpt(input.dump()));
   }
 
   *property_value = input[property_name];
 }
 
+http::FetchOptions Client::OptionsFor(const std::string& url) const {
+  /* Reads, and writes of content-addressed data, which store the same blocks
+   * no matter how often they are sent. */
+  static const std::set<std::string> idempotent_paths = {
+      "add", "block/get", "block/put", "block/stat", "cat", "config/show",
+      "dag/export", "dag/get", "dag/import", "dag/put", "dag/resolve",
+      "dag/stat", "file/ls", "id", "key/list", "name/resolve", "pin/add",
+      "pin/ls", "routing/findpeer", "routing/findprovs", "stats/bw",
+      "stats/repo", "swarm/addrs", "swarm/peers", "version"};
+
+  http::FetchOptions options = options_;
+  const std::string prefix = url_prefix_ + "/";
+  if (!options.idempotent && url.compare(0, prefix.size(), prefix) == 0) {
+    const std::string path =
+        url.substr(prefix.size(), url.find('?') - prefix.size());
+    options.idempotent = idempotent_paths.count(path) > 0;
+  }
+  return options;
+}
+
 std::string Client::MakeUrl(
     const std::string& path,
     const std::vector<std::pair<std::string, std::string>>& parameters) {
@@ -465,7 +1910,18 @@ std::string Client::MakeUrl(
                     "?stream-channels=true&json=true&encoding=json";
   std::vector<std::pair<std::string, std::string>> params = parameters;
 
-  if (!timeout_value_.empty()) {
+  if (options_.deadline) {
+    // Give the server-side the time that is left until the deadline, so that
+    // it stops working on the request once nobody waits for it anymore
+    const auto remaining =
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            *options_.deadline - std::chrono::steady_clock::now())
+            .count();
+    if (remaining > 0) {
+      params.push_back(std::make_pair(std::string("timeout"),
+                                      std::to_string(remaining) + "ms"));
+    }
+  } else if (!timeout_value_.empty()) {
     // Set time-out at server-side
     params.push_back(std::make_pair(std::string("timeout"), timeout_value_));
   }
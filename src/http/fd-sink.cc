@@ -0,0 +1,156 @@
+/* Copyright (c) 2016-2023, The C++ IPFS client library developers
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#include <ipfs/http/fd-sink.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace ipfs {
+
+namespace http {
+
+/** Alignment and granularity of the write buffer, a page on most systems. */
+static constexpr size_t kAlignment = 4096;
+
+/** Write a whole buffer to a file descriptor, retrying partial writes. */
+static void write_all(
+    /** [in] File descriptor to write to. */
+    int fd,
+    /** [in] Data to write. */
+    const char* data,
+    /** [in] Size of the data in bytes. */
+    size_t size) {
+  while (size > 0) {
+#ifdef _WIN32
+    const int n =
+        _write(fd, data, static_cast<unsigned>(std::min<size_t>(size, INT_MAX)));
+#else
+    const ssize_t n = ::write(fd, data, size);
+#endif
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::runtime_error(std::string("write() failed: ") +
+                               std::strerror(errno));
+    }
+    data += n;
+    size -= static_cast<size_t>(n);
+  }
+}
+
+void FdSink::AlignedDelete::operator()(char* p) const {
+  ::operator delete[](p, std::align_val_t(kAlignment));
+}
+
+FdSink::FdSink(int fd, const FdSinkOptions& options)
+    : fd_(fd),
+      options_(options),
+      buffer_size_(std::max<size_t>(
+          (options.buffer_size + kAlignment - 1) / kAlignment * kAlignment,
+          kAlignment)),
+      buffer_(static_cast<char*>(
+          ::operator new[](buffer_size_, std::align_val_t(kAlignment)))) {
+#ifdef _WIN32
+  start_offset_ = _lseeki64(fd_, 0, SEEK_CUR);
+#else
+  start_offset_ = ::lseek(fd_, 0, SEEK_CUR);
+#endif
+}
+
+void FdSink::OnBegin(int64_t content_length) {
+  const int64_t size = content_length >= 0
+                           ? content_length
+                           : static_cast<int64_t>(options_.expected_size);
+  if (!options_.preallocate || size <= 0 || start_offset_ < 0) {
+    return;
+  }
+#ifdef __linux__
+  /* Reserve the blocks without changing the file size, so a transfer that
+   * ends early does not leave a file that is too long. Only running out of
+   * space is an error, file systems that can't preallocate are fine. */
+  if (fallocate(fd_, FALLOC_FL_KEEP_SIZE, start_offset_, size) != 0 &&
+      errno == ENOSPC) {
+    throw std::runtime_error(std::string("fallocate() failed: ") +
+                             std::strerror(errno));
+  }
+#endif /* __linux__ */
+}
+
+bool FdSink::OnData(const char* data, size_t size) {
+  while (size > 0) {
+    const size_t n = std::min(size, buffer_size_ - buffered_);
+    std::memcpy(buffer_.get() + buffered_, data, n);
+    buffered_ += n;
+    data += n;
+    size -= n;
+    if (buffered_ == buffer_size_) {
+      Flush();
+    }
+  }
+  return true;
+}
+
+void FdSink::OnEnd() {
+#ifdef O_DIRECT
+  /* The tail of the body is not a whole number of blocks, which O_DIRECT
+   * refuses to write. */
+  if (buffered_ % kAlignment != 0) {
+    const int flags = fcntl(fd_, F_GETFL);
+    if (flags != -1 && (flags & O_DIRECT)) {
+      fcntl(fd_, F_SETFL, flags & ~O_DIRECT);
+    }
+  }
+#endif /* O_DIRECT */
+  Flush();
+
+#ifdef POSIX_FADV_DONTNEED
+  if (options_.drop_cache && start_offset_ >= 0 && written_ > 0) {
+    /* Only clean pages can be dropped, so write them out first. */
+    if (fdatasync(fd_) != 0) {
+      throw std::runtime_error(std::string("fdatasync() failed: ") +
+                               std::strerror(errno));
+    }
+    posix_fadvise(fd_, start_offset_, static_cast<off_t>(written_),
+                  POSIX_FADV_DONTNEED);
+  }
+#endif /* POSIX_FADV_DONTNEED */
+}
+
+void FdSink::Flush() {
+  write_all(fd_, buffer_.get(), buffered_);
+  written_ += buffered_;
+  buffered_ = 0;
+}
+
+} /* namespace http */
+} /* namespace ipfs */
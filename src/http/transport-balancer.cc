@@ -0,0 +1,578 @@
+/* Copyright (c) 2016-2023, The C++ IPFS client library developers
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#include <ipfs/http/transport-balancer.h>
+#include <ipfs/http/transport-curl.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <limits>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "url.h"
+
+namespace ipfs {
+
+namespace http {
+
+/** Outcome of a request, as far as the health of its daemon is concerned. */
+enum class BackendOutcome {
+  /** The daemon answered. */
+  kAnswered,
+  /** The daemon did not answer, or answered that it can't. */
+  kFailed,
+  /** Says nothing about the daemon, eg. the request was cancelled. */
+  kNeutral,
+};
+
+/** Extract what a request is about, for `BalancerOptions::kConsistentHash`:
+ * the value of its `arg` parameter, or only the root CID of an IPFS path.
+ * @return The key, empty if the request has no `arg`. */
+static std::string hash_key(
+    /** [in] URL of the request, with an URL encoded query. */
+    const std::string& url) {
+  size_t begin = url.find("?arg=");
+  if (begin == std::string::npos) {
+    begin = url.find("&arg=");
+  }
+  if (begin == std::string::npos) {
+    return "";
+  }
+  begin += 5;
+  const size_t end = url.find('&', begin);
+  std::string key = url.substr(begin, end == std::string::npos
+                                          ? std::string::npos
+                                          : end - begin);
+
+  /* "/ipfs/<cid>/some/file" -> "<cid>" */
+  static const std::string ipfs_prefix = "%2Fipfs%2F";
+  if (key.compare(0, ipfs_prefix.size(), ipfs_prefix) == 0) {
+    key.erase(0, ipfs_prefix.size());
+  }
+  const size_t slash = key.find("%2F");
+  if (slash != std::string::npos) {
+    key.erase(slash);
+  }
+  return key;
+}
+
+/** @return 64 bit hash of a string (FNV-1a, plus a final mix so that similar
+ * strings land far apart on the ring). Stable across processes, so that every
+ * client sends a CID to the same daemon. */
+static uint64_t hash64(
+    /** [in] The string. */
+    const std::string& s) {
+  uint64_t h = 14695981039346656037ULL;
+  for (unsigned char c : s) {
+    h ^= c;
+    h *= 1099511628211ULL;
+  }
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+/** @return The outcome of a failed request for its daemon. */
+static BackendOutcome classify(
+    /** [in] The error of the request. */
+    std::exception_ptr error) {
+  try {
+    std::rethrow_exception(error);
+  } catch (const HttpStatusError& e) {
+    const long status = e.StatusCode();
+    return status == 502 || status == 503 || status == 504
+               ? BackendOutcome::kFailed
+               : BackendOutcome::kAnswered;
+  } catch (...) {
+    return BackendOutcome::kFailed;
+  }
+}
+
+class TransportBalancer::State {
+ public:
+  /** Constructor. */
+  State(
+      /** [in] Endpoints of the daemons. */
+      const std::vector<std::string>& endpoints,
+      /** [in] Settings. */
+      const BalancerOptions& options)
+      : options_(options),
+        daemons_(endpoints.size()),
+        random_(std::random_device()()) {
+    for (size_t i = 0; i < endpoints.size(); ++i) {
+      for (int point = 0; point < options_.virtual_nodes; ++point) {
+        ring_.emplace_back(hash64(endpoints[i] + "#" + std::to_string(point)),
+                           i);
+      }
+    }
+    std::sort(ring_.begin(), ring_.end());
+  }
+
+  /** Pick the daemon for a request and count the request as in flight there.
+   * @return Index of the daemon, `kNone` if there is none left to pick. */
+  size_t Pick(
+      /** [in] URL of the request. */
+      const std::string& url,
+      /** [in] Daemons that the request has been sent to already. */
+      const std::vector<bool>& tried,
+      /** [in] Only pick among the daemons in rotation. */
+      bool healthy_only) {
+    const auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::vector<size_t> candidates;
+    for (size_t i = 0; i < daemons_.size(); ++i) {
+      if (!tried[i] && daemons_[i].ejected_until <= now) {
+        candidates.push_back(i);
+      }
+    }
+    if (candidates.empty() && !healthy_only) {
+      /* All are out of rotation, use the one that is back first. */
+      size_t first_back = kNone;
+      for (size_t i = 0; i < daemons_.size(); ++i) {
+        if (!tried[i] &&
+            (first_back == kNone || daemons_[i].ejected_until <
+                                        daemons_[first_back].ejected_until)) {
+          first_back = i;
+        }
+      }
+      if (first_back != kNone) {
+        candidates.push_back(first_back);
+      }
+    }
+    if (candidates.empty()) {
+      return kNone;
+    }
+
+    size_t picked = kNone;
+    const std::string key =
+        options_.policy == BalancerOptions::Policy::kConsistentHash
+            ? hash_key(url)
+            : "";
+    if (!key.empty()) {
+      picked = OnRing(hash64(key), candidates);
+    } else if (options_.policy ==
+                   BalancerOptions::Policy::kPowerOfTwoChoices &&
+               candidates.size() > 2) {
+      std::uniform_int_distribution<size_t> any(0, candidates.size() - 1);
+      const size_t a = any(random_);
+      size_t b = any(random_);
+      while (b == a) {
+        b = any(random_);
+      }
+      picked = daemons_[candidates[b]].outstanding <
+                       daemons_[candidates[a]].outstanding
+                   ? candidates[b]
+                   : candidates[a];
+    } else {
+      /* Least outstanding, ties go round robin. */
+      const size_t offset = next_++;
+      for (size_t n = 0; n < candidates.size(); ++n) {
+        const size_t i = candidates[(offset + n) % candidates.size()];
+        if (picked == kNone ||
+            daemons_[i].outstanding < daemons_[picked].outstanding) {
+          picked = i;
+        }
+      }
+    }
+    ++daemons_[picked].outstanding;
+    return picked;
+  }
+
+  /** Count a request as no longer in flight, and learn from its outcome. */
+  void Done(
+      /** [in] Index of the daemon. */
+      size_t index,
+      /** [in] What the outcome says about the daemon. */
+      BackendOutcome outcome) {
+    const auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(mutex_);
+    Daemon& daemon = daemons_[index];
+    --daemon.outstanding;
+    if (outcome == BackendOutcome::kAnswered) {
+      daemon.failures = 0;
+      daemon.ejections = 0;
+    } else if (outcome == BackendOutcome::kFailed &&
+               daemon.ejected_until <= now &&
+               ++daemon.failures >= options_.failure_threshold) {
+      /* Out of rotation, for longer every time in a row. A request after the
+       * time is over tells whether it is back. The failures of the requests
+       * that were in flight meanwhile don't count. */
+      const auto backoff = std::min<int64_t>(
+          options_.max_ejection_time.count(),
+          options_.ejection_time.count() << std::min(daemon.ejections, 20));
+      daemon.ejected_until = now + std::chrono::milliseconds(backoff);
+      ++daemon.ejections;
+      daemon.failures = 0;
+    }
+  }
+
+  /** @return Whether a daemon is in rotation. */
+  bool IsHealthy(
+      /** [in] Index of the daemon. */
+      size_t index) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return daemons_.at(index).ejected_until <= std::chrono::steady_clock::now();
+  }
+
+  /** Returned by `Pick()` if there is no daemon to pick. */
+  static constexpr size_t kNone = std::numeric_limits<size_t>::max();
+
+ private:
+  /** Load and health of a daemon. */
+  struct Daemon {
+    /** Requests in flight. */
+    size_t outstanding = 0;
+
+    /** Failures in a row. */
+    int failures = 0;
+
+    /** Times in a row that the daemon has been taken out of rotation. */
+    int ejections = 0;
+
+    /** When the daemon is back in rotation. */
+    std::chrono::steady_clock::time_point ejected_until;
+  };
+
+  /** @return The first candidate at or after `hash` on the ring. */
+  size_t OnRing(
+      /** [in] Hash of the request. */
+      uint64_t hash,
+      /** [in] Daemons that may be picked, not empty. */
+      const std::vector<size_t>& candidates) const {
+    auto it = std::lower_bound(ring_.begin(), ring_.end(),
+                               std::make_pair(hash, size_t{0}));
+    for (size_t n = 0; n < ring_.size(); ++n, ++it) {
+      if (it == ring_.end()) {
+        it = ring_.begin();
+      }
+      if (std::find(candidates.begin(), candidates.end(), it->second) !=
+          candidates.end()) {
+        return it->second;
+      }
+    }
+    return candidates.front();
+  }
+
+  /** Protects all members below. */
+  mutable std::mutex mutex_;
+
+  /** Settings. */
+  const BalancerOptions options_;
+
+  /** The daemons, in the order of the constructor's list. */
+  std::vector<Daemon> daemons_;
+
+  /** Hash ring, (point, daemon) sorted by point. */
+  std::vector<std::pair<uint64_t, size_t>> ring_;
+
+  /** Where the round robin among equally loaded daemons starts next. */
+  size_t next_ = 0;
+
+  /** Source of the power of two choices. */
+  std::minstd_rand random_;
+};
+
+/** Forwards the response of the daemon to the caller's sink, and notes
+ * whether the failover is still possible. */
+struct TransportBalancer::Attempt : public ResponseSink {
+  /** URL of the request, with the endpoint that the caller used. */
+  std::string url;
+
+  /** The files, kept for a failover of an asynchronous request. */
+  std::vector<FileUpload> files;
+
+  /** The caller's sink. */
+  ResponseSink* sink = nullptr;
+
+  /** Settings of the request. */
+  FetchOptions options;
+
+  /** Completion callback of an asynchronous request. */
+  FetchCallback on_done;
+
+  /** Daemons that the request has been sent to. */
+  std::vector<bool> tried;
+
+  /** Whether the request may be sent to another daemon. */
+  bool may_fail_over = false;
+
+  /** Set once the response has reached the sink. */
+  bool begun = false;
+
+  /** Set if the sink threw, that is not the daemon's fault. */
+  bool sink_failed = false;
+
+  void OnBegin(int64_t content_length) override {
+    begun = true;
+    Forward([&]() {
+      sink->OnBegin(content_length);
+      return true;
+    });
+  }
+
+  bool OnData(const char* data, size_t size) override {
+    begun = true;
+    return Forward([&]() { return sink->OnData(data, size); });
+  }
+
+  void OnEnd() override {
+    Forward([&]() {
+      sink->OnEnd();
+      return true;
+    });
+  }
+
+  /** Call the caller's sink, noting if it throws.
+   * @return What the sink returned. */
+  template <typename Call>
+  bool Forward(Call call) {
+    try {
+      return call();
+    } catch (...) {
+      sink_failed = true;
+      throw;
+    }
+  }
+
+  /** Decide what a failed request says about its daemon, and whether to send
+   * it to another one.
+   * @return The outcome for the daemon. */
+  BackendOutcome Failed(
+      /** [in] The error. */
+      std::exception_ptr error) const {
+    if (sink_failed ||
+        (options.cancellation && options.cancellation->IsCancelled()) ||
+        (options.deadline &&
+         std::chrono::steady_clock::now() >= *options.deadline)) {
+      return BackendOutcome::kNeutral;
+    }
+    return classify(error);
+  }
+};
+
+/** @return Whether the files of a request can be sent again, after the call
+ * that started the request has returned if `async` is set. */
+static bool replayable(
+    /** [in] The files. */
+    const std::vector<FileUpload>& files,
+    /** [in] Whether the request is asynchronous. */
+    bool async) {
+  for (const FileUpload& file : files) {
+    if (file.type == FileUpload::Type::kReader ||
+        (async && file.type == FileUpload::Type::kMemory)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+TransportBalancer::TransportBalancer(std::vector<Backend> backends,
+                                     const BalancerOptions& options)
+    : backends_(std::move(backends)) {
+  if (backends_.empty()) {
+    throw std::runtime_error("TransportBalancer needs at least one backend");
+  }
+  std::vector<std::string> endpoints;
+  for (const Backend& backend : backends_) {
+    endpoints.push_back(backend.endpoint);
+  }
+  state_ = std::make_shared<State>(endpoints, options);
+}
+
+/** @return A backend with a `TransportCurl` for every endpoint. */
+static std::vector<TransportBalancer::Backend> curl_backends(
+    /** [in] Scheme, host and port of the daemons. */
+    const std::vector<std::string>& endpoints,
+    /** [in] Enable cURL verbose mode. */
+    bool curl_verbose) {
+  std::vector<TransportBalancer::Backend> backends;
+  for (const std::string& endpoint : endpoints) {
+    backends.push_back(
+        {endpoint, std::make_unique<TransportCurl>(curl_verbose)});
+  }
+  return backends;
+}
+
+TransportBalancer::TransportBalancer(const std::vector<std::string>& endpoints,
+                                     const BalancerOptions& options,
+                                     bool curl_verbose)
+    : TransportBalancer(curl_backends(endpoints, curl_verbose), options) {}
+
+TransportBalancer::TransportBalancer(std::vector<Backend> backends,
+                                     std::shared_ptr<State> state)
+    : state_(std::move(state)), backends_(std::move(backends)) {}
+
+TransportBalancer::~TransportBalancer() { stopped_ = true; }
+
+std::unique_ptr<Transport> TransportBalancer::Clone() const {
+  std::vector<Backend> backends;
+  for (const Backend& backend : backends_) {
+    backends.push_back({backend.endpoint, backend.transport->Clone()});
+  }
+  return std::unique_ptr<Transport>(
+      new TransportBalancer(std::move(backends), state_));
+}
+
+void TransportBalancer::Fetch(const std::string& url,
+                              const std::vector<FileUpload>& files,
+                              std::iostream* response) {
+  StreamSink sink(response);
+  Fetch(url, files, &sink, {});
+}
+
+void TransportBalancer::Fetch(const std::string& url,
+                              const std::vector<FileUpload>& files,
+                              ResponseSink* sink,
+                              const FetchOptions& options) {
+  Attempt attempt;
+  attempt.url = url;
+  attempt.sink = sink;
+  attempt.options = options;
+  attempt.tried.assign(backends_.size(), false);
+  attempt.may_fail_over = options.idempotent && replayable(files, false);
+
+  size_t index = state_->Pick(url, attempt.tried, false);
+  for (;;) {
+    attempt.tried[index] = true;
+    std::exception_ptr error;
+    try {
+      backends_[index].transport->Fetch(
+          replace_endpoint(url, backends_[index].endpoint), files, &attempt,
+          options);
+    } catch (...) {
+      error = std::current_exception();
+    }
+    if (!error) {
+      state_->Done(index, BackendOutcome::kAnswered);
+      return;
+    }
+
+    const BackendOutcome outcome =
+        stopped_ ? BackendOutcome::kNeutral : attempt.Failed(error);
+    state_->Done(index, outcome);
+    if (outcome != BackendOutcome::kFailed || !attempt.may_fail_over ||
+        attempt.begun ||
+        (index = state_->Pick(url, attempt.tried, true)) == State::kNone) {
+      std::rethrow_exception(error);
+    }
+  }
+}
+
+void TransportBalancer::FetchAsync(const std::string& url,
+                                   const std::vector<FileUpload>& files,
+                                   std::iostream* response,
+                                   FetchCallback on_done) {
+  /* The sink lives as long as the completion callback. */
+  auto sink = std::make_shared<StreamSink>(response);
+  FetchAsync(url, files, sink.get(), {},
+             [sink, on_done = std::move(on_done)](std::exception_ptr error) {
+               on_done(error);
+             });
+}
+
+void TransportBalancer::FetchAsync(const std::string& url,
+                                   const std::vector<FileUpload>& files,
+                                   ResponseSink* sink,
+                                   const FetchOptions& options,
+                                   FetchCallback on_done) {
+  auto attempt = std::make_shared<Attempt>();
+  attempt->url = url;
+  attempt->sink = sink;
+  attempt->options = options;
+  attempt->on_done = std::move(on_done);
+  attempt->tried.assign(backends_.size(), false);
+  attempt->may_fail_over = options.idempotent && replayable(files, true);
+  if (attempt->may_fail_over) {
+    /* A copy that is moved in, FileUpload can't be assigned. */
+    attempt->files = std::vector<FileUpload>(files);
+  }
+  Dispatch(attempt, files, state_->Pick(url, attempt->tried, false));
+}
+
+void TransportBalancer::Dispatch(std::shared_ptr<Attempt> attempt,
+                                 const std::vector<FileUpload>& files,
+                                 size_t index) {
+  attempt->tried[index] = true;
+  auto on_done = [this, attempt, index](std::exception_ptr error) {
+    if (!error) {
+      state_->Done(index, BackendOutcome::kAnswered);
+      attempt->on_done(nullptr);
+      return;
+    }
+
+    const BackendOutcome outcome =
+        stopped_ ? BackendOutcome::kNeutral : attempt->Failed(error);
+    state_->Done(index, outcome);
+    size_t next = State::kNone;
+    if (outcome == BackendOutcome::kFailed && attempt->may_fail_over &&
+        !attempt->begun) {
+      next = state_->Pick(attempt->url, attempt->tried, true);
+    }
+    if (next == State::kNone) {
+      attempt->on_done(error);
+      return;
+    }
+    Dispatch(attempt, attempt->files, next);
+  };
+
+  backends_[index].transport->FetchAsync(
+      replace_endpoint(attempt->url, backends_[index].endpoint), files,
+      attempt.get(), attempt->options, std::move(on_done));
+}
+
+void TransportBalancer::StopFetch() {
+  stopped_ = true;
+  for (Backend& backend : backends_) {
+    backend.transport->StopFetch();
+  }
+}
+
+void TransportBalancer::ResetFetch() {
+  stopped_ = false;
+  for (Backend& backend : backends_) {
+    backend.transport->ResetFetch();
+  }
+}
+
+void TransportBalancer::UrlEncode(const std::string& raw,
+                                  std::string* encoded) {
+  backends_.front().transport->UrlEncode(raw, encoded);
+}
+
+Transport& TransportBalancer::BackendTransport(size_t index) {
+  return *backends_.at(index).transport;
+}
+
+bool TransportBalancer::IsHealthy(size_t index) const {
+  return state_->IsHealthy(index);
+}
+
+}  // namespace http
+}  // namespace ipfs
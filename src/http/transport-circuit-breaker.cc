@@ -0,0 +1,404 @@
+/* Copyright (c) 2016-2023, The C++ IPFS client library developers
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#include <ipfs/http/transport-circuit-breaker.h>
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "url.h"
+
+namespace ipfs {
+
+namespace http {
+
+/** Outcome of a request, as far as the circuit of its endpoint is concerned.
+ * Named apart from the outcome in transport-balancer.cc, both are in
+ * `ipfs::http`. */
+enum class CircuitOutcome {
+  /** Answered in time. */
+  kFine,
+  /** Answered, but slowly. */
+  kSlow,
+  /** Not answered, or answered that the daemon can't. */
+  kFailed,
+  /** Says nothing about the daemon, eg. the request was cancelled. */
+  kNeutral,
+};
+
+/** How long before its deadline a request may fail and still count as timed
+ * out. The inner transport may keep the time with a clock of its own, as curl
+ * does. */
+static constexpr std::chrono::milliseconds kDeadlineSlack{10};
+
+class TransportCircuitBreaker::State {
+ public:
+  /** Constructor. */
+  explicit State(
+      /** [in] Settings. */
+      const CircuitBreakerOptions& options)
+      : options_(options) {}
+
+  /** @return Settings. */
+  const CircuitBreakerOptions& Options() const { return options_; }
+
+  /** Check the circuit of an endpoint.
+   * @return Whether to let a request through. */
+  bool Admit(
+      /** [in] Scheme, host and port of the endpoint. */
+      const std::string& endpoint,
+      /** [out] Set if the caller must start a probe. */
+      bool* probe) {
+    const auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(mutex_);
+    Circuit& circuit = circuits_[endpoint];
+    *probe = circuit.open && !circuit.probing && now >= circuit.next_probe;
+    if (*probe) {
+      circuit.probing = true;
+    }
+    return !circuit.open;
+  }
+
+  /** Learn from the outcome of a request. */
+  void Record(
+      /** [in] Scheme, host and port of the endpoint. */
+      const std::string& endpoint,
+      /** [in] The outcome. */
+      CircuitOutcome outcome) {
+    if (outcome == CircuitOutcome::kNeutral) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    Circuit& circuit = circuits_[endpoint];
+    if (circuit.open) {
+      /* Was in flight when the circuit opened. */
+      return;
+    }
+    circuit.recent.push_back(outcome);
+    if (static_cast<int>(circuit.recent.size()) > options_.window) {
+      circuit.recent.pop_front();
+    }
+    if (static_cast<int>(circuit.recent.size()) < options_.min_requests) {
+      return;
+    }
+
+    size_t failed = 0;
+    size_t slow = 0;
+    for (CircuitOutcome recent : circuit.recent) {
+      failed += recent == CircuitOutcome::kFailed;
+      slow += recent == CircuitOutcome::kSlow;
+    }
+    const double count = static_cast<double>(circuit.recent.size());
+    if (failed / count >= options_.failure_rate ||
+        slow / count >= options_.slow_call_rate) {
+      circuit.open = true;
+      circuit.next_probe =
+          std::chrono::steady_clock::now() + options_.open_time;
+      circuit.recent.clear();
+    }
+  }
+
+  /** Learn from the outcome of a probe. */
+  void ProbeDone(
+      /** [in] Scheme, host and port of the endpoint. */
+      const std::string& endpoint,
+      /** [in] Whether the daemon answered in time. */
+      bool answered) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Circuit& circuit = circuits_[endpoint];
+    circuit.probing = false;
+    if (answered) {
+      circuit.open = false;
+    } else {
+      circuit.next_probe =
+          std::chrono::steady_clock::now() + options_.probe_interval;
+    }
+  }
+
+ private:
+  /** The circuit of an endpoint. */
+  struct Circuit {
+    /** Outcomes of the recent requests, oldest first. Empty while open. */
+    std::deque<CircuitOutcome> recent;
+
+    /** Whether requests fail fast. */
+    bool open = false;
+
+    /** Whether a probe is in flight. */
+    bool probing = false;
+
+    /** When the next probe is due, if the circuit is open. */
+    std::chrono::steady_clock::time_point next_probe;
+  };
+
+  /** Settings. */
+  const CircuitBreakerOptions options_;
+
+  /** Protects `circuits_`. */
+  std::mutex mutex_;
+
+  /** The circuits, by endpoint. */
+  std::map<std::string, Circuit> circuits_;
+};
+
+/** Forwards the response to the caller's sink, and takes the time to its first
+ * byte. */
+struct TransportCircuitBreaker::Call : public ResponseSink {
+  /** The caller's sink. */
+  ResponseSink* sink = nullptr;
+
+  /** Scheme, host and port of the endpoint. */
+  std::string endpoint;
+
+  /** Settings of the request. */
+  FetchOptions options;
+
+  /** Completion callback of an asynchronous request. */
+  FetchCallback on_done;
+
+  /** When the request was let through. */
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+
+  /** Time to the first byte of the body, once it has arrived. */
+  std::optional<std::chrono::steady_clock::duration> first_byte;
+
+  /** Set if the sink threw, that is not the daemon's fault. */
+  bool sink_failed = false;
+
+  void OnBegin(int64_t content_length) override {
+    Arrived();
+    Forward([&]() {
+      sink->OnBegin(content_length);
+      return true;
+    });
+  }
+
+  bool OnData(const char* data, size_t size) override {
+    Arrived();
+    return Forward([&]() { return sink->OnData(data, size); });
+  }
+
+  void OnEnd() override {
+    Forward([&]() {
+      sink->OnEnd();
+      return true;
+    });
+  }
+
+  /** Note the time of the first byte. */
+  void Arrived() {
+    if (!first_byte) {
+      first_byte = std::chrono::steady_clock::now() - start;
+    }
+  }
+
+  /** Call the caller's sink, noting if it throws.
+   * @return What the sink returned. */
+  template <typename Function>
+  bool Forward(Function call) {
+    try {
+      return call();
+    } catch (...) {
+      sink_failed = true;
+      throw;
+    }
+  }
+
+  /** @return The outcome of the request. */
+  CircuitOutcome Finished(
+      /** [in] The error, null on success. */
+      std::exception_ptr error,
+      /** [in] Settings of the circuit breaker. */
+      const CircuitBreakerOptions& breaker) const {
+    const auto now = std::chrono::steady_clock::now();
+    if (error) {
+      if (sink_failed ||
+          (options.cancellation && options.cancellation->IsCancelled())) {
+        return CircuitOutcome::kNeutral;
+      }
+      if (options.deadline && now + kDeadlineSlack >= *options.deadline) {
+        /* Timed out, which is only held against the daemon if the deadline
+         * had not passed before the request was sent. */
+        return *options.deadline <= start ? CircuitOutcome::kNeutral
+                                          : CircuitOutcome::kSlow;
+      }
+      try {
+        std::rethrow_exception(error);
+      } catch (const HttpStatusError& e) {
+        const long status = e.StatusCode();
+        if (status == 429 || status == 502 || status == 503 || status == 504) {
+          return CircuitOutcome::kFailed;
+        }
+      } catch (...) {
+        return CircuitOutcome::kFailed;
+      }
+    }
+    return first_byte.value_or(now - start) > breaker.slow_call_duration
+               ? CircuitOutcome::kSlow
+               : CircuitOutcome::kFine;
+  }
+};
+
+TransportCircuitBreaker::TransportCircuitBreaker(
+    std::unique_ptr<Transport> transport, const CircuitBreakerOptions& options)
+    : state_(std::make_shared<State>(options)),
+      transport_(std::move(transport)) {}
+
+TransportCircuitBreaker::TransportCircuitBreaker(
+    std::unique_ptr<Transport> transport, std::shared_ptr<State> state)
+    : state_(std::move(state)), transport_(std::move(transport)) {}
+
+TransportCircuitBreaker::~TransportCircuitBreaker() { stopped_ = true; }
+
+std::unique_ptr<Transport> TransportCircuitBreaker::Clone() const {
+  return std::unique_ptr<Transport>(
+      new TransportCircuitBreaker(transport_->Clone(), state_));
+}
+
+void TransportCircuitBreaker::Fetch(const std::string& url,
+                                    const std::vector<FileUpload>& files,
+                                    std::iostream* response) {
+  StreamSink sink(response);
+  Fetch(url, files, &sink, {});
+}
+
+void TransportCircuitBreaker::Fetch(const std::string& url,
+                                    const std::vector<FileUpload>& files,
+                                    ResponseSink* sink,
+                                    const FetchOptions& options) {
+  Call call;
+  call.sink = sink;
+  call.endpoint = endpoint_of(url);
+  call.options = options;
+  Admit(call.endpoint);
+
+  std::exception_ptr error;
+  try {
+    transport_->Fetch(url, files, &call, options);
+  } catch (...) {
+    error = std::current_exception();
+  }
+  state_->Record(call.endpoint,
+                 stopped_ ? CircuitOutcome::kNeutral
+                          : call.Finished(error, state_->Options()));
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+void TransportCircuitBreaker::FetchAsync(const std::string& url,
+                                         const std::vector<FileUpload>& files,
+                                         std::iostream* response,
+                                         FetchCallback on_done) {
+  /* The sink lives as long as the completion callback. */
+  auto sink = std::make_shared<StreamSink>(response);
+  FetchAsync(url, files, sink.get(), {},
+             [sink, on_done = std::move(on_done)](std::exception_ptr error) {
+               on_done(error);
+             });
+}
+
+void TransportCircuitBreaker::FetchAsync(const std::string& url,
+                                         const std::vector<FileUpload>& files,
+                                         ResponseSink* sink,
+                                         const FetchOptions& options,
+                                         FetchCallback on_done) {
+  auto call = std::make_shared<Call>();
+  call->sink = sink;
+  call->endpoint = endpoint_of(url);
+  call->options = options;
+  call->on_done = std::move(on_done);
+  try {
+    Admit(call->endpoint);
+  } catch (...) {
+    call->on_done(std::current_exception());
+    return;
+  }
+
+  /* The call reports to the state, which outlives this transport if need
+   * be. */
+  std::shared_ptr<State> state = state_;
+  transport_->FetchAsync(
+      url, files, call.get(), options,
+      [this, state, call](std::exception_ptr error) {
+        state->Record(call->endpoint,
+                      stopped_ ? CircuitOutcome::kNeutral
+                               : call->Finished(error, state->Options()));
+        call->on_done(error);
+      });
+}
+
+void TransportCircuitBreaker::StopFetch() {
+  stopped_ = true;
+  transport_->StopFetch();
+}
+
+void TransportCircuitBreaker::ResetFetch() {
+  stopped_ = false;
+  transport_->ResetFetch();
+}
+
+void TransportCircuitBreaker::UrlEncode(const std::string& raw,
+                                        std::string* encoded) {
+  transport_->UrlEncode(raw, encoded);
+}
+
+bool TransportCircuitBreaker::IsOpen(const std::string& endpoint) {
+  try {
+    Admit(endpoint);
+  } catch (const CircuitOpenError&) {
+    return true;
+  }
+  return false;
+}
+
+void TransportCircuitBreaker::Admit(const std::string& endpoint) {
+  bool probe = false;
+  const bool admitted = state_->Admit(endpoint, &probe);
+  if (probe) {
+    /* The probe reports to the state, which outlives this transport if need
+     * be. */
+    std::shared_ptr<State> state = state_;
+    auto sink = std::make_shared<CallbackSink>(
+        [](const char*, size_t) { return true; });
+    FetchOptions options;
+    options.deadline =
+        std::chrono::steady_clock::now() + state_->Options().probe_timeout;
+    transport_->FetchAsync(endpoint + state_->Options().probe_path, {},
+                           sink.get(), options,
+                           [state, sink, endpoint](std::exception_ptr error) {
+                             state->ProbeDone(endpoint, !error);
+                           });
+  }
+  if (!admitted) {
+    throw CircuitOpenError(endpoint);
+  }
+}
+
+}  // namespace http
+}  // namespace ipfs
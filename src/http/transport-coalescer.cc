@@ -0,0 +1,543 @@
+/* Copyright (c) 2016-2023, The C++ IPFS client library developers
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#include <ipfs/http/transport-coalescer.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace ipfs {
+
+namespace http {
+
+/** @return The error of a cancelled request. */
+static std::exception_ptr cancelled_error() {
+  return std::make_exception_ptr(std::runtime_error("Request was cancelled"));
+}
+
+/** @return The error of a request whose deadline has passed. */
+static std::exception_ptr deadline_error() {
+  return std::make_exception_ptr(std::runtime_error("Deadline exceeded"));
+}
+
+/** Runs tasks at given times, on a thread of its own that is started with the
+ * first one. Tasks that are due after it is destroyed are dropped. */
+class TransportCoalescer::Timer {
+ public:
+  ~Timer() {
+    {
+      std::lock_guard<std::mutex> lock(tasks_->mutex);
+      tasks_->stopping = true;
+      tasks_->cv.notify_all();
+    }
+    if (thread_.joinable()) {
+      if (thread_.get_id() == std::this_thread::get_id()) {
+        /* Destroyed by a task, the thread ends once it returns. */
+        thread_.detach();
+      } else {
+        thread_.join();
+      }
+    }
+  }
+
+  /** Run a task at a time. It must be quick. */
+  void At(
+      /** [in] When to run it. */
+      std::chrono::steady_clock::time_point time,
+      /** [in] The task. */
+      std::function<void()> task) {
+    std::lock_guard<std::mutex> lock(tasks_->mutex);
+    tasks_->queue.emplace(time, std::move(task));
+    if (!thread_.joinable()) {
+      thread_ = std::thread(Run, tasks_);
+    }
+    tasks_->cv.notify_all();
+  }
+
+ private:
+  /** The tasks, shared with the thread. */
+  struct Tasks {
+    /** Protects all members below. */
+    std::mutex mutex;
+
+    /** Signalled when a task is added or the timer is stopped. */
+    std::condition_variable cv;
+
+    /** The tasks, by time. */
+    std::multimap<std::chrono::steady_clock::time_point, std::function<void()>>
+        queue;
+
+    /** Set when the timer is destroyed. */
+    bool stopping = false;
+  };
+
+  /** Body of the thread. */
+  static void Run(
+      /** [in] The tasks. */
+      std::shared_ptr<Tasks> tasks) {
+    std::unique_lock<std::mutex> lock(tasks->mutex);
+    while (!tasks->stopping) {
+      if (tasks->queue.empty()) {
+        tasks->cv.wait(lock);
+        continue;
+      }
+      auto first = tasks->queue.begin();
+      if (std::chrono::steady_clock::now() < first->first) {
+        tasks->cv.wait_until(lock, first->first);
+        continue;
+      }
+      std::function<void()> task = std::move(first->second);
+      tasks->queue.erase(first);
+      lock.unlock();
+      task();
+      lock.lock();
+    }
+  }
+
+  /** The tasks. */
+  std::shared_ptr<Tasks> tasks_ = std::make_shared<Tasks>();
+
+  /** The thread, once started. Guarded by the mutex of `tasks_`. */
+  std::thread thread_;
+};
+
+class TransportCoalescer::State {
+ public:
+  /** Protects `flights`. Taken before the mutex of a flight. */
+  std::mutex mutex;
+
+  /** The transfers that still take requests, by URL. */
+  std::map<std::string, std::shared_ptr<Flight>> flights;
+
+  /** Number of requests that joined a transfer. */
+  std::atomic<uint64_t> coalesced{0};
+
+  /** Finishes the asynchronous requests whose own deadline passes. */
+  Timer timer;
+};
+
+struct TransportCoalescer::Waiter {
+  /** The request's sink. */
+  ResponseSink* sink = nullptr;
+
+  /** Called when the request has finished. */
+  FetchCallback on_done;
+
+  /** Token of the request, may be null. */
+  std::shared_ptr<CancellationToken> cancellation;
+
+  /** Id of the subscription to `cancellation`. */
+  uint64_t subscription = 0;
+
+  /** Called when the request is cancelled, eg. to wake up a waiting thread.
+   * Must be quick. */
+  std::function<void()> wake;
+
+  /** Set when the request is cancelled. */
+  std::atomic<bool> cancelled{false};
+
+  /** Deadline of the request, if the transfer it joined may run past it. */
+  std::optional<std::chrono::steady_clock::time_point> deadline;
+
+  /** The transfer, once joined. It lives at least until the request is
+   * finished. */
+  std::atomic<Flight*> flight{nullptr};
+
+  /** Set once the request no longer wants the response, guarded by the mutex
+   * of the flight. */
+  bool left = false;
+
+  /** Serializes the calls of the sink with `Complete()`. */
+  std::mutex mutex;
+
+  /** Set once `on_done` has been called, guarded by `mutex`. */
+  bool finished = false;
+
+  /** Finish the request, unless it is finished already. Must not be called
+   * from a callback of the token.
+   * @return Whether this call finished it. */
+  bool Complete(
+      /** [in] The error, null on success. */
+      std::exception_ptr error) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (finished) {
+        return false;
+      }
+      finished = true;
+    }
+    if (cancellation) {
+      cancellation->Unsubscribe(subscription);
+    }
+    on_done(error);
+    return true;
+  }
+
+  /** Leave the transfer and finish the request with the error of a passed
+   * deadline, unless it is finished already. */
+  void Expire();
+};
+
+/** Fans the response out to the sinks of the requests that share it. */
+struct TransportCoalescer::Flight : public ResponseSink {
+  /** URL of the transfer. */
+  std::string url;
+
+  /** Deadline of the transfer. */
+  std::optional<std::chrono::steady_clock::time_point> deadline;
+
+  /** Cancels the transfer once all of its requests are cancelled. */
+  std::shared_ptr<CancellationToken> cancellation =
+      std::make_shared<CancellationToken>();
+
+  /** Where the transfer is listed while it takes requests. */
+  std::shared_ptr<State> state;
+
+  /** Protects all members below. */
+  std::mutex mutex;
+
+  /** The requests that share the transfer. */
+  std::vector<std::shared_ptr<Waiter>> waiters;
+
+  /** Requests that still want the response. */
+  size_t live = 0;
+
+  void OnBegin(int64_t content_length) override {
+    Close();
+    for (const auto& waiter : Waiters()) {
+      Deliver(waiter, [&]() {
+        waiter->sink->OnBegin(content_length);
+        return true;
+      });
+    }
+  }
+
+  bool OnData(const char* data, size_t size) override {
+    bool wanted = false;
+    for (const auto& waiter : Waiters()) {
+      wanted |=
+          Deliver(waiter, [&]() { return waiter->sink->OnData(data, size); });
+    }
+    return wanted;
+  }
+
+  void OnEnd() override {
+    Close();
+    for (const auto& waiter : Waiters()) {
+      Deliver(waiter, [&]() {
+        waiter->sink->OnEnd();
+        return true;
+      });
+    }
+  }
+
+  /** Finish all requests that are left, with the outcome of the transfer. */
+  void Finish(
+      /** [in] The error of the transfer, null on success. */
+      std::exception_ptr error) {
+    Close();
+    for (const auto& waiter : Waiters()) {
+      waiter->Complete(waiter->cancelled ? cancelled_error() : error);
+    }
+  }
+
+  /** Stop taking requests. */
+  void Close() {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    auto it = state->flights.find(url);
+    if (it != state->flights.end() && it->second.get() == this) {
+      state->flights.erase(it);
+    }
+  }
+
+  /** @return The requests, at this moment. */
+  std::vector<std::shared_ptr<Waiter>> Waiters() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return waiters;
+  }
+
+  /** Count out a request that no longer wants the response.
+   * @return Whether no one wants it any more. */
+  bool Leave(
+      /** [in] The request. */
+      Waiter* waiter) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (waiter->left) {
+      return false;
+    }
+    waiter->left = true;
+    return --live == 0;
+  }
+
+  /** Hand something to the sink of a request, unless it is finished. Finish
+   * it if it is cancelled, or its sink throws or wants no more.
+   * @return Whether the request still wants the response. */
+  template <typename Function>
+  bool Deliver(
+      /** [in] The request. */
+      const std::shared_ptr<Waiter>& waiter,
+      /** [in] Calls the sink, returns what `ResponseSink::OnData()` does. */
+      Function call) {
+    std::exception_ptr error;
+    {
+      std::lock_guard<std::mutex> lock(waiter->mutex);
+      if (waiter->finished) {
+        return false;
+      }
+      if (waiter->cancelled) {
+        error = cancelled_error();
+      } else {
+        try {
+          if (call()) {
+            return true;
+          }
+        } catch (...) {
+          error = std::current_exception();
+        }
+      }
+    }
+    /* The transfer stops by itself once OnData() returns false for all. */
+    Leave(waiter.get());
+    waiter->Complete(error);
+    return false;
+  }
+};
+
+void TransportCoalescer::Waiter::Expire() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (finished) {
+      return;
+    }
+  }
+  Flight* joined = flight;
+  if (joined && joined->Leave(this)) {
+    joined->cancellation->Cancel();
+  }
+  Complete(deadline_error());
+}
+
+TransportCoalescer::TransportCoalescer(std::unique_ptr<Transport> transport)
+    : transport_(std::move(transport)), state_(std::make_shared<State>()) {}
+
+TransportCoalescer::~TransportCoalescer() {}
+
+std::unique_ptr<Transport> TransportCoalescer::Clone() const {
+  return std::make_unique<TransportCoalescer>(transport_->Clone());
+}
+
+/** @return Whether a request may share its transfer. */
+static bool coalescable(
+    /** [in] List of files to upload. */
+    const std::vector<FileUpload>& files,
+    /** [in] Settings of the request. */
+    const FetchOptions& options) {
+  return options.idempotent && files.empty() &&
+         !(options.cancellation && options.cancellation->IsCancelled()) &&
+         !(options.deadline &&
+           std::chrono::steady_clock::now() >= *options.deadline);
+}
+
+void TransportCoalescer::Fetch(const std::string& url,
+                               const std::vector<FileUpload>& files,
+                               std::iostream* response) {
+  transport_->Fetch(url, files, response);
+}
+
+void TransportCoalescer::Fetch(const std::string& url,
+                               const std::vector<FileUpload>& files,
+                               ResponseSink* sink,
+                               const FetchOptions& options) {
+  if (!coalescable(files, options)) {
+    transport_->Fetch(url, files, sink, options);
+    return;
+  }
+
+  struct {
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool done = false;
+    std::exception_ptr error;
+  } wait;
+
+  auto waiter = std::make_shared<Waiter>();
+  waiter->sink = sink;
+  waiter->on_done = [&wait](std::exception_ptr error) {
+    std::lock_guard<std::mutex> lock(wait.mutex);
+    wait.done = true;
+    wait.error = error;
+    wait.cv.notify_all();
+  };
+  waiter->wake = [&wait]() {
+    std::lock_guard<std::mutex> lock(wait.mutex);
+    wait.cv.notify_all();
+  };
+  Join(url, options, waiter);
+
+  std::unique_lock<std::mutex> lock(wait.mutex);
+  auto woken = [&]() { return wait.done || waiter->cancelled; };
+  if (waiter->deadline) {
+    wait.cv.wait_until(lock, *waiter->deadline, woken);
+  } else {
+    wait.cv.wait(lock, woken);
+  }
+  if (!wait.done) {
+    /* Leave the transfer to the others. */
+    lock.unlock();
+    if (waiter->cancelled) {
+      waiter->Complete(cancelled_error());
+    } else {
+      waiter->Expire();
+    }
+    lock.lock();
+    wait.cv.wait(lock, [&]() { return wait.done; });
+  }
+  if (wait.error) {
+    std::rethrow_exception(wait.error);
+  }
+}
+
+void TransportCoalescer::FetchAsync(const std::string& url,
+                                    const std::vector<FileUpload>& files,
+                                    std::iostream* response,
+                                    FetchCallback on_done) {
+  transport_->FetchAsync(url, files, response, std::move(on_done));
+}
+
+void TransportCoalescer::FetchAsync(const std::string& url,
+                                    const std::vector<FileUpload>& files,
+                                    ResponseSink* sink,
+                                    const FetchOptions& options,
+                                    FetchCallback on_done) {
+  if (!coalescable(files, options)) {
+    transport_->FetchAsync(url, files, sink, options, std::move(on_done));
+    return;
+  }
+
+  auto waiter = std::make_shared<Waiter>();
+  waiter->sink = sink;
+  waiter->on_done = std::move(on_done);
+  Join(url, options, waiter);
+  if (waiter->deadline) {
+    std::weak_ptr<Waiter> weak = waiter;
+    state_->timer.At(*waiter->deadline, [weak]() {
+      if (auto expired = weak.lock()) {
+        expired->Expire();
+      }
+    });
+  }
+}
+
+void TransportCoalescer::Join(const std::string& url,
+                              const FetchOptions& options,
+                              std::shared_ptr<Waiter> waiter) {
+  waiter->cancellation = options.cancellation;
+  if (waiter->cancellation) {
+    /* Only flags the request, it is finished by the transfer or by the thread
+     * that waits for it. */
+    Waiter* raw = waiter.get();
+    waiter->subscription = waiter->cancellation->Subscribe([raw]() {
+      raw->cancelled = true;
+      Flight* flight = raw->flight;
+      if (flight && flight->Leave(raw)) {
+        flight->cancellation->Cancel();
+      }
+      if (raw->wake) {
+        raw->wake();
+      }
+    });
+  }
+
+  std::shared_ptr<Flight> flight;
+  bool lead = false;
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    auto it = state_->flights.find(url);
+    if (it != state_->flights.end()) {
+      /* One that may end before the deadline of this request would not do,
+       * no deadline counts as the latest. An earlier deadline of this request
+       * is kept by the request itself. */
+      const auto& deadline = it->second->deadline;
+      std::lock_guard<std::mutex> flight_lock(it->second->mutex);
+      if (it->second->live > 0 &&
+          (!deadline || (options.deadline && *options.deadline <= *deadline))) {
+        flight = it->second;
+        flight->waiters.push_back(waiter);
+        ++flight->live;
+        waiter->flight = flight.get();
+        if (options.deadline && (!deadline || *options.deadline < *deadline)) {
+          waiter->deadline = options.deadline;
+        }
+        ++state_->coalesced;
+      }
+    }
+    if (!flight) {
+      flight = std::make_shared<Flight>();
+      flight->url = url;
+      flight->deadline = options.deadline;
+      flight->state = state_;
+      flight->waiters.push_back(waiter);
+      flight->live = 1;
+      waiter->flight = flight.get();
+      state_->flights[url] = flight;
+      lead = true;
+    }
+  }
+  if (waiter->cancelled && flight->Leave(waiter.get())) {
+    /* Cancelled before it was counted in. */
+    flight->cancellation->Cancel();
+  }
+
+  if (lead) {
+    FetchOptions flight_options;
+    flight_options.cancellation = flight->cancellation;
+    flight_options.deadline = flight->deadline;
+    flight_options.idempotent = true;
+    transport_->FetchAsync(
+        url, {}, flight.get(), flight_options,
+        [flight](std::exception_ptr error) { flight->Finish(error); });
+  }
+}
+
+void TransportCoalescer::StopFetch() { transport_->StopFetch(); }
+
+void TransportCoalescer::ResetFetch() { transport_->ResetFetch(); }
+
+void TransportCoalescer::UrlEncode(const std::string& raw,
+                                   std::string* encoded) {
+  transport_->UrlEncode(raw, encoded);
+}
+
+uint64_t TransportCoalescer::CoalescedCount() const {
+  return state_->coalesced;
+}
+
+}  // namespace http
+}  // namespace ipfs
@@ -21,13 +21,41 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
 #include <ipfs/http/transport-curl.h>
 #include <ipfs/test/utils.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <future>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif /* _WIN32 */
+
+#include "url.h"
+
 namespace ipfs {
 
 namespace http {
@@ -44,70 +72,1774 @@ std::string replace_body;
  * @return true if 2xx HTTP status code */
 inline bool status_is_success(long code) { return code >= 200 && code <= 299; }
 
-/** CURL callback for writing the result to a stream. */
-static size_t curl_cb_stream(
+/** Shared by the two transfers ("legs") of a hedged fetch, see
+ * `TransportCurl::SetHedgePolicy()`. Leg 0 is the original request and leg 1
+ * its duplicate. The first leg whose body arrives claims the sink and cancels
+ * the other one. */
+class HedgeRace {
+ public:
+  /** Constructor. */
+  HedgeRace(
+      /** [in] Completion callback of the fetch. */
+      FetchCallback on_done,
+      /** [in] Token that cancels the fetch, may be null. */
+      std::shared_ptr<CancellationToken> cancellation)
+      : on_done_(std::move(on_done)), cancellation_(std::move(cancellation)) {
+    for (auto& leg : legs_) {
+      leg = std::make_shared<CancellationToken>();
+    }
+    if (cancellation_) {
+      subscription_ = cancellation_->Subscribe([this]() {
+        legs_[0]->Cancel();
+        legs_[1]->Cancel();
+      });
+    }
+  }
+
+  HedgeRace(const HedgeRace&) = delete;
+  HedgeRace& operator=(const HedgeRace&) = delete;
+
+  /** Destructor. */
+  ~HedgeRace() {
+    if (cancellation_) {
+      cancellation_->Unsubscribe(subscription_);
+    }
+  }
+
+  /** @return Token of a leg, cancelled with the fetch or when the other leg
+   * wins. */
+  const std::shared_ptr<CancellationToken>& LegToken(
+      /** [in] The leg. */
+      int leg) const {
+    return legs_[leg];
+  }
+
+  /** Note that a leg has left the queue. */
+  void OnStart(
+      /** [in] The leg. */
+      int leg) {
+    started_[leg] = true;
+  }
+
+  /** Claim the sink for a leg, once its body starts to arrive.
+   * @return false if the other leg has claimed it already. */
+  bool Claim(
+      /** [in] The leg. */
+      int leg) {
+    int winner = -1;
+    if (winner_.compare_exchange_strong(winner, leg)) {
+      legs_[1 - leg]->Cancel();
+      return true;
+    }
+    return winner == leg;
+  }
+
+  /** Completion callback of a leg. The outcome of the fetch is that of the
+   * winner, or that of the original request if neither leg won, after both
+   * legs that were started have finished. */
+  void OnDone(
+      /** [in] The leg. */
+      int leg,
+      /** [in] Null on success, otherwise the error of the leg. */
+      std::exception_ptr error) {
+    FetchCallback on_done;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      done_[leg] = true;
+      errors_[leg] = error;
+      const int winner = winner_;
+      if (!on_done_ || winner == 1 - leg) {
+        /* Reported already, or to be reported by the winner. */
+        return;
+      }
+      if (winner != leg) {
+        if (started_[1 - leg] && !done_[1 - leg]) {
+          /* The other leg may still make it. */
+          return;
+        }
+        error = errors_[0] ? errors_[0] : error;
+      }
+      on_done = std::move(on_done_);
+      on_done_ = nullptr;
+    }
+    legs_[1 - leg]->Cancel();
+    on_done(error);
+  }
+
+ private:
+  /** Protects `done_`, `errors_` and `on_done_`. */
+  std::mutex mutex_;
+
+  /** Completion callback of the fetch, empty once it has been called. */
+  FetchCallback on_done_;
+
+  /** Token that cancels the fetch, may be null. */
+  const std::shared_ptr<CancellationToken> cancellation_;
+
+  /** Id of the subscription to `cancellation_`. */
+  uint64_t subscription_ = 0;
+
+  /** Tokens of the legs. */
+  std::shared_ptr<CancellationToken> legs_[2];
+
+  /** The leg that has claimed the sink, -1 until one has. */
+  std::atomic<int> winner_{-1};
+
+  /** Which legs have left the queue. */
+  std::atomic<bool> started_[2] = {false, false};
+
+  /** Which legs have finished. */
+  bool done_[2] = {false, false};
+
+  /** Errors of the legs that have finished. */
+  std::exception_ptr errors_[2];
+};
+
+/** Most of the body of an error response that is kept for the error message.
+ * The daemon explains an error in a short JSON, anything longer is unlikely
+ * to be an explanation, eg. a proxy's HTML page. */
+static constexpr size_t kMaxErrorBody = 4096;
+
+/** Where the body of a response goes: to the caller's sink if the response is
+ * successful, otherwise into a buffer for the error message. */
+struct ResponseReceiver {
+  /** Easy handle of the transfer. */
+  CURL* curl = nullptr;
+
+  /** Consumer of the body of a successful response. */
+  ResponseSink* sink = nullptr;
+
+  /** HTTP status code, 0 until the first chunk of the body has arrived. */
+  long status_code = 0;
+
+  /** Set once `ResponseSink::OnBegin()` has been called. */
+  bool begun = false;
+
+  /** Set when the sink asked to end the transfer early. */
+  bool stopped = false;
+
+  /** Exception thrown by the sink, it ends the transfer. */
+  std::exception_ptr sink_error;
+
+  /** Start of the body of an error response, at most `kMaxErrorBody`. */
+  std::string error_body;
+
+  /** Size of the whole body of an error response. */
+  size_t error_body_size = 0;
+
+  /** Race of a hedged fetch that the transfer takes part in, may be null. */
+  HedgeRace* race = nullptr;
+
+  /** Leg of the transfer in `race`. */
+  int leg = 0;
+};
+
+/** CURL callback for handing the result to a `ResponseReceiver`. */
+static size_t curl_cb_sink(
     /** [in] Pointer to the result. */
     char* ptr,
     /** [in] Size each chunk of the result. */
     size_t size,
     /** [in] Number of chunks in the result. */
     size_t nmemb,
-    /** [out] Response (a pointer to `std::iostream`). */
-    void* response_void) {
-  std::iostream* response = static_cast<std::iostream*>(response_void);
-
+    /** [out] Receiver (a pointer to `ResponseReceiver`). */
+    void* receiver_void) {
+  ResponseReceiver* receiver = static_cast<ResponseReceiver*>(receiver_void);
   const size_t n = size * nmemb;
-  if (static_cast<std::streamsize>(n) < 0) {
-    throw std::runtime_error("Buffer Size overflowing");
-  } else {
-    response->write(ptr, static_cast<std::streamsize>(n));
-  }
-
-  return n;
-}
 
-void TransportCurl::InitCurl() {
-  global_init_result_ = curl_global_init(CURL_GLOBAL_ALL);
-  if (global_init_result_ != CURLE_OK || curl_global_injected_failure) {
-    throw std::runtime_error("curl_global_init() failed");
+  if (receiver->status_code == 0) {
+    /* The headers are complete once the body arrives.
+     * https://curl.se/libcurl/c/CURLINFO_RESPONSE_CODE.html */
+    curl_easy_getinfo(receiver->curl, CURLINFO_RESPONSE_CODE,
+                      &receiver->status_code);
   }
 
-  /* Init a multi stack
-   * https://curl.se/libcurl/c/curl_multi_init.html */
-  multi_handle_ = curl_multi_init();
-
-  /* Create a cURL easy handle (which we will reuse)
-   * https://curl.se/libcurl/c/curl_easy_init.html */
-  curl_ = curl_easy_init();
+  if (!status_is_success(receiver->status_code)) {
+    if (receiver->error_body.size() < kMaxErrorBody) {
+      receiver->error_body.append(
+          ptr, std::min(n, kMaxErrorBody - receiver->error_body.size()));
+    }
+    receiver->error_body_size += n;
+    return n;
+  }
 
-  if (curl_ == NULL) {
-    throw std::runtime_error("curl_easy_init() failed");
+  /* Exceptions must not cross cURL, so they are kept for later. Returning
+   * anything but `n` makes cURL end the transfer with CURLE_WRITE_ERROR. */
+  try {
+    if (!receiver->begun) {
+      if (receiver->race && !receiver->race->Claim(receiver->leg)) {
+        /* The other leg is faster, this one is about to be cancelled. */
+        return 0;
+      }
+      receiver->begun = true;
+      curl_off_t content_length = -1;
+      /* https://curl.se/libcurl/c/CURLINFO_CONTENT_LENGTH_DOWNLOAD_T.html */
+      curl_easy_getinfo(receiver->curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T,
+                        &content_length);
+      receiver->sink->OnBegin(content_length);
+    }
+    if (!receiver->sink->OnData(ptr, n)) {
+      receiver->stopped = true;
+      return 0;
+    }
+  } catch (...) {
+    receiver->sink_error = std::current_exception();
+    return 0;
   }
 
-  if (curl_verbose_) {
+  return n;
+}
+
+/** Apply the options that every request of ours uses to a fresh (or freshly
+ * reset) easy handle. */
+static void setup_easy_handle(
+    /** [in,out] Handle to configure. */
+    CURL* curl,
+    /** [in] Enable cURL verbose mode. */
+    bool verbose,
+    /** [in] Share object to attach the handle to. */
+    CURLSH* share) {
+  /* https://curl.se/libcurl/c/CURLOPT_SHARE.html */
+  curl_easy_setopt(curl, CURLOPT_SHARE, share);
+
+  if (verbose) {
     /* https://curl.se/libcurl/c/CURLOPT_VERBOSE.html */
-    curl_easy_setopt(curl_, CURLOPT_VERBOSE, 1L);
+    curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
   }
 
   /* Enable TCP keepalive.
    * https://curl.se/libcurl/c/CURLOPT_TCP_KEEPALIVE.html */
-  curl_easy_setopt(curl_, CURLOPT_TCP_KEEPALIVE, 1);
+  curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1);
 
   /* Seconds to wait before sending keep-alive packets.
    * https://curl.se/libcurl/c/CURLOPT_TCP_KEEPIDLE.html */
-  curl_easy_setopt(curl_, CURLOPT_TCP_KEEPIDLE, 30);
+  curl_easy_setopt(curl, CURLOPT_TCP_KEEPIDLE, 30);
 
   /* Seconds between keep-alive probes.
    * https://curl.se/libcurl/c/CURLOPT_TCP_KEEPINTVL.html */
-  curl_easy_setopt(curl_, CURLOPT_TCP_KEEPINTVL, 10);
+  curl_easy_setopt(curl, CURLOPT_TCP_KEEPINTVL, 10);
 
   /* https://curl.se/libcurl/c/CURLOPT_USERAGENT.html */
-  curl_easy_setopt(curl_, CURLOPT_USERAGENT, "cpp-ipfs-http-client");
+  curl_easy_setopt(curl, CURLOPT_USERAGENT, "cpp-ipfs-http-client");
 
   /* Avoid race condition when used in threading
    * https://curl.se/libcurl/c/threadsafe.html
    * https://curl.se/libcurl/c/CURLOPT_NOSIGNAL.html */
-  curl_easy_setopt(curl_, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+}
+
+/** Route the request of an easy handle over a Unix domain socket. */
+static void setup_unix_socket(
+    /** [in,out] Handle to configure. */
+    CURL* curl,
+    /** [in] Path of the socket, nothing is done if it is empty. */
+    const std::string& path) {
+  if (!path.empty()) {
+    /* cURL keeps its own copy of the path.
+     * https://curl.se/libcurl/c/CURLOPT_UNIX_SOCKET_PATH.html */
+    curl_easy_setopt(curl, CURLOPT_UNIX_SOCKET_PATH, path.c_str());
+  }
+}
+
+/** Bound the transfer of an easy handle, connecting included, by a deadline.
+ * @return false if the deadline has passed already. */
+static bool setup_deadline(
+    /** [in,out] Handle to configure. */
+    CURL* curl,
+    /** [in] The deadline, nothing is done if it is empty. */
+    const std::optional<std::chrono::steady_clock::time_point>& deadline) {
+  if (!deadline) {
+    return true;
+  }
+  /* Rounded up, so that curl does not give up before the deadline. */
+  const auto remaining = std::chrono::ceil<std::chrono::milliseconds>(
+                             *deadline - std::chrono::steady_clock::now())
+                             .count();
+  if (remaining <= 0) {
+    return false;
+  }
+  /* https://curl.se/libcurl/c/CURLOPT_TIMEOUT_MS.html */
+  curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, static_cast<long>(remaining));
+  /* https://curl.se/libcurl/c/CURLOPT_CONNECTTIMEOUT_MS.html */
+  curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS,
+                   static_cast<long>(remaining));
+  return true;
+}
+
+/** Upload source that reads from a region of memory, for
+ * curl_mime_data_cb(). */
+struct MemoryReader {
+  /** Start of the region. */
+  const char* data;
+
+  /** Size of the region. */
+  size_t size;
+
+  /** Read position within the region. */
+  size_t position = 0;
+
+  /** cURL read callback.
+   * https://curl.se/libcurl/c/CURLOPT_READFUNCTION.html */
+  static size_t Read(char* buffer, size_t size, size_t nitems, void* arg) {
+    MemoryReader* reader = static_cast<MemoryReader*>(arg);
+    const size_t n =
+        std::min(size * nitems, reader->size - reader->position);
+    std::memcpy(buffer, reader->data + reader->position, n);
+    reader->position += n;
+    return n;
+  }
+
+  /** cURL seek callback, used when the upload has to be sent again.
+   * https://curl.se/libcurl/c/CURLOPT_SEEKFUNCTION.html */
+  static int Seek(void* arg, curl_off_t offset, int origin) {
+    MemoryReader* reader = static_cast<MemoryReader*>(arg);
+    if (origin != SEEK_SET || offset < 0 ||
+        static_cast<size_t>(offset) > reader->size) {
+      return CURL_SEEKFUNC_CANTSEEK;
+    }
+    reader->position = static_cast<size_t>(offset);
+    return CURL_SEEKFUNC_OK;
+  }
+};
+
+/** Upload source that asks a `FileUpload::reader` for the data, for
+ * curl_mime_data_cb(). */
+struct FunctionReader {
+  /** The producer, a copy of the one in the `FileUpload`. */
+  std::function<size_t(char* buffer, size_t max_size)> reader;
+
+  /** Where to keep an exception thrown by `reader`. */
+  std::exception_ptr* error;
+
+  /** cURL read callback.
+   * https://curl.se/libcurl/c/CURLOPT_READFUNCTION.html */
+  static size_t Read(char* buffer, size_t size, size_t nitems, void* arg) {
+    FunctionReader* reader = static_cast<FunctionReader*>(arg);
+    /* Exceptions must not cross cURL. */
+    try {
+      return std::min(reader->reader(buffer, size * nitems), size * nitems);
+    } catch (...) {
+      *reader->error = std::current_exception();
+      return CURL_READFUNC_ABORT;
+    }
+  }
+};
+
+/** Read-only memory mapping of a file region, unmapped on destruction. On
+ * platforms without mmap() the region is read into memory instead. */
+class MappedRegion {
+ public:
+  /** Constructor.
+   * @throw std::exception if the file can't be mapped */
+  MappedRegion(
+      /** [in] Name of the file. */
+      const std::string& file_name,
+      /** [in] Start of the region. */
+      uint64_t offset,
+      /** [in] Size of the region, -1 for up to the end of the file. */
+      int64_t size) {
+#ifdef _WIN32
+    std::ifstream file(file_name, std::ios::binary);
+    if (!file) {
+      throw std::runtime_error("Can't open \"" + file_name + "\"");
+    }
+    file.seekg(0, std::ios::end);
+    const uint64_t file_size = static_cast<uint64_t>(file.tellg());
+    size_ = RegionSize(file_name, file_size, offset, size);
+    copy_.resize(size_);
+    file.seekg(static_cast<std::streamoff>(offset));
+    file.read(copy_.data(), static_cast<std::streamsize>(size_));
+    data_ = copy_.data();
+#else
+    const int fd = open(file_name.c_str(), O_RDONLY);
+    if (fd == -1) {
+      throw std::runtime_error("Can't open \"" + file_name +
+                               "\": " + std::strerror(errno));
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      close(fd);
+      throw std::runtime_error("Can't stat \"" + file_name + "\"");
+    }
+
+    try {
+      size_ = RegionSize(file_name, static_cast<uint64_t>(st.st_size), offset,
+                         size);
+    } catch (...) {
+      close(fd);
+      throw;
+    }
+
+    if (size_ > 0) {
+      /* mmap() wants an offset that is a multiple of the page size. */
+      const uint64_t page = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+      const uint64_t aligned_offset = offset / page * page;
+      mapping_size_ = size_ + (offset - aligned_offset);
+      mapping_ = mmap(nullptr, mapping_size_, PROT_READ, MAP_PRIVATE, fd,
+                      static_cast<off_t>(aligned_offset));
+      if (mapping_ == MAP_FAILED) {
+        mapping_ = nullptr;
+        close(fd);
+        throw std::runtime_error("Can't map \"" + file_name +
+                                 "\": " + std::strerror(errno));
+      }
+      /* The upload reads it front to back, once. */
+      madvise(mapping_, mapping_size_, MADV_SEQUENTIAL);
+      data_ = static_cast<const char*>(mapping_) + (offset - aligned_offset);
+    }
+    close(fd);
+#endif /* _WIN32 */
+  }
+
+  MappedRegion(const MappedRegion&) = delete;
+  MappedRegion& operator=(const MappedRegion&) = delete;
+
+  /** Destructor. */
+  ~MappedRegion() {
+#ifndef _WIN32
+    if (mapping_) {
+      munmap(mapping_, mapping_size_);
+    }
+#endif /* _WIN32 */
+  }
+
+  /** @return Start of the region. */
+  const char* Data() const { return data_; }
+
+  /** @return Size of the region. */
+  size_t Size() const { return size_; }
+
+ private:
+  /** Check a region against the size of the file.
+   * @return Size of the region. */
+  static size_t RegionSize(const std::string& file_name, uint64_t file_size,
+                           uint64_t offset, int64_t size) {
+    if (offset > file_size ||
+        (size >= 0 && static_cast<uint64_t>(size) > file_size - offset)) {
+      throw std::runtime_error("Region is beyond the end of \"" + file_name +
+                               "\"");
+    }
+    return static_cast<size_t>(size >= 0 ? static_cast<uint64_t>(size)
+                                         : file_size - offset);
+  }
+
+  /** Start of the region. */
+  const char* data_ = nullptr;
+
+  /** Size of the region. */
+  size_t size_ = 0;
+
+#ifdef _WIN32
+  /** Contents of the region. */
+  std::string copy_;
+#else
+  /** The mapping, which starts at a page boundary before the region. */
+  void* mapping_ = nullptr;
+
+  /** Size of the mapping. */
+  size_t mapping_size_ = 0;
+#endif /* _WIN32 */
+};
+
+/** The files of a request as a multipart/form-data POST, plus whatever their
+ * sources need while the transfer runs. */
+class MultipartUpload {
+ public:
+  /** Constructor. Prepares the sources that may fail, like mappings, before
+   * anything is attached to a handle.
+   * @throw std::exception if a source can't be prepared */
+  explicit MultipartUpload(
+      /** [in] List of files to upload. */
+      const std::vector<FileUpload>& files) {
+    for (const FileUpload& file : files) {
+      if (file.type == FileUpload::Type::kMappedFile) {
+        mappings_.push_back(
+            std::make_unique<MappedRegion>(file.data, file.offset, file.size));
+      }
+    }
+  }
+
+  MultipartUpload(const MultipartUpload&) = delete;
+  MultipartUpload& operator=(const MultipartUpload&) = delete;
+
+  /** Destructor. */
+  ~MultipartUpload() {
+    /* https://curl.se/libcurl/c/curl_mime_free.html */
+    curl_mime_free(multipart_);
+  }
+
+  /** Attach the files to an easy handle. Except for `kMemory`, cURL copies
+   * what it needs from `files`. */
+  void Attach(
+      /** [in,out] Handle to configure. */
+      CURL* curl,
+      /** [in] The list of files that was passed to the constructor. */
+      const std::vector<FileUpload>& files) {
+    /* https://curl.se/libcurl/c/CURLOPT_POST.html */
+    curl_easy_setopt(curl, CURLOPT_POST, 1L);
+
+    multipart_ = curl_mime_init(curl);
+    if (!multipart_) {
+      return;
+    }
+
+    size_t mapping = 0;
+    for (size_t i = 0; i < files.size(); ++i) {
+      const FileUpload& file = files[i];
+      const std::string name("file" + std::to_string(i));
+      static const char* content_type = "application/octet-stream";
+
+      /* Add a part.
+       * https://curl.se/libcurl/c/curl_mime_addpart.html */
+      curl_mimepart* part = curl_mime_addpart(multipart_);
+      curl_mime_name(part, name.c_str());
+
+      switch (file.type) {
+        case FileUpload::Type::kFileContents:
+          /* Memory source, copied by cURL: */
+          curl_mime_data(part, file.data.c_str(), file.data.length());
+          break;
+        case FileUpload::Type::kFileName:
+          /* File source: */
+          curl_mime_filedata(part, file.data.c_str());
+          break;
+        case FileUpload::Type::kMemory:
+          AddMemory(part, reinterpret_cast<const char*>(file.memory.data()),
+                    file.memory.size());
+          break;
+        case FileUpload::Type::kMappedFile:
+          AddMemory(part, mappings_[mapping]->Data(),
+                    mappings_[mapping]->Size());
+          ++mapping;
+          break;
+        case FileUpload::Type::kReader:
+          function_readers_.push_back(std::make_unique<FunctionReader>(
+              FunctionReader{file.reader, &error_}));
+          /* A size of -1 makes cURL send the request chunked.
+           * https://curl.se/libcurl/c/curl_mime_data_cb.html */
+          curl_mime_data_cb(part, static_cast<curl_off_t>(file.size),
+                            FunctionReader::Read, nullptr, nullptr,
+                            function_readers_.back().get());
+          break;
+      }
+
+      // Override filename (instead of using the remote file name)
+      curl_mime_filename(part, file.path.c_str());
+      curl_mime_type(part, content_type);
+    }
+
+    /* Set the form info
+     * https://curl.se/libcurl/c/CURLOPT_MIMEPOST.html */
+    curl_easy_setopt(curl, CURLOPT_MIMEPOST, multipart_);
+  }
+
+  /** @return The exception that a reader threw, if any. */
+  std::exception_ptr Error() const { return error_; }
+
+  /** @return Whether the files can be sent again, for a retry. cURL rewinds
+   * all sources except the `kReader` ones. */
+  bool Replayable() const { return function_readers_.empty(); }
+
+ private:
+  /** Make a part read from memory that we don't own, without copying it. */
+  void AddMemory(curl_mimepart* part, const char* data, size_t size) {
+    readers_.push_back(std::make_unique<MemoryReader>(MemoryReader{data, size}));
+    /* https://curl.se/libcurl/c/curl_mime_data_cb.html */
+    curl_mime_data_cb(part, static_cast<curl_off_t>(size), MemoryReader::Read,
+                      MemoryReader::Seek, nullptr, readers_.back().get());
+  }
+
+  /** Mappings of the `kMappedFile` files, in order. */
+  std::vector<std::unique_ptr<MappedRegion>> mappings_;
+
+  /** Sources of the parts that are read from memory. */
+  std::vector<std::unique_ptr<MemoryReader>> readers_;
+
+  /** Sources of the parts that are produced by a `FileUpload::reader`. */
+  std::vector<std::unique_ptr<FunctionReader>> function_readers_;
+
+  /** Exception thrown by a `FileUpload::reader`, it aborts the transfer. */
+  std::exception_ptr error_;
+
+  /** The mime structure, attached to the handle. */
+  curl_mime* multipart_ = nullptr;
+};
+
+/** Compose the error message for a non-2xx HTTP response.
+ * @return The error message. */
+static std::string status_code_error(
+    /** [in] HTTP status code. */
+    long status_code,
+    /** [in] Start of the body of the error response. Usually it is a short
+     * HTML or JSON that describes the error. */
+    const std::string& body,
+    /** [in] Size of the whole body. */
+    size_t body_size) {
+  std::string error = "HTTP request failed with status code " +
+                      std::to_string(status_code) + ". Response body:\n" +
+                      body;
+  if (body_size > body.size()) {
+    error += "\n[" + std::to_string(body_size - body.size()) +
+             " more bytes not shown]";
+  }
+  return error;
+}
+
+/** Check the outcome of a finished transfer.
+ * @return Null on success, otherwise the error. */
+static std::exception_ptr transfer_error(
+    /** [in] Receiver of the response body. */
+    const ResponseReceiver& receiver,
+    /** [in] Result code of the transfer. */
+    CURLcode result,
+    /** [in] cURL error message buffer of the transfer. */
+    const char* curl_error,
+    /** [in] Pretend that getting the HTTP status code failed. */
+    bool getinfo_injected_failure = false) {
+  if (receiver.sink_error) {
+    return receiver.sink_error;
+  }
+  if (receiver.stopped && result == CURLE_WRITE_ERROR) {
+    return nullptr;
+  }
+  if (result != CURLE_OK) {
+    return std::make_exception_ptr(std::runtime_error(
+        std::string(curl_easy_strerror(result)) +
+        (curl_error[0] != '\0' ? std::string(": ") + curl_error : "")));
+  }
+
+  long status_code = 0;
+  /* https://curl.se/libcurl/c/curl_easy_getinfo.html */
+  CURLcode res =
+      curl_easy_getinfo(receiver.curl, CURLINFO_RESPONSE_CODE, &status_code);
+  if (res != CURLE_OK || getinfo_injected_failure) {
+    return std::make_exception_ptr(
+        std::runtime_error("Can't get the HTTP status code from CURL: " +
+                           std::string(curl_easy_strerror(res))));
+  }
+  if (!status_is_success(status_code)) {
+    return std::make_exception_ptr(HttpStatusError(
+        status_code, status_code_error(status_code, receiver.error_body,
+                                       receiver.error_body_size)));
+  }
+  return nullptr;
+}
+
+/** Check whether a failed transfer may succeed when it is sent again. That is
+ * only the case if none of the body has reached the sink yet.
+ * @return true if a retry may help. */
+static bool is_retryable(
+    /** [in] Receiver of the response body. */
+    const ResponseReceiver& receiver,
+    /** [in] Result code of the transfer. */
+    CURLcode result) {
+  if (receiver.begun || receiver.sink_error) {
+    return false;
+  }
+  switch (result) {
+    case CURLE_COULDNT_CONNECT:
+    case CURLE_SEND_ERROR:
+    case CURLE_RECV_ERROR:
+    case CURLE_GOT_NOTHING:
+    case CURLE_PARTIAL_FILE:
+    case CURLE_HTTP2:
+    case CURLE_HTTP2_STREAM:
+      return true;
+    case CURLE_OK: {
+      long status_code = receiver.status_code;
+      if (status_code == 0) {
+        /* https://curl.se/libcurl/c/CURLINFO_RESPONSE_CODE.html */
+        curl_easy_getinfo(receiver.curl, CURLINFO_RESPONSE_CODE, &status_code);
+      }
+      /* Not 500, with which the daemon reports errors of the request. */
+      return status_code == 429 || status_code == 502 || status_code == 503 ||
+             status_code == 504;
+    }
+    default:
+      return false;
+  }
+}
+
+/** Keeps a function subscribed to a cancellation token for its lifetime. */
+class CancellationSubscription {
+ public:
+  /** Constructor. */
+  CancellationSubscription(
+      /** [in] Token to subscribe to, nothing is done if it is null. */
+      CancellationToken* token,
+      /** [in] See `CancellationToken::Subscribe()`. */
+      std::function<void()> on_cancel)
+      : token_(token) {
+    if (token_) {
+      id_ = token_->Subscribe(std::move(on_cancel));
+    }
+  }
+
+  CancellationSubscription(const CancellationSubscription&) = delete;
+  CancellationSubscription& operator=(const CancellationSubscription&) = delete;
+
+  /** Destructor. */
+  ~CancellationSubscription() {
+    if (token_) {
+      token_->Unsubscribe(id_);
+    }
+  }
+
+ private:
+  /** The token, may be null. */
+  CancellationToken* token_;
+
+  /** Id of the subscription. */
+  uint64_t id_ = 0;
+};
+
+/** Decides whether and when a failed fetch is sent again, see
+ * `TransportCurl::SetRetryPolicy()`. Shared by the copies of a transport and
+ * used from any thread. */
+class TransportCurl::Retrier {
+ public:
+  /** Constructor. */
+  Retrier() : budget_(policy_.budget_max), random_(std::random_device()()) {}
+
+  /** Replace the policy, which refills the budget. */
+  void SetPolicy(
+      /** [in] The policy. */
+      const RetryPolicy& policy) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    policy_ = policy;
+    budget_ = policy_.budget_max;
+  }
+
+  /** Account for a new fetch that may be retried. */
+  void OnFetch() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    budget_ = std::min(policy_.budget_max, budget_ + policy_.budget_ratio);
+  }
+
+  /** Decide about a retry after a transient failure.
+   * @return How long to wait before the retry, nothing to give up. */
+  std::optional<std::chrono::milliseconds> NextRetry(
+      /** [in] Number of the attempt that failed, starting from 1. */
+      int attempt,
+      /** [in] Deadline of the fetch, if any. */
+      const std::optional<std::chrono::steady_clock::time_point>& deadline) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (attempt >= policy_.max_attempts || budget_ < 1) {
+      return std::nullopt;
+    }
+    const double backoff = std::min(
+        static_cast<double>(policy_.max_backoff.count()),
+        static_cast<double>(policy_.initial_backoff.count()) *
+            std::pow(policy_.backoff_multiplier, attempt - 1));
+    /* Full jitter, so that the clients that failed together don't retry
+     * together. */
+    std::uniform_real_distribution<double> jitter(0, backoff);
+    const std::chrono::milliseconds delay(std::llround(jitter(random_)));
+    if (deadline && std::chrono::steady_clock::now() + delay >= *deadline) {
+      return std::nullopt;
+    }
+    budget_ -= 1;
+    return delay;
+  }
+
+ private:
+  /** Protects all members below. */
+  std::mutex mutex_;
+
+  /** The policy. */
+  RetryPolicy policy_;
+
+  /** Retries that may be made right now. */
+  double budget_;
+
+  /** Source of the jitter. */
+  std::minstd_rand random_;
+};
+
+/** Decides when a fetch is hedged, from the times to the first byte of the
+ * recent fetches, see `TransportCurl::SetHedgePolicy()`. Shared by the copies
+ * of a transport and used from any thread. */
+class TransportCurl::Hedger {
+ public:
+  /** Replace the policy, which forgets the recorded times. */
+  void SetPolicy(
+      /** [in] The policy. */
+      const HedgePolicy& policy) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    policy_ = policy;
+    samples_.clear();
+    next_sample_ = 0;
+  }
+
+  /** @return Whether fetches are hedged at all. */
+  bool Enabled() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return policy_.percentile > 0;
+  }
+
+  /** Decide about hedging a new fetch.
+   * @return How long to wait for the first byte before sending the duplicate,
+   * nothing if hedging is off. */
+  std::optional<std::chrono::milliseconds> Delay(
+      /** [out] Where to send the duplicate, see `HedgePolicy::endpoint`. */
+      std::string* endpoint) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (policy_.percentile <= 0) {
+      return std::nullopt;
+    }
+    *endpoint = policy_.endpoint;
+    if (samples_.size() < kMinSamples) {
+      return policy_.initial_delay;
+    }
+    std::vector<int64_t> sorted(samples_);
+    const size_t k = std::min(
+        sorted.size() - 1,
+        static_cast<size_t>(policy_.percentile * sorted.size()));
+    std::nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+    return std::max(policy_.min_delay,
+                    std::chrono::ceil<std::chrono::milliseconds>(
+                        std::chrono::microseconds(sorted[k])));
+  }
+
+  /** Record the time to the first byte of a fetch that could have been
+   * hedged. */
+  void Record(
+      /** [in] The time. */
+      std::chrono::microseconds time_to_first_byte) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (samples_.size() < kMaxSamples) {
+      samples_.push_back(time_to_first_byte.count());
+    } else {
+      samples_[next_sample_] = time_to_first_byte.count();
+      next_sample_ = (next_sample_ + 1) % kMaxSamples;
+    }
+  }
+
+ private:
+  /** Number of recorded times needed to tell the percentile. */
+  static constexpr size_t kMinSamples = 20;
+
+  /** Number of recent times to keep. */
+  static constexpr size_t kMaxSamples = 256;
+
+  /** Protects all members below. */
+  std::mutex mutex_;
+
+  /** The policy. */
+  HedgePolicy policy_;
+
+  /** Recent times to the first byte, in microseconds. */
+  std::vector<int64_t> samples_;
+
+  /** Slot of `samples_` to overwrite next, once it is full. */
+  size_t next_sample_ = 0;
+};
+
+/** Wait before retrying a blocking fetch. The wait ends early, with an
+ * exception, if the fetch is cancelled or aborted. */
+static void wait_for_retry(
+    /** [in] Multi handle of the fetch, woken up by the cancellation. */
+    CURLM* multi_handle,
+    /** [in] How long to wait. */
+    std::chrono::milliseconds delay,
+    /** [in] Token that cancels the fetch, may be null. */
+    CancellationToken* cancellation,
+    /** [in] Cleared by `TransportCurl::StopFetch()`. */
+    const std::atomic<bool>& keep_running) {
+  const auto until = std::chrono::steady_clock::now() + delay;
+  for (;;) {
+    if (cancellation && cancellation->IsCancelled()) {
+      throw std::runtime_error("Request was cancelled");
+    }
+    if (!keep_running) {
+      throw std::runtime_error("Request was aborted");
+    }
+    const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                          until - std::chrono::steady_clock::now())
+                          .count();
+    if (left <= 0) {
+      return;
+    }
+    /* Look at the abort flag every 40 ms, like Perform() does.
+     * https://curl.se/libcurl/c/curl_multi_poll.html */
+    curl_multi_poll(multi_handle, NULL, 0,
+                    static_cast<int>(std::min<int64_t>(left, 40)), NULL);
+  }
+}
+
+/** cURL share object, plus the locking that libcurl needs in order to use it
+ * from several threads at once. All handles of a transport and of its copies
+ * share their DNS cache and TLS sessions through it, so a copy neither looks
+ * up the server again nor does a full TLS handshake.
+ *
+ * The connection cache is deliberately not shared: libcurl does not support
+ * sharing connections between concurrently running threads. Connections stay
+ * with the multi handle that opened them instead, and the copies of a
+ * transport share the `HandlePool` that keeps those.
+ * https://curl.se/libcurl/c/libcurl-share.html */
+class TransportCurl::Share {
+ public:
+  /** Constructor. */
+  Share() : share_(curl_share_init()) {
+    /* https://curl.se/libcurl/c/curl_share_init.html */
+    if (share_ == NULL) {
+      throw std::runtime_error("curl_share_init() failed");
+    }
+    /* https://curl.se/libcurl/c/curl_share_setopt.html */
+    curl_share_setopt(share_, CURLSHOPT_LOCKFUNC, Lock);
+    curl_share_setopt(share_, CURLSHOPT_UNLOCKFUNC, Unlock);
+    curl_share_setopt(share_, CURLSHOPT_USERDATA, this);
+    curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+  }
+
+  /** Destructor. All handles using the share must have been cleaned up. */
+  ~Share() { curl_share_cleanup(share_); }
+
+  /** @return The cURL share handle. */
+  CURLSH* Get() const { return share_; }
+
+ private:
+  /** Lock callback of the share. */
+  static void Lock(CURL*, curl_lock_data data, curl_lock_access, void* share) {
+    static_cast<Share*>(share)->locks_[data].lock();
+  }
+
+  /** Unlock callback of the share. */
+  static void Unlock(CURL*, curl_lock_data data, void* share) {
+    static_cast<Share*>(share)->locks_[data].unlock();
+  }
+
+  /** cURL share handle. */
+  CURLSH* share_;
+
+  /** One lock per kind of shared data. */
+  std::mutex locks_[CURL_LOCK_DATA_LAST];
+};
+
+/** Easy handle plus the multi handle that drives it in a blocking `Fetch()`. */
+struct PooledHandle {
+  /** cURL easy handle. */
+  CURL* curl;
+
+  /** cURL multi handle, it also keeps the open connections. */
+  CURLM* multi_handle;
+};
+
+/** Handles for the blocking `Fetch()`. Every call checks out a handle of its
+ * own, so any number of threads can fetch through the same transport (and its
+ * copies) at once. Handles are reused most recently returned first, which
+ * favours the ones that still have a live connection to the server. */
+class TransportCurl::HandlePool {
+ public:
+  /** Constructor. */
+  HandlePool(
+      /** [in] Enable cURL verbose mode on the easy handles. */
+      bool curl_verbose,
+      /** [in] Share object to attach the easy handles to. */
+      std::shared_ptr<Share> share)
+      : curl_verbose_(curl_verbose), share_(std::move(share)) {}
+
+  /** Destructor. All handles must have been returned. */
+  ~HandlePool() {
+    for (const PooledHandle& handle : idle_) {
+      curl_easy_cleanup(handle.curl);
+      curl_multi_cleanup(handle.multi_handle);
+    }
+  }
+
+  /** Check out a handle, reusing an idle one if possible.
+   * @return Handle with our default options set. */
+  PooledHandle Acquire() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!idle_.empty()) {
+        PooledHandle handle = idle_.back();
+        idle_.pop_back();
+        return handle;
+      }
+    }
+
+    /* Create a cURL easy handle (which we will reuse)
+     * https://curl.se/libcurl/c/curl_easy_init.html */
+    CURL* curl = curl_easy_init();
+    if (curl == NULL) {
+      throw std::runtime_error("curl_easy_init() failed");
+    }
+    setup_easy_handle(curl, curl_verbose_, share_->Get());
+
+    /* Init a multi stack
+     * https://curl.se/libcurl/c/curl_multi_init.html */
+    CURLM* multi_handle = curl_multi_init();
+    if (multi_handle == NULL) {
+      curl_easy_cleanup(curl);
+      throw std::runtime_error("curl_multi_init() failed");
+    }
+
+    return {curl, multi_handle};
+  }
+
+  /** Return a handle that is no longer used by any transfer. */
+  void Release(
+      /** [in] Handle to return. */
+      const PooledHandle& handle) {
+    /* Reset the easy to default settings, so we can safely reuse the
+     * handle */
+    curl_easy_reset(handle.curl);
+    setup_easy_handle(handle.curl, curl_verbose_, share_->Get());
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    idle_.push_back(handle);
+  }
+
+ private:
+  /** Flag for enabling CURL verbose mode on new easy handles. */
+  const bool curl_verbose_;
+
+  /** Share object of the easy handles, outlives them. */
+  const std::shared_ptr<Share> share_;
+
+  /** Protects `idle_`. */
+  std::mutex mutex_;
+
+  /** Handles that are ready to be reused. */
+  std::vector<PooledHandle> idle_;
+};
+
+/** One transfer started by `TransportCurl::FetchAsync()`. */
+struct AsyncTransfer {
+  /** Frees the resources that only live as long as the transfer. */
+  ~AsyncTransfer() { curl_slist_free_all(headers); }
+
+  /** Easy handle, configured for this transfer. */
+  CURL* curl = nullptr;
+
+  /** The uploaded files. */
+  std::unique_ptr<MultipartUpload> upload;
+
+  /** Extra HTTP headers. */
+  curl_slist* headers = nullptr;
+
+  /** Receiver of the response body. */
+  ResponseReceiver receiver;
+
+  /** Called when the transfer has finished. */
+  FetchCallback on_done;
+
+  /** Token that cancels the transfer, may be null. */
+  std::shared_ptr<CancellationToken> cancellation;
+
+  /** Id of the subscription to `cancellation`. */
+  uint64_t subscription = 0;
+
+  /** Deadline of the transfer, applied when it leaves the queue. */
+  std::optional<std::chrono::steady_clock::time_point> deadline;
+
+  /** Whether the transfer may be retried, see `TransportCurl::Retrier`. */
+  bool may_retry = false;
+
+  /** Number of the current attempt, starting from 1. */
+  int attempt = 1;
+
+  /** When to start the next attempt, while waiting for a retry. The
+   * duplicate of a hedged fetch waits the same way for its start. */
+  std::chrono::steady_clock::time_point retry_at;
+
+  /** Duplicate of the transfer, if it is hedged, until it is scheduled. */
+  std::unique_ptr<AsyncTransfer> hedge;
+
+  /** How long after the start of the transfer `hedge` starts. */
+  std::chrono::milliseconds hedge_delay{0};
+
+  /** Whether the time to the first byte feeds `TransportCurl::Hedger`. */
+  bool record_first_byte = false;
+
+  /** cURL error message buffer. */
+  char curl_error[CURL_ERROR_SIZE] = "";
+};
+
+/** Runs the transfers of `TransportCurl::FetchAsync()`. Transfers are queued
+ * by any thread and executed by a single background thread, which drives all
+ * of them at once on one multi handle. The thread is started on the first
+ * transfer. */
+class TransportCurl::AsyncEngine {
+ public:
+  /** Constructor. */
+  AsyncEngine(
+      /** [in] Enable cURL verbose mode on the easy handles. */
+      bool curl_verbose,
+      /** [in] Share object to attach the easy handles to. */
+      std::shared_ptr<Share> share,
+      /** [in] Retry policy of the transport. */
+      std::shared_ptr<Retrier> retrier,
+      /** [in] Hedge policy of the transport. */
+      std::shared_ptr<Hedger> hedger)
+      : curl_verbose_(curl_verbose),
+        share_(std::move(share)),
+        retrier_(std::move(retrier)),
+        hedger_(std::move(hedger)),
+        multi_handle_(curl_multi_init()) {}
+
+  /** Destructor. Stops the background thread and fails any transfer that has
+   * not finished yet. */
+  ~AsyncEngine() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+      /* The event loop may be gone already, don't tell it about the sockets
+       * that are closed below. */
+      loop_ = {};
+    }
+    wakeup_.notify_one();
+    curl_multi_wakeup(multi_handle_);
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+
+    const auto aborted =
+        std::make_exception_ptr(std::runtime_error("Request was aborted"));
+    for (auto& running : running_) {
+      curl_multi_remove_handle(multi_handle_, running.first);
+      Finish(std::move(running.second), aborted);
+    }
+    for (auto& pending : pending_) {
+      Finish(std::move(pending), aborted);
+    }
+    for (auto& retrying : retrying_) {
+      Finish(std::move(retrying), aborted);
+    }
+
+    for (CURL* curl : idle_) {
+      curl_easy_cleanup(curl);
+    }
+    curl_multi_cleanup(multi_handle_);
+  }
+
+  /** Get an easy handle for a new transfer, reusing an idle one if possible.
+   * @return Easy handle with our default options set. */
+  CURL* AcquireHandle() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!idle_.empty()) {
+        CURL* curl = idle_.back();
+        idle_.pop_back();
+        return curl;
+      }
+    }
+
+    CURL* curl = curl_easy_init();
+    if (curl == NULL) {
+      throw std::runtime_error("curl_easy_init() failed");
+    }
+    setup_easy_handle(curl, curl_verbose_, share_->Get());
+    return curl;
+  }
+
+  /** Queue a fully configured transfer. */
+  void Submit(
+      /** [in] Transfer to run. */
+      std::unique_ptr<AsyncTransfer> transfer) {
+    for (AsyncTransfer* t : {transfer.get(), transfer->hedge.get()}) {
+      if (t && t->cancellation) {
+        t->subscription = t->cancellation->Subscribe([this]() { OnCancel(); });
+      }
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      pending_.push_back(std::move(transfer));
+      if (!external_ && !thread_.joinable()) {
+        thread_ = std::thread(&AsyncEngine::Run, this);
+      }
+    }
+    if (external_) {
+      /* Adding the handle arms the timer of the event loop. */
+      StartPending();
+      return;
+    }
+    wakeup_.notify_one();
+    /* https://curl.se/libcurl/c/curl_multi_wakeup.html */
+    curl_multi_wakeup(multi_handle_);
+  }
+
+  /** Fail all queued and running transfers with "Request was aborted". */
+  void AbortAll() {
+    std::deque<std::unique_ptr<AsyncTransfer>> pending;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      /* Nothing runs before the thread has started, and the flag would abort
+       * the requests that start it. */
+      abort_requested_ = thread_.joinable();
+      pending.swap(pending_);
+    }
+    wakeup_.notify_one();
+    curl_multi_wakeup(multi_handle_);
+
+    const auto aborted =
+        std::make_exception_ptr(std::runtime_error("Request was aborted"));
+    for (auto& transfer : pending) {
+      Finish(std::move(transfer), aborted);
+    }
+
+    if (external_) {
+      /* There is no background thread to do it. */
+      std::vector<
+          std::pair<std::unique_ptr<AsyncTransfer>, std::exception_ptr>>
+          finished;
+      FailRunning("Request was aborted", &finished);
+      for (auto& f : finished) {
+        Finish(std::move(f.first), f.second);
+      }
+    }
+  }
+
+  /** Let an external event loop drive the transfers instead of the background
+   * thread. */
+  void SetEventLoop(
+      /** [in] Hooks of the event loop. */
+      TransportCurl::EventLoop loop) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (thread_.joinable() || !pending_.empty() || !running_.empty()) {
+      throw std::runtime_error(
+          "SetEventLoop() must be called before the first FetchAsync()");
+    }
+    loop_ = std::move(loop);
+    external_ = true;
+    /* https://curl.se/libcurl/c/curl_multi_setopt.html */
+    curl_multi_setopt(multi_handle_, CURLMOPT_SOCKETFUNCTION, SocketCallback);
+    curl_multi_setopt(multi_handle_, CURLMOPT_SOCKETDATA, this);
+    curl_multi_setopt(multi_handle_, CURLMOPT_TIMERFUNCTION, TimerCallback);
+    curl_multi_setopt(multi_handle_, CURLMOPT_TIMERDATA, this);
+  }
+
+  /** Let cURL act on a socket that the external event loop found ready. */
+  void OnSocketEvent(
+      /** [in] The socket. */
+      curl_socket_t socket,
+      /** [in] Combination of `TransportCurl::SocketEvent`. */
+      int events) {
+    int still_running = 0;
+    /* https://curl.se/libcurl/c/curl_multi_socket_action.html */
+    curl_multi_socket_action(multi_handle_, socket, events, &still_running);
+    Drive();
+  }
+
+  /** Let cURL act on the expired timer of the external event loop. */
+  void OnTimeout() {
+    if (curl_timer_due_ &&
+        *curl_timer_due_ <= std::chrono::steady_clock::now()) {
+      /* cURL arms it again if it needs to. */
+      curl_timer_due_.reset();
+    }
+    int still_running = 0;
+    /* https://curl.se/libcurl/c/curl_multi_socket_action.html */
+    curl_multi_socket_action(multi_handle_, CURL_SOCKET_TIMEOUT, 0,
+                             &still_running);
+    Drive();
+    /* The timer may have been fired early, by a retry or a cancellation. */
+    ArmTimer();
+  }
+
+  /** @return Whether an external event loop drives the transfers. */
+  bool External() const { return external_; }
+
+  /** Set the maximum number of transfers on the multi handle at once. */
+  void SetMaxInFlight(
+      /** [in] Maximum number of running transfers. */
+      size_t max_in_flight) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      max_in_flight_ = max_in_flight;
+    }
+    if (external_) {
+      StartPending();
+      return;
+    }
+    curl_multi_wakeup(multi_handle_);
+  }
+
+ private:
+  /** Body of the background thread. */
+  void Run() {
+    std::vector<std::pair<std::unique_ptr<AsyncTransfer>, std::exception_ptr>>
+        finished;
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (!stopping_) {
+      if (running_.empty() && retrying_.empty()) {
+        /* Nothing to drive, sleep until there is. */
+        wakeup_.wait(lock, [this]() {
+          return stopping_ || abort_requested_ || !pending_.empty();
+        });
+        if (stopping_) {
+          break;
+        }
+      }
+      /* Before the queued transfers start: they came after the abort, eg.
+       * once ResetFetch() was called. The retries are of earlier ones. */
+      if (abort_requested_) {
+        abort_requested_ = false;
+        FailRunning("Request was aborted", &finished);
+      }
+      QueueDueRetries();
+      while (!pending_.empty() && running_.size() < max_in_flight_) {
+        std::unique_ptr<AsyncTransfer> transfer = std::move(pending_.front());
+        pending_.pop_front();
+        if (!setup_deadline(transfer->curl, transfer->deadline)) {
+          finished.emplace_back(std::move(transfer), DeadlineExceeded());
+          continue;
+        }
+        OnStarted(transfer.get());
+        /* https://curl.se/libcurl/c/curl_multi_add_handle.html */
+        curl_multi_add_handle(multi_handle_, transfer->curl);
+        running_.emplace(transfer->curl, std::move(transfer));
+      }
+      lock.unlock();
+
+      FailCancelled(&finished);
+
+      int still_running = 0;
+      /* https://curl.se/libcurl/c/curl_multi_perform.html */
+      CURLMcode mc = curl_multi_perform(multi_handle_, &still_running);
+
+      if (mc == CURLM_OK) {
+        CollectFinished(&finished);
+      } else {
+        FailRunning(curl_multi_strerror(mc), &finished);
+      }
+
+      for (auto& f : finished) {
+        Finish(std::move(f.first), f.second);
+      }
+      finished.clear();
+
+      if (mc == CURLM_OK && (!running_.empty() || !retrying_.empty())) {
+        /* Wait for activity, a timeout, a curl_multi_wakeup() from another
+         * thread or the next retry. Only the latter two if nothing runs.
+         * https://curl.se/libcurl/c/curl_multi_poll.html */
+        int timeout_ms = 1000;
+        if (!retrying_.empty()) {
+          timeout_ms = static_cast<int>(std::clamp<int64_t>(
+              std::chrono::duration_cast<std::chrono::milliseconds>(
+                  NextRetryDue() - std::chrono::steady_clock::now())
+                  .count(),
+              0, timeout_ms));
+        }
+        curl_multi_poll(multi_handle_, NULL, 0, timeout_ms, NULL);
+      }
+
+      lock.lock();
+    }
+  }
+
+  /** Take the transfers that cURL has completed off the multi handle. */
+  void CollectFinished(
+      /** [in,out] List of finished transfers to append to. */
+      std::vector<std::pair<std::unique_ptr<AsyncTransfer>,
+                            std::exception_ptr>>* finished) {
+    CURLMsg* msg;
+    int msgs_left;
+    /* https://curl.se/libcurl/c/curl_multi_info_read.html */
+    while ((msg = curl_multi_info_read(multi_handle_, &msgs_left))) {
+      if (msg->msg != CURLMSG_DONE) {
+        continue;
+      }
+      CURL* curl = msg->easy_handle;
+      const CURLcode result = msg->data.result;
+      curl_multi_remove_handle(multi_handle_, curl);
+
+      auto it = running_.find(curl);
+      std::unique_ptr<AsyncTransfer> transfer = std::move(it->second);
+      running_.erase(it);
+
+      std::exception_ptr error =
+          transfer->upload->Error()
+              ? transfer->upload->Error()
+              : transfer_error(transfer->receiver, result,
+                               transfer->curl_error);
+      if (error && transfer->may_retry &&
+          is_retryable(transfer->receiver, result)) {
+        const auto delay =
+            retrier_->NextRetry(transfer->attempt, transfer->deadline);
+        if (delay) {
+          ++transfer->attempt;
+          transfer->retry_at = std::chrono::steady_clock::now() + *delay;
+          ResponseReceiver receiver;
+          receiver.curl = curl;
+          receiver.sink = transfer->receiver.sink;
+          receiver.race = transfer->receiver.race;
+          receiver.leg = transfer->receiver.leg;
+          transfer->receiver = std::move(receiver);
+          transfer->curl_error[0] = '\0';
+          retrying_.push_back(std::move(transfer));
+          continue;
+        }
+      }
+      if (!error && transfer->receiver.race &&
+          !transfer->receiver.race->Claim(transfer->receiver.leg)) {
+        /* Lost the race with an empty body. */
+        error = std::make_exception_ptr(
+            std::runtime_error("Request was cancelled"));
+      }
+      if (!error && transfer->record_first_byte) {
+        curl_off_t first_byte_us = 0;
+        /* https://curl.se/libcurl/c/CURLINFO_STARTTRANSFER_TIME_T.html */
+        curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME_T, &first_byte_us);
+        hedger_->Record(std::chrono::microseconds(first_byte_us));
+      }
+      if (!error) {
+        try {
+          transfer->receiver.sink->OnEnd();
+        } catch (...) {
+          error = std::current_exception();
+        }
+      }
+      finished->emplace_back(std::move(transfer), error);
+    }
+  }
+
+  /** Report finished transfers and start queued ones, after the external
+   * event loop let cURL make progress. */
+  void Drive() {
+    std::vector<std::pair<std::unique_ptr<AsyncTransfer>, std::exception_ptr>>
+        finished;
+    CollectFinished(&finished);
+    FailCancelled(&finished);
+    for (auto& f : finished) {
+      Finish(std::move(f.first), f.second);
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      QueueDueRetries();
+    }
+    StartPending();
+  }
+
+  /** Note that a transfer has left the queue, and schedule its duplicate if
+   * it is hedged. Called on the thread that drives the transfers. */
+  void OnStarted(
+      /** [in] The transfer. */
+      AsyncTransfer* transfer) {
+    if (transfer->receiver.race) {
+      transfer->receiver.race->OnStart(transfer->receiver.leg);
+    }
+    if (transfer->hedge) {
+      transfer->hedge->retry_at =
+          std::chrono::steady_clock::now() + transfer->hedge_delay;
+      retrying_.push_back(std::move(transfer->hedge));
+    }
+  }
+
+  /** Queue the transfers whose wait for a retry is over, ahead of the new
+   * ones. Must be called with `mutex_` held. */
+  void QueueDueRetries() {
+    const auto now = std::chrono::steady_clock::now();
+    for (auto it = retrying_.begin(); it != retrying_.end();) {
+      if ((*it)->retry_at <= now) {
+        pending_.push_front(std::move(*it));
+        it = retrying_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  /** @return When the first of the transfers that wait for a retry is due.
+   * There must be at least one. */
+  std::chrono::steady_clock::time_point NextRetryDue() const {
+    auto due = retrying_.front()->retry_at;
+    for (const auto& transfer : retrying_) {
+      due = std::min(due, transfer->retry_at);
+    }
+    return due;
+  }
+
+  /** Arm the timer of the external event loop for whatever comes first, the
+   * timeout that cURL asked for or the next retry.
+   * @return false if the event loop failed. */
+  bool ArmTimer() {
+    if (!loop_.set_timer) {
+      return true;
+    }
+    std::optional<std::chrono::steady_clock::time_point> due = curl_timer_due_;
+    if (!retrying_.empty() && (!due || NextRetryDue() < *due)) {
+      due = NextRetryDue();
+    }
+    long timeout_ms = -1;
+    if (due) {
+      /* Round up, so that the timer does not fire just before it is due. */
+      timeout_ms = static_cast<long>(std::max<int64_t>(
+          0, std::chrono::ceil<std::chrono::milliseconds>(
+                 *due - std::chrono::steady_clock::now())
+                 .count()));
+    }
+    try {
+      loop_.set_timer(timeout_ms);
+    } catch (...) {
+      return false;
+    }
+    return true;
+  }
+
+  /** Move queued transfers onto the multi handle, as far as `max_in_flight_`
+   * allows. Only for the external event loop, whose hooks cURL may call from
+   * curl_multi_add_handle(), so `mutex_` is not held while adding. */
+  void StartPending() {
+    std::vector<std::unique_ptr<AsyncTransfer>> expired;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!pending_.empty() && running_.size() < max_in_flight_) {
+      std::unique_ptr<AsyncTransfer> transfer = std::move(pending_.front());
+      pending_.pop_front();
+      if (!setup_deadline(transfer->curl, transfer->deadline)) {
+        expired.push_back(std::move(transfer));
+        continue;
+      }
+      OnStarted(transfer.get());
+      CURL* curl = transfer->curl;
+      running_.emplace(curl, std::move(transfer));
+      lock.unlock();
+      /* https://curl.se/libcurl/c/curl_multi_add_handle.html */
+      curl_multi_add_handle(multi_handle_, curl);
+      lock.lock();
+    }
+    lock.unlock();
+
+    for (auto& transfer : expired) {
+      Finish(std::move(transfer), DeadlineExceeded());
+    }
+    if (!retrying_.empty()) {
+      ArmTimer();
+    }
+  }
+
+  /** @return The error of a transfer whose deadline passed in the queue. */
+  static std::exception_ptr DeadlineExceeded() {
+    return std::make_exception_ptr(std::runtime_error("Deadline exceeded"));
+  }
+
+  /** cURL socket callback, forwards the interest in a socket to the external
+   * event loop. https://curl.se/libcurl/c/CURLMOPT_SOCKETFUNCTION.html */
+  static int SocketCallback(CURL*, curl_socket_t socket, int what,
+                            void* engine_void, void*) {
+    AsyncEngine* engine = static_cast<AsyncEngine*>(engine_void);
+    if (!engine->loop_.watch_socket) {
+      return 0;
+    }
+    /* CURL_POLL_IN and CURL_POLL_OUT match kSocketRead and kSocketWrite. */
+    const int events = what == CURL_POLL_REMOVE ? 0 : what;
+    try {
+      engine->loop_.watch_socket(socket, events);
+    } catch (...) {
+      return -1;
+    }
+    return 0;
+  }
+
+  /** cURL timer callback, forwards the timeout to the external event loop.
+   * https://curl.se/libcurl/c/CURLMOPT_TIMERFUNCTION.html */
+  static int TimerCallback(CURLM*, long timeout_ms, void* engine_void) {
+    AsyncEngine* engine = static_cast<AsyncEngine*>(engine_void);
+    if (timeout_ms < 0) {
+      engine->curl_timer_due_.reset();
+    } else {
+      engine->curl_timer_due_ = std::chrono::steady_clock::now() +
+                                std::chrono::milliseconds(timeout_ms);
+    }
+    return engine->ArmTimer() ? 0 : -1;
+  }
+
+  /** Subscriber of the cancellation tokens of the transfers. It may run on
+   * any thread, so it only flags the cancellation and has the transfers looked
+   * at on the thread that drives them. */
+  void OnCancel() {
+    cancel_requested_ = true;
+    if (external_) {
+      /* Cancelled from the loop's thread, see TransportCurl::FetchAsync(). */
+      if (loop_.set_timer) {
+        loop_.set_timer(0);
+      }
+      return;
+    }
+    curl_multi_wakeup(multi_handle_);
+  }
+
+  /** Take the transfers whose token has been cancelled off the multi handle
+   * and the queue, and mark them as failed. */
+  void FailCancelled(
+      /** [in,out] List of finished transfers to append to. */
+      std::vector<std::pair<std::unique_ptr<AsyncTransfer>,
+                            std::exception_ptr>>* finished) {
+    if (!cancel_requested_.exchange(false)) {
+      return;
+    }
+    const auto cancelled =
+        std::make_exception_ptr(std::runtime_error("Request was cancelled"));
+    auto is_cancelled = [](const std::unique_ptr<AsyncTransfer>& transfer) {
+      return transfer->cancellation && transfer->cancellation->IsCancelled();
+    };
+
+    for (auto it = running_.begin(); it != running_.end();) {
+      if (is_cancelled(it->second)) {
+        curl_multi_remove_handle(multi_handle_, it->first);
+        finished->emplace_back(std::move(it->second), cancelled);
+        it = running_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    for (auto it = retrying_.begin(); it != retrying_.end();) {
+      if (is_cancelled(*it)) {
+        finished->emplace_back(std::move(*it), cancelled);
+        it = retrying_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = pending_.begin(); it != pending_.end();) {
+      if (is_cancelled(*it)) {
+        finished->emplace_back(std::move(*it), cancelled);
+        it = pending_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  /** Remove all running transfers from the multi handle and mark them, and
+   * the ones that wait for a retry, as failed. */
+  void FailRunning(
+      /** [in] Error message for the failed transfers. */
+      const std::string& error,
+      /** [in,out] List of finished transfers to append to. */
+      std::vector<std::pair<std::unique_ptr<AsyncTransfer>,
+                            std::exception_ptr>>* finished) {
+    const auto e = std::make_exception_ptr(std::runtime_error(error));
+    for (auto& running : running_) {
+      curl_multi_remove_handle(multi_handle_, running.first);
+      finished->emplace_back(std::move(running.second), e);
+    }
+    running_.clear();
+    for (auto& retrying : retrying_) {
+      finished->emplace_back(std::move(retrying), e);
+    }
+    retrying_.clear();
+  }
+
+  /** Recycle the easy handle of a finished transfer and report the outcome to
+   * its owner. Must be called without holding `mutex_`. */
+  void Finish(
+      /** [in] The finished transfer. */
+      std::unique_ptr<AsyncTransfer> transfer,
+      /** [in] Null on success, otherwise the error. */
+      std::exception_ptr error) {
+    /* Reset the easy to default settings, so we can safely reuse the
+     * handle */
+    curl_easy_reset(transfer->curl);
+    setup_easy_handle(transfer->curl, curl_verbose_, share_->Get());
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      idle_.push_back(transfer->curl);
+    }
+
+    if (transfer->cancellation) {
+      transfer->cancellation->Unsubscribe(transfer->subscription);
+    }
+
+    FetchCallback on_done = std::move(transfer->on_done);
+    /* A duplicate that was never scheduled shares the fate of the original. */
+    std::unique_ptr<AsyncTransfer> hedge = std::move(transfer->hedge);
+    transfer.reset();
+    on_done(error);
+    if (hedge) {
+      Finish(std::move(hedge), error);
+    }
+  }
+
+  /** Flag for enabling CURL verbose mode on new easy handles. */
+  const bool curl_verbose_;
+
+  /** Share object of the easy handles, outlives them. */
+  const std::shared_ptr<Share> share_;
+
+  /** Retry policy of the transport. */
+  const std::shared_ptr<Retrier> retrier_;
+
+  /** Hedge policy of the transport. */
+  const std::shared_ptr<Hedger> hedger_;
+
+  /** cURL multi handle, only touched by the background thread (and by the
+   * destructor, after the thread is gone). */
+  CURLM* multi_handle_;
+
+  /** Protects all members below, except `running_`. */
+  std::mutex mutex_;
+
+  /** Wakes up the background thread while it has nothing to drive. */
+  std::condition_variable wakeup_;
+
+  /** The background thread. */
+  std::thread thread_;
+
+  /** Set when the engine is being destroyed. */
+  bool stopping_ = false;
+
+  /** Set by `AbortAll()` to have the running transfers failed. */
+  bool abort_requested_ = false;
+
+  /** Set when the token of a transfer may have been cancelled. */
+  std::atomic<bool> cancel_requested_{false};
+
+  /** Maximum number of running transfers. */
+  size_t max_in_flight_ = 64;
+
+  /** Set when an external event loop drives the transfers. */
+  bool external_ = false;
+
+  /** Hooks of the external event loop. */
+  TransportCurl::EventLoop loop_;
+
+  /** Transfers waiting for a free slot on the multi handle. */
+  std::deque<std::unique_ptr<AsyncTransfer>> pending_;
+
+  /** Easy handles that are ready to be reused. */
+  std::vector<CURL*> idle_;
+
+  /** Transfers on the multi handle, owned by the background thread. */
+  std::unordered_map<CURL*, std::unique_ptr<AsyncTransfer>> running_;
+
+  /** Transfers that wait for a retry, owned by the background thread. */
+  std::vector<std::unique_ptr<AsyncTransfer>> retrying_;
+
+  /** When the timeout that cURL asked the external event loop for is due. */
+  std::optional<std::chrono::steady_clock::time_point> curl_timer_due_;
+};
+
+void TransportCurl::InitCurl() {
+  global_init_result_ = curl_global_init(CURL_GLOBAL_ALL);
+  if (global_init_result_ != CURLE_OK || curl_global_injected_failure) {
+    throw std::runtime_error("curl_global_init() failed");
+  }
+
+  /* Create a cURL easy handle for UrlEncode()
+   * https://curl.se/libcurl/c/curl_easy_init.html */
+  curl_ = curl_easy_init();
+
+  if (curl_ == NULL) {
+    throw std::runtime_error("curl_easy_init() failed");
+  }
+
+  /* Copies share the share object and the handle pool of the original, so
+   * that their first request can reuse its DNS cache, TLS sessions and open
+   * connections. */
+  if (!share_) {
+    share_ = std::make_shared<Share>();
+    pool_ = std::make_shared<HandlePool>(curl_verbose_, share_);
+    retrier_ = std::make_shared<Retrier>();
+    hedger_ = std::make_shared<Hedger>();
+  }
+  async_ = std::make_unique<AsyncEngine>(curl_verbose_, share_, retrier_,
+                                         hedger_);
 }
 
 TransportCurl::TransportCurl(bool curlVerbose)
@@ -116,17 +1848,27 @@ TransportCurl::TransportCurl(bool curlVerbose)
 }
 
 TransportCurl::TransportCurl(const TransportCurl& other)
-    : keep_perform_running_(true), curl_verbose_(other.curl_verbose_) {
+    : share_(other.share_),
+      pool_(other.pool_),
+      retrier_(other.retrier_),
+      hedger_(other.hedger_),
+      unix_socket_path_(other.unix_socket_path_),
+      keep_perform_running_(true),
+      curl_verbose_(other.curl_verbose_) {
   InitCurl();
 }
 
 TransportCurl::TransportCurl(TransportCurl&& other) noexcept
-    : keep_perform_running_(true),
+    : unix_socket_path_(std::move(other.unix_socket_path_)),
+      keep_perform_running_(true),
       global_init_result_(other.global_init_result_),
       curl_verbose_(other.curl_verbose_) {
-  multi_handle_ = other.multi_handle_;
   curl_ = other.curl_;
-  other.multi_handle_ = nullptr;
+  share_ = std::move(other.share_);
+  pool_ = std::move(other.pool_);
+  retrier_ = std::move(other.retrier_);
+  hedger_ = std::move(other.hedger_);
+  async_ = std::move(other.async_);
   other.curl_ = nullptr;
 }
 
@@ -136,6 +1878,11 @@ TransportCurl& TransportCurl::operator=(const TransportCurl& other) {
   }
   keep_perform_running_ = true;
   curl_verbose_ = other.curl_verbose_;
+  unix_socket_path_ = other.unix_socket_path_;
+  share_ = other.share_;
+  pool_ = other.pool_;
+  retrier_ = other.retrier_;
+  hedger_ = other.hedger_;
   InitCurl();
   return *this;
 }
@@ -147,9 +1894,13 @@ TransportCurl& TransportCurl::operator=(TransportCurl&& other) noexcept {
   keep_perform_running_ = true;
   global_init_result_ = other.global_init_result_;
   curl_verbose_ = other.curl_verbose_;
-  multi_handle_ = other.multi_handle_;
+  unix_socket_path_ = std::move(other.unix_socket_path_);
   curl_ = other.curl_;
-  other.multi_handle_ = nullptr;
+  share_ = std::move(other.share_);
+  pool_ = std::move(other.pool_);
+  retrier_ = std::move(other.retrier_);
+  hedger_ = std::move(other.hedger_);
+  async_ = std::move(other.async_);
   other.curl_ = nullptr;
   return *this;
 }
@@ -159,10 +1910,14 @@ std::unique_ptr<Transport> TransportCurl::Clone() const {
 }
 
 TransportCurl::~TransportCurl() {
-  if (multi_handle_ && curl_) {
-    curl_multi_remove_handle(multi_handle_, curl_);  // Remove easy handle
-    curl_easy_cleanup(curl_);           // Clean up all easy handles
-    curl_multi_cleanup(multi_handle_);  // Finally remove the multi handle
+  /* Finish the asynchronous transfers while cURL is still initialized. The
+   * share object is released last, by whoever uses it last. */
+  async_.reset();
+  pool_.reset();
+  share_.reset();
+
+  if (curl_) {
+    curl_easy_cleanup(curl_);
     curl_global_cleanup();
   }
 }
@@ -170,48 +1925,50 @@ TransportCurl::~TransportCurl() {
 void TransportCurl::Fetch(const std::string& url,
                           const std::vector<FileUpload>& files,
                           std::iostream* response) {
-  /* https://curl.se/libcurl/c/CURLOPT_POST.html */
-  curl_easy_setopt(curl_, CURLOPT_POST, 1L);
-
-  multipart_ = curl_mime_init(curl_);
+  StreamSink sink(response);
+  Fetch(url, files, &sink, {});
+}
 
-  if (multipart_) {
-    for (size_t i = 0; i < files.size(); ++i) {
-      const FileUpload& file = files[i];
-      const std::string name("file" + std::to_string(i));
-      static const char* content_type = "application/octet-stream";
-      curl_mimepart* part;
+void TransportCurl::Fetch(const std::string& url,
+                          const std::vector<FileUpload>& files,
+                          ResponseSink* sink, const FetchOptions& options) {
+  if (options.cancellation && options.cancellation->IsCancelled()) {
+    throw std::runtime_error("Request was cancelled");
+  }
+  if (options.deadline &&
+      std::chrono::steady_clock::now() >= *options.deadline) {
+    throw std::runtime_error("Deadline exceeded");
+  }
 
-      switch (file.type) {
-        case FileUpload::Type::kFileContents:
-          /* Add a part.
-           * https://curl.se/libcurl/c/curl_mime_addpart.html */
-          part = curl_mime_addpart(multipart_);
-          curl_mime_name(part, name.c_str());
-          /* Memory source: */
-          curl_mime_data(part, file.data.c_str(), file.data.length());
-          curl_mime_filename(part, file.path.c_str());
-          curl_mime_type(part, content_type);
-          break;
-        case FileUpload::Type::kFileName:
-          /* Add a part.
-           * https://curl.se/libcurl/c/curl_mime_addpart.html */
-          part = curl_mime_addpart(multipart_);
-          curl_mime_name(part, name.c_str());
-          /* File source: */
-          curl_mime_filedata(part, file.data.c_str());
-          // Override filename (instead of using the remote file name)
-          curl_mime_filename(part, file.path.c_str());
-          curl_mime_type(part, content_type);
-          break;
+  if (options.idempotent && files.empty() && hedger_->Enabled() &&
+      !async_->External()) {
+    /* Hedging needs two easy handles for one fetch, which the engine of the
+     * asynchronous transfers can drive. */
+    std::promise<void> done;
+    FetchAsync(url, files, sink, options, [&done](std::exception_ptr error) {
+      if (error) {
+        done.set_exception(error);
+      } else {
+        done.set_value();
       }
-    }
-
-    /* Set the form info
-     * https://curl.se/libcurl/c/CURLOPT_MIMEPOST.html */
-    curl_easy_setopt(curl_, CURLOPT_MIMEPOST, multipart_);
+    });
+    done.get_future().get();
+    return;
   }
 
+  /* Map the files before taking a handle, the mappings (and the mime
+   * structure) are released after the transfer. */
+  MultipartUpload upload(files);
+
+  /* Check out a handle of our own, so that concurrent calls from other threads
+   * don't get in the way. */
+  PooledHandle handle = pool_->Acquire();
+  auto release = [this](PooledHandle* h) { pool_->Release(*h); };
+  std::unique_ptr<PooledHandle, decltype(release)> lease(&handle, release);
+  CURL* curl = handle.curl;
+
+  upload.Attach(curl, files);
+
   curl_slist* headers = NULL;
   /* https://curl.se/libcurl/c/curl_slist_append.html */
   headers = curl_slist_append(headers, "Expect:");
@@ -224,19 +1981,213 @@ void TransportCurl::Fetch(const std::string& url,
       });
 
   /* https://curl.se/libcurl/c/CURLOPT_HTTPHEADER.html */
-  curl_easy_setopt(curl_, CURLOPT_HTTPHEADER, headers);
+  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+  setup_unix_socket(curl, unix_socket_path_);
+  if (!setup_deadline(curl, options.deadline)) {
+    throw std::runtime_error("Deadline exceeded");
+  }
+
+#ifndef NDEBUG
+  if (!replace_body.empty()) {
+    sink->OnBegin(static_cast<int64_t>(replace_body.size()));
+    sink->OnData(replace_body.data(), replace_body.size());
+    sink->OnEnd();
+    return;
+  }
+#endif /* NDEBUG */
+
+  /* Cancelling the token interrupts curl_multi_poll() right away.
+   * https://curl.se/libcurl/c/curl_multi_wakeup.html */
+  CancellationSubscription subscription(
+      options.cancellation.get(),
+      [multi_handle = handle.multi_handle]() {
+        curl_multi_wakeup(multi_handle);
+      });
+
+  const bool may_retry = options.idempotent && upload.Replayable();
+  if (may_retry) {
+    retrier_->OnFetch();
+  }
+
+  for (int attempt = 1;; ++attempt) {
+    bool retryable = false;
+    std::optional<std::chrono::milliseconds> delay;
+    try {
+      Perform(curl, handle.multi_handle, url, sink,
+              options.cancellation.get(), &retryable);
+      return;
+    } catch (...) {
+      /* A failing reader is the cause, not the aborted transfer. */
+      if (upload.Error()) {
+        std::rethrow_exception(upload.Error());
+      }
+      if (may_retry && retryable) {
+        delay = retrier_->NextRetry(attempt, options.deadline);
+      }
+      if (!delay) {
+        throw;
+      }
+    }
+    wait_for_retry(handle.multi_handle, *delay, options.cancellation.get(),
+                   keep_perform_running_);
+    if (!setup_deadline(curl, options.deadline)) {
+      throw std::runtime_error("Deadline exceeded");
+    }
+  }
+}
+
+void TransportCurl::FetchAsync(const std::string& url,
+                               const std::vector<FileUpload>& files,
+                               std::iostream* response, FetchCallback on_done) {
+  /* The sink lives as long as the completion callback. */
+  auto sink = std::make_shared<StreamSink>(response);
+  FetchAsync(url, files, sink.get(), {},
+             [sink, on_done = std::move(on_done)](std::exception_ptr error) {
+               on_done(error);
+             });
+}
+
+void TransportCurl::FetchAsync(const std::string& url,
+                               const std::vector<FileUpload>& files,
+                               ResponseSink* sink, const FetchOptions& options,
+                               FetchCallback on_done) {
+  if (!keep_perform_running_) {
+    on_done(std::make_exception_ptr(std::runtime_error("Request was aborted")));
+    return;
+  }
+  if (options.cancellation && options.cancellation->IsCancelled()) {
+    on_done(
+        std::make_exception_ptr(std::runtime_error("Request was cancelled")));
+    return;
+  }
+  if (options.deadline &&
+      std::chrono::steady_clock::now() >= *options.deadline) {
+    on_done(std::make_exception_ptr(std::runtime_error("Deadline exceeded")));
+    return;
+  }
 
 #ifndef NDEBUG
   if (!replace_body.empty()) {
-    *response << replace_body;
+    std::exception_ptr error;
+    try {
+      sink->OnBegin(static_cast<int64_t>(replace_body.size()));
+      sink->OnData(replace_body.data(), replace_body.size());
+      sink->OnEnd();
+    } catch (...) {
+      error = std::current_exception();
+    }
+    on_done(error);
     return;
   }
 #endif /* NDEBUG */
 
-  Perform(url, response);
+  auto make_transfer = [&](const std::string& transfer_url,
+                           const std::string& unix_socket_path) {
+    auto transfer = std::make_unique<AsyncTransfer>();
+    transfer->upload = std::make_unique<MultipartUpload>(files);
+    transfer->curl = async_->AcquireHandle();
+    transfer->receiver.curl = transfer->curl;
+    transfer->receiver.sink = sink;
+    transfer->deadline = options.deadline;
+
+    transfer->upload->Attach(transfer->curl, files);
+
+    /* https://curl.se/libcurl/c/curl_slist_append.html */
+    transfer->headers = curl_slist_append(NULL, "Expect:");
+    /* https://curl.se/libcurl/c/CURLOPT_HTTPHEADER.html */
+    curl_easy_setopt(transfer->curl, CURLOPT_HTTPHEADER, transfer->headers);
+    setup_unix_socket(transfer->curl, unix_socket_path);
+
+    /* https://curl.se/libcurl/c/CURLOPT_URL.html */
+    curl_easy_setopt(transfer->curl, CURLOPT_URL, transfer_url.c_str());
+    /* https://curl.se/libcurl/c/CURLOPT_WRITEFUNCTION.html */
+    curl_easy_setopt(transfer->curl, CURLOPT_WRITEFUNCTION, curl_cb_sink);
+    /* https://curl.se/libcurl/c/CURLOPT_WRITEDATA.html */
+    curl_easy_setopt(transfer->curl, CURLOPT_WRITEDATA, &transfer->receiver);
+    /* https://curl.se/libcurl/c/CURLOPT_ERRORBUFFER.html */
+    curl_easy_setopt(transfer->curl, CURLOPT_ERRORBUFFER,
+                     transfer->curl_error);
+    return transfer;
+  };
+
+  std::unique_ptr<AsyncTransfer> transfer;
+  try {
+    transfer = make_transfer(url, unix_socket_path_);
+  } catch (...) {
+    on_done(std::current_exception());
+    return;
+  }
+  transfer->on_done = std::move(on_done);
+  transfer->cancellation = options.cancellation;
+  transfer->may_retry = options.idempotent && transfer->upload->Replayable();
+  if (transfer->may_retry) {
+    retrier_->OnFetch();
+  }
+
+  std::string hedge_endpoint;
+  std::optional<std::chrono::milliseconds> hedge_delay;
+  if (options.idempotent && files.empty()) {
+    hedge_delay = hedger_->Delay(&hedge_endpoint);
+  }
+  if (hedge_delay) {
+    transfer->record_first_byte = true;
+    try {
+      transfer->hedge =
+          make_transfer(replace_endpoint(url, hedge_endpoint),
+                        hedge_endpoint.empty() ? unix_socket_path_ : "");
+    } catch (...) {
+      /* Go without the duplicate. */
+    }
+  }
+  if (transfer->hedge) {
+    AsyncTransfer* legs[] = {transfer.get(), transfer->hedge.get()};
+    auto race = std::make_shared<HedgeRace>(std::move(transfer->on_done),
+                                            options.cancellation);
+    for (int leg = 0; leg < 2; ++leg) {
+      legs[leg]->receiver.race = race.get();
+      legs[leg]->receiver.leg = leg;
+      legs[leg]->cancellation = race->LegToken(leg);
+      legs[leg]->on_done = [race, leg](std::exception_ptr error) {
+        race->OnDone(leg, error);
+      };
+    }
+    transfer->hedge->record_first_byte = true;
+    transfer->hedge_delay = *hedge_delay;
+  }
+
+  async_->Submit(std::move(transfer));
+}
+
+void TransportCurl::SetUnixSocketPath(const std::string& path) {
+  unix_socket_path_ = path;
+}
+
+void TransportCurl::SetEventLoop(EventLoop loop) {
+  async_->SetEventLoop(std::move(loop));
+}
+
+void TransportCurl::OnSocketEvent(curl_socket_t socket, int events) {
+  async_->OnSocketEvent(socket, events);
 }
 
-void TransportCurl::StopFetch() { keep_perform_running_ = false; }
+void TransportCurl::OnTimeout() { async_->OnTimeout(); }
+
+void TransportCurl::SetRetryPolicy(const RetryPolicy& policy) {
+  retrier_->SetPolicy(policy);
+}
+
+void TransportCurl::SetHedgePolicy(const HedgePolicy& policy) {
+  hedger_->SetPolicy(policy);
+}
+
+void TransportCurl::SetMaxConcurrentFetches(size_t max_fetches) {
+  async_->SetMaxInFlight(max_fetches > 0 ? max_fetches : 1);
+}
+
+void TransportCurl::StopFetch() {
+  keep_perform_running_ = false;
+  async_->AbortAll();
+}
 
 void TransportCurl::ResetFetch() { keep_perform_running_ = true; }
 
@@ -251,47 +2202,60 @@ void TransportCurl::UrlEncode(const std::string& raw, std::string* encoded) {
   encoded->assign(encoded_c);
 }
 
-void TransportCurl::Perform(const std::string& url, std::iostream* response) {
+void TransportCurl::Perform(CURL* curl, CURLM* multi_handle,
+                            const std::string& url, ResponseSink* sink,
+                            CancellationToken* cancellation, bool* retryable) {
   int still_running = 0; /* keep number of running handles */
   CURLMsg* msg;          /* for picking up messages with the transfer status */
   int msgs_left;         /* how many messages are left */
   char curl_error[CURL_ERROR_SIZE]; /* cURL error message buffer */
   std::string generic_error;
-  std::vector<std::string> get_info_errors;
-  std::vector<std::string> status_code_errors;
+  std::exception_ptr error;
+  ResponseReceiver receiver;
+  bool cancelled = false;
+
+  receiver.curl = curl;
+  receiver.sink = sink;
 
   /* https://curl.se/libcurl/c/CURLOPT_URL.html */
-  curl_easy_setopt(curl_, CURLOPT_URL, url.c_str());
+  curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
 
   /* https://curl.se/libcurl/c/CURLOPT_WRITEFUNCTION.html */
-  curl_easy_setopt(curl_, CURLOPT_WRITEFUNCTION, curl_cb_stream);
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, curl_cb_sink);
 
   /* https://curl.se/libcurl/c/CURLOPT_WRITEDATA.html */
-  curl_easy_setopt(curl_, CURLOPT_WRITEDATA, response);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &receiver);
 
   /* https://curl.se/libcurl/c/CURLOPT_ERRORBUFFER.html */
-  curl_easy_setopt(curl_, CURLOPT_ERRORBUFFER, curl_error);
+  curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, curl_error);
 
   /* End of string (empty string) */
   curl_error[0] = '\0';
 
   /* Add easy handle to multi stack.
    * https://curl.se/libcurl/c/curl_multi_add_handle.html */
-  curl_multi_add_handle(multi_handle_, curl_);
+  curl_multi_add_handle(multi_handle, curl);
+
+  *retryable = false;
 
   do {
     /* https://curl.se/libcurl/c/curl_multi_perform.html */
-    CURLMcode mc = curl_multi_perform(multi_handle_, &still_running);
+    CURLMcode mc = curl_multi_perform(multi_handle, &still_running);
 
     /* Allow to break/stop the perform task at any given moment.
      * Very useful if you want to stop this call when running inside a thread.
      */
     if (!keep_perform_running_) break;
 
+    if (still_running && cancellation && cancellation->IsCancelled()) {
+      cancelled = true;
+      break;
+    }
+
     if (!mc && still_running)
       /* wait for activity, timeout or "nothing"
        * https://curl.se/libcurl/c/curl_multi_poll.html */
-      mc = curl_multi_poll(multi_handle_, NULL, 0, 40, NULL);
+      mc = curl_multi_poll(multi_handle, NULL, 0, 40, NULL);
 
     if (mc) {
       generic_error = std::string(curl_multi_strerror(mc));
@@ -300,55 +2264,30 @@ void TransportCurl::Perform(const std::string& url, std::iostream* response) {
 
   } while (still_running);
 
-  /* Check for HTTP status code, only if there are no generic errors and the
-   * atomic bool is still true */
-  if (generic_error.empty() && keep_perform_running_) {
-    /* Future-proof - by looping over each easy handle; altough we only use one
-     * handle for now. https://curl.se/libcurl/c/curl_multi_info_read.html */
-    while ((msg = curl_multi_info_read(multi_handle_, &msgs_left))) {
+  /* Check the outcome, only if there are no generic errors, the transfer was
+   * not cancelled and the atomic bool is still true */
+  if (generic_error.empty() && !cancelled && keep_perform_running_) {
+    /* https://curl.se/libcurl/c/curl_multi_info_read.html */
+    while ((msg = curl_multi_info_read(multi_handle, &msgs_left))) {
       if (msg->msg == CURLMSG_DONE) {
-        long status_code;
-
-        /* https://curl.se/libcurl/c/curl_easy_getinfo.html */
-        CURLcode res = curl_easy_getinfo(msg->easy_handle,
-                                         CURLINFO_RESPONSE_CODE, &status_code);
-        if (res != CURLE_OK || perform_injected_failure) {
-          get_info_errors.push_back(
-              "Can't get the HTTP status code from CURL: " +
-              std::string(curl_easy_strerror(res)));
-        }
-        if (!status_is_success(status_code)) {
-          std::streambuf* b = response->rdbuf();
-          status_code_errors.push_back(
-              "HTTP request failed with status code " +
-              std::to_string(status_code) + ". Response body:\n" +
-              /* Read the whole body back from the stream where we wrote it and
-               * append it to this error message string. Usually the bodies of
-               * HTTP error responses represent a short HTML or JSON that
-               * describes the error. */
-              static_cast<const std::stringstream&>(std::stringstream() << b)
-                  .str());
-        }
+        error = transfer_error(receiver, msg->data.result, curl_error,
+                               perform_injected_failure);
+        *retryable = error && is_retryable(receiver, msg->data.result);
       }
     }
   }
 
   /* Always execute the curl_multi_remove_handle()!
    * https://curl.se/libcurl/c/curl_multi_remove_handle.html */
-  curl_multi_remove_handle(multi_handle_, curl_);
+  curl_multi_remove_handle(multi_handle, curl);
 
   /*
    * Note: We re-use easy curl handle and multiple handle, so we don't clean it
-   * up here.
+   * up here. The caller returns them to the pool.
    */
 
-  /* Reset the easy to default settings, so we can safely reuse the handle */
-  curl_easy_reset(curl_);
-
-  /* If post multi part mime structure was used, free it.
-    https://curl.se/libcurl/c/curl_mime_free.html */
-  if (multipart_) {
-    curl_mime_free(multipart_);
+  if (cancelled) {
+    throw std::runtime_error("Request was cancelled");
   }
 
   /* If there were errors, throw them now (if atomic bool is still true) */
@@ -357,15 +2296,10 @@ void TransportCurl::Perform(const std::string& url, std::iostream* response) {
       throw std::runtime_error(
           generic_error +
           (curl_error[0] != '\0' ? std::string(": ") + curl_error : ""));
-    } else {
-      // For now we just throw the first error we see
-      for (const auto& error : get_info_errors) {
-        throw std::runtime_error(error);
-      }
-      for (const auto& error : status_code_errors) {
-        throw std::runtime_error(error);
-      }
+    } else if (error) {
+      std::rethrow_exception(error);
     }
+    sink->OnEnd();
   } else {
     /* Throw runtime error if the request was aborted (atomic bool is false)
      * This is useful for the client-side in order to
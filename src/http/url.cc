@@ -0,0 +1,50 @@
+/* Copyright (c) 2016-2023, The C++ IPFS client library developers
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#include "url.h"
+
+#include <string>
+
+namespace ipfs {
+
+namespace http {
+
+/** @return Offset of the path of a URL, `std::string::npos` if it has none. */
+static size_t path_of(
+    /** [in] URL, eg. "http://localhost:5001/api/v0/cat?arg=...". */
+    const std::string& url) {
+  const size_t scheme = url.find("://");
+  return url.find('/', scheme == std::string::npos ? 0 : scheme + 3);
+}
+
+std::string endpoint_of(const std::string& url) {
+  return url.substr(0, path_of(url));
+}
+
+std::string replace_endpoint(const std::string& url,
+                             const std::string& endpoint) {
+  if (endpoint.empty()) {
+    return url;
+  }
+  const size_t path = path_of(url);
+  return endpoint + (path == std::string::npos ? "" : url.substr(path));
+}
+
+} /* namespace http */
+} /* namespace ipfs */
@@ -0,0 +1,48 @@
+/* Copyright (c) 2016-2023, The C++ IPFS client library developers
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+/* Helpers for the URLs of the requests, shared by the transports. Internal to
+ * the library, not installed. */
+
+#ifndef IPFS_HTTP_URL_H
+#define IPFS_HTTP_URL_H
+
+#include <string>
+
+namespace ipfs {
+
+namespace http {
+
+/** @return Scheme, host and port of a URL. */
+std::string endpoint_of(
+    /** [in] URL, eg. "http://localhost:5001/api/v0/cat?arg=...". */
+    const std::string& url);
+
+/** @return `url` with its scheme, host and port replaced by `endpoint`, or
+ * `url` itself if `endpoint` is empty. */
+std::string replace_endpoint(
+    /** [in] URL, eg. "http://localhost:5001/api/v0/cat?arg=...". */
+    const std::string& url,
+    /** [in] New endpoint, eg. "http://10.0.0.2:5001". */
+    const std::string& endpoint);
+
+} /* namespace http */
+} /* namespace ipfs */
+
+#endif /* IPFS_HTTP_URL_H */
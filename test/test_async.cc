@@ -0,0 +1,139 @@
+/* Copyright (c) 2016-2023, The C++ IPFS client library developers
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#include <ipfs/async.h>
+#include <ipfs/client.h>
+#include <ipfs/test/utils.h>
+
+#include <atomic>
+#include <future>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/** [ipfs::Task] */
+/* Store a block, read it back and pin it, one step after the other, without
+ * blocking any thread while the requests are in flight. */
+ipfs::Task<std::string> StoreAndPin(ipfs::Client& client,
+                                    const std::string& contents) {
+  const ipfs::http::FileUpload upload{
+      "", ipfs::http::FileUpload::Type::kFileContents, contents};
+  ipfs::Json stat;
+  co_await client.BlockPutAsync(upload, &stat);
+
+  std::stringstream block;
+  co_await client.BlockGetAsync(stat["Key"], &block);
+  if (block.str() != contents) {
+    throw std::runtime_error("Unexpected contents of block " +
+                             stat["Key"].get<std::string>());
+  }
+
+  co_await client.PinAddAsync(stat["Key"]);
+  co_return stat["Key"].get<std::string>();
+}
+/** [ipfs::Task] */
+
+int main(int, char**) {
+  try {
+    ipfs::Client client("localhost", 5001);
+
+    const size_t n = 32;
+
+    /* Store a few blocks, all at once. */
+    std::vector<ipfs::Json> stats(n);
+    std::vector<std::future<void>> puts;
+    for (size_t i = 0; i < n; ++i) {
+      puts.push_back(client.BlockPutAsync(
+          {"", ipfs::http::FileUpload::Type::kFileContents,
+           "Async block " + std::to_string(i)},
+          &stats[i]));
+    }
+    for (auto& put : puts) {
+      put.get();
+    }
+
+    /** [ipfs::Client::BlockGetAsync] */
+    /* Keep all the requests in flight at the same time and wait for them
+     * afterwards. */
+    std::vector<std::stringstream> blocks(n);
+    std::vector<std::future<void>> gets;
+    for (size_t i = 0; i < n; ++i) {
+      gets.push_back(client.BlockGetAsync(stats[i]["Key"], &blocks[i]));
+    }
+    for (auto& get : gets) {
+      /* Throws if the request failed. */
+      get.get();
+    }
+    /** [ipfs::Client::BlockGetAsync] */
+
+    for (size_t i = 0; i < n; ++i) {
+      if (blocks[i].str() != "Async block " + std::to_string(i)) {
+        throw std::runtime_error("Unexpected contents of block " +
+                                 std::to_string(i) + ": " + blocks[i].str());
+      }
+    }
+
+    /* Run many chains at once, the transport's thread resumes each of them
+     * when its current request has finished. */
+    std::vector<std::future<std::string>> chains;
+    for (size_t i = 0; i < n; ++i) {
+      chains.push_back(
+          StoreAndPin(client, "Coroutine block " + std::to_string(i)).Start());
+    }
+    for (auto& chain : chains) {
+      std::cout << "Stored and pinned: " << chain.get() << std::endl;
+    }
+
+    /** [ipfs::Client::IdAsync] */
+    ipfs::Json id;
+    std::atomic<bool> called{false};
+    client
+        .IdAsync(&id,
+                 [&called](std::exception_ptr error) {
+                   /* Runs on the transport's thread, keep it short. */
+                   called = error == nullptr;
+                 })
+        .wait();
+    /** [ipfs::Client::IdAsync] */
+    if (!called) {
+      throw std::runtime_error("IdAsync() completion callback was not called");
+    }
+    ipfs::test::check_if_properties_exist("client.IdAsync()", id,
+                                          {"Addresses", "ID", "PublicKey"});
+
+    ipfs::Client client_cant_connect("localhost", 57);
+    ipfs::test::must_fail("client.VersionAsync()", [&client_cant_connect]() {
+      ipfs::Json version;
+      client_cant_connect.VersionAsync(&version).get();
+    });
+    ipfs::test::must_fail("co_await client.BlockPutAsync()",
+                          [&client_cant_connect]() {
+                            StoreAndPin(client_cant_connect, "Unreachable")
+                                .Start()
+                                .get();
+                          });
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
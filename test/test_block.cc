@@ -21,8 +21,10 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
 #include <ipfs/test/utils.h>
 
 #include <iostream>
+#include <span>
 #include <sstream>
 #include <stdexcept>
+#include <string>
 
 int main(int, char**) {
   try {
@@ -42,6 +44,20 @@ int main(int, char**) {
     ipfs::test::check_if_properties_exist("client.BlockPut()", block,
                                           {"Key", "Size"});
 
+    /** [ipfs::Client::BlockPut__memory] */
+    /* Upload a buffer of our own without copying it into a string first */
+    const std::string payload = "Block put test.";
+    ipfs::Json memory_block;
+    client.BlockPut({"", ipfs::http::FileUpload::Type::kMemory, "",
+                     std::as_bytes(std::span(payload))},
+                    &memory_block);
+    /** [ipfs::Client::BlockPut__memory] */
+    if (memory_block["Key"] != block["Key"]) {
+      throw std::runtime_error(
+          "client.BlockPut(): kMemory stored a different block than "
+          "kFileContents");
+    }
+
     /** [ipfs::Client::BlockGet] */
     std::stringstream block_contents;
     /* E.g. block["Key"] is "QmQpWo5TL9nivqvL18Bq8bS34eewAA6jcgdVsUu4tGeVHo". */
@@ -53,6 +69,30 @@ int main(int, char**) {
     */
     /** [ipfs::Client::BlockGet] */
 
+    /** [ipfs::Client::BlockGet__sink] */
+    size_t block_size = 0;
+    ipfs::http::CallbackSink count_bytes([&block_size](const char*,
+                                                       size_t size) {
+      block_size += size;
+      return true; /* false would end the transfer here */
+    });
+    client.BlockGet(block["Key"], &count_bytes);
+    std::cout << "Block size: " << block_size << std::endl;
+    /** [ipfs::Client::BlockGet__sink] */
+    if (block_size != block_contents.str().size()) {
+      throw std::runtime_error(
+          "client.BlockGet(): sink got a different size than the stream");
+    }
+
+    std::string block_string;
+    ipfs::http::StringSink to_string(&block_string);
+    client.BlockGet(block["Key"], &to_string);
+    if (block_string != block_contents.str()) {
+      throw std::runtime_error(
+          "client.BlockGet(): string sink got a different body than the "
+          "stream");
+    }
+
     /** [ipfs::Client::BlockStat] */
     ipfs::Json stat_result;
     client.BlockStat(block["Key"], &stat_result);
@@ -63,6 +103,13 @@ int main(int, char**) {
     /** [ipfs::Client::BlockStat] */
     ipfs::test::check_if_properties_exist("client.BlockStat()", stat_result,
                                           {"Key", "Size"});
+
+    ipfs::BlockStatResult stat;
+    client.BlockStat(block["Key"], &stat);
+    if (stat.cid != stat_result["Key"] || stat.size != stat_result["Size"]) {
+      throw std::runtime_error(
+          "client.BlockStat(): the struct differs from the JSON");
+    }
   } catch (const std::exception& e) {
     std::cerr << e.what() << std::endl;
     return 1;
@@ -22,6 +22,7 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
 #include <ipfs/test/base64.hpp>
 
 #include <iostream>
+#include <sstream>
 #include <stdexcept>
 
 int main(int, char**) {
@@ -73,6 +74,16 @@ int main(int, char**) {
     client.DagExport(cid, &cab);
     std::cout << cab.str() << std::endl;
 
+    /** [ipfs::Client::DagExport__sink] */
+    std::stringstream car;
+    ipfs::http::StreamSink car_sink(&car);
+    client.DagExport(cid, &car_sink);
+    /** [ipfs::Client::DagExport__sink] */
+    if (car.str() != cab.str()) {
+      throw std::runtime_error(
+          "client.DagExport(): sink got different content than the stream");
+    }
+
     std::string ncid;
     client.DagImport({"file", ipfs::http::FileUpload::Type::kFileContents, cab.str()}, true, &ncid);
     std::cout << ncid << std::endl;
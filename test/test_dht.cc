@@ -71,6 +71,35 @@ int main(int, char**) {
     */
     /** [ipfs::Client::DhtFindProvs] */
 
+    /** [ipfs::Client::DhtFindProvs__records] */
+    /* See the providers as the DHT query finds them. */
+    size_t records = 0;
+    client.DhtFindProvs(hash, [&records](const ipfs::Json& record) {
+      if (record["Type"] == 4) {
+        std::cout << "Provider: " << record["Responses"].dump() << std::endl;
+      }
+      ++records;
+    });
+    /** [ipfs::Client::DhtFindProvs__records] */
+    if (records == 0) {
+      throw std::runtime_error("client.DhtFindProvs(): no records");
+    }
+
+    /** [ipfs::Client::DhtFindProvs__first] */
+    /* Stop the query once 2 providers have turned up. */
+    ipfs::Json first_providers;
+    client.DhtFindProvs(hash, 2, &first_providers);
+    /* An example output:
+    [
+      {"Addrs": ["/ip4/212.227.249.191/tcp/4001"], "ID": "QmZSb7SYajaE..."},
+      {"Addrs": ["/ip4/1.2.3.4/tcp/4001"], "ID": "QmYoQjsZeSyzeeX..."}
+    ]
+    */
+    /** [ipfs::Client::DhtFindProvs__first] */
+    if (first_providers.size() > 2) {
+      throw std::runtime_error("client.DhtFindProvs(): too many providers");
+    }
+
     std::string peer_id;
     /* Find an actual peer. */
     for (auto& p : providers) {
@@ -20,9 +20,13 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
 #include <ipfs/client.h>
 #include <ipfs/test/utils.h>
 
+#include <algorithm>
+#include <cstdio>
 #include <iostream>
 #include <sstream>
 #include <stdexcept>
+#include <string>
+#include <vector>
 
 int main(int, char**) {
   try {
@@ -44,6 +48,61 @@ int main(int, char**) {
     ipfs::test::check_if_string_contains("client.FilesGet()", contents.str(),
                                          "Hello and Welcome to IPFS!");
 
+    /** [ipfs::Client::FilesGet__sink] */
+    std::string head;
+    ipfs::http::CallbackSink read_head([&head](const char* data, size_t size) {
+      head.append(data, size);
+      /* End the transfer once the first 16 bytes have arrived */
+      return head.size() < 16;
+    });
+    client.FilesGet(
+        "/ipfs/QmYwAPJzv5CZsnA625s3Xf2nemtYgPpHdWEz79ojWnPbdG/readme",
+        &read_head);
+    /** [ipfs::Client::FilesGet__sink] */
+    ipfs::test::check_if_string_contains("client.FilesGet()", head, "Hello");
+
+    /** [ipfs::Client::FilesGetToFd] */
+    std::FILE* file = std::tmpfile();
+    client.FilesGetToFd(
+        "/ipfs/QmYwAPJzv5CZsnA625s3Xf2nemtYgPpHdWEz79ojWnPbdG/readme",
+        fileno(file));
+    /** [ipfs::Client::FilesGetToFd] */
+    std::rewind(file);
+    std::string file_contents(contents.str().size(), '\0');
+    file_contents.resize(std::fread(file_contents.data(), 1,
+                                    file_contents.size(), file));
+    std::fclose(file);
+    if (file_contents != contents.str()) {
+      throw std::runtime_error(
+          "client.FilesGetToFd(): file differs from client.FilesGet()");
+    }
+
+    /** [ipfs::http::FdSink] */
+    std::FILE* big_file = std::tmpfile();
+    ipfs::http::FdSinkOptions options;
+    options.buffer_size = 4 << 20;
+    options.drop_cache = true;
+    ipfs::http::FdSink fd_sink(fileno(big_file), options);
+    client.FilesGet(
+        "/ipfs/QmYwAPJzv5CZsnA625s3Xf2nemtYgPpHdWEz79ojWnPbdG/readme",
+        &fd_sink);
+    std::cout << "Wrote " << fd_sink.BytesWritten() << " bytes" << std::endl;
+    /** [ipfs::http::FdSink] */
+    std::fclose(big_file);
+
+    ipfs::test::must_fail("client.FilesGetToFd()", [&client]() {
+      client.FilesGetToFd(
+          "/ipfs/QmYwAPJzv5CZsnA625s3Xf2nemtYgPpHdWEz79ojWnPbdG/readme", -1);
+    });
+
+    ipfs::test::must_fail("client.FilesGet()", [&client]() {
+      ipfs::http::CallbackSink fail([](const char*, size_t) -> bool {
+        throw std::runtime_error("sink failed");
+      });
+      client.FilesGet(
+          "/ipfs/QmYwAPJzv5CZsnA625s3Xf2nemtYgPpHdWEz79ojWnPbdG/readme", &fail);
+    });
+
     /** [ipfs::Client::FilesAdd] */
     ipfs::Json add_result;
     client.FilesAdd(
@@ -68,6 +127,72 @@ int main(int, char**) {
     ]
     */
     /** [ipfs::Client::FilesAdd] */
+
+    /** [ipfs::Client::FilesAdd__mapped] */
+    /* Upload the first 100 bytes of a file straight from a memory mapping */
+    ipfs::http::FileUpload mapped{"bar.txt",
+                                  ipfs::http::FileUpload::Type::kMappedFile,
+                                  "../compile_commands.json"};
+    mapped.size = 100;
+    ipfs::Json mapped_result;
+    client.FilesAdd({mapped}, &mapped_result);
+    /** [ipfs::Client::FilesAdd__mapped] */
+    if (mapped_result[0]["size"] < 100) {
+      throw std::runtime_error("client.FilesAdd(): mapped region got lost");
+    }
+
+    /** [ipfs::Client::FilesAdd__reader] */
+    /* Upload 1 MiB of generated data without ever holding all of it */
+    size_t left = 1 << 20;
+    ipfs::http::FileUpload generated{"generated.txt",
+                                     ipfs::http::FileUpload::Type::kReader, ""};
+    generated.reader = [&left](char* buffer, size_t max_size) {
+      const size_t n = std::min(left, max_size);
+      std::fill(buffer, buffer + n, 'x');
+      left -= n;
+      return n; /* 0 ends the upload */
+    };
+    ipfs::Json generated_result;
+    client.FilesAdd({generated}, &generated_result);
+    /** [ipfs::Client::FilesAdd__reader] */
+    std::cout << "FilesAdd() of generated data:" << std::endl
+              << generated_result.dump(2) << std::endl;
+
+    /** [ipfs::Client::FilesAdd__records] */
+    /* Follow an add of many files as it goes, without collecting the results */
+    std::vector<ipfs::http::FileUpload> many;
+    for (int i = 0; i < 100; ++i) {
+      many.push_back({"file" + std::to_string(i) + ".txt",
+                      ipfs::http::FileUpload::Type::kFileContents,
+                      "contents of file " + std::to_string(i)});
+    }
+    size_t added = 0;
+    client.FilesAdd(many, [&added](const ipfs::Json& record) {
+      if (record.contains("Hash")) {
+        ++added;
+      }
+    });
+    /** [ipfs::Client::FilesAdd__records] */
+    if (added != many.size()) {
+      throw std::runtime_error("client.FilesAdd(): records got lost");
+    }
+
+    ipfs::test::must_fail("client.FilesAdd()", [&client]() {
+      ipfs::http::FileUpload failing{"failing.txt",
+                                     ipfs::http::FileUpload::Type::kReader, ""};
+      failing.reader = [](char*, size_t) -> size_t {
+        throw std::runtime_error("Generator failed");
+      };
+      ipfs::Json result;
+      client.FilesAdd({failing}, &result);
+    });
+
+    ipfs::test::must_fail("client.FilesAdd()", [&client]() {
+      ipfs::Json result;
+      client.FilesAdd({{"missing.txt", ipfs::http::FileUpload::Type::kMappedFile,
+                        "nonexistent.txt"}},
+                      &result);
+    });
   } catch (const std::exception& e) {
     std::cerr << e.what() << std::endl;
     return 1;
@@ -18,9 +18,12 @@ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
 CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
 
 #include <ipfs/client.h>
+#include <ipfs/http/transport-curl.h>
 #include <ipfs/test/utils.h>
 
+#include <chrono>
 #include <iostream>
+#include <memory>
 #include <stdexcept>
 #include <utility>
 
@@ -37,6 +40,42 @@ int main(int, char**) {
     ipfs::Client client3("localhost", 5001, "6s", "http://", "/api/v0", true);
     /** [ipfs::Client::Client] */
 
+    /** [ipfs::Client::Client__transport] */
+    auto transport = std::make_unique<ipfs::http::TransportCurl>(false);
+    /* With a daemon that listens on a Unix domain socket, eg.
+    transport->SetUnixSocketPath("/run/ipfs/api.sock"); */
+    ipfs::Client client4(std::move(transport), "localhost", 5001);
+    /** [ipfs::Client::Client__transport] */
+    ipfs::Json version4;
+    client4.Version(&version4);
+
+    /** [ipfs::http::TransportCurl::SetRetryPolicy] */
+    auto retrying_transport =
+        std::make_unique<ipfs::http::TransportCurl>(false);
+    ipfs::http::TransportCurl::RetryPolicy policy;
+    policy.max_attempts = 4;
+    policy.initial_backoff = std::chrono::milliseconds(50);
+    retrying_transport->SetRetryPolicy(policy);
+    ipfs::Client client5(std::move(retrying_transport), "localhost", 5001);
+    /* A read like this is sent again if the daemon is briefly unavailable */
+    ipfs::Json version5;
+    client5.Version(&version5);
+    /** [ipfs::http::TransportCurl::SetRetryPolicy] */
+
+    /** [ipfs::http::TransportCurl::SetHedgePolicy] */
+    auto hedging_transport = std::make_unique<ipfs::http::TransportCurl>(false);
+    ipfs::http::TransportCurl::HedgePolicy hedge_policy;
+    /* Duplicate the reads that wait longer for their first byte than 95% of
+     * the recent ones did */
+    hedge_policy.percentile = 0.95;
+    /* A second daemon could serve the duplicates, eg.
+    hedge_policy.endpoint = "http://10.0.0.2:5001"; */
+    hedging_transport->SetHedgePolicy(hedge_policy);
+    ipfs::Client client6(std::move(hedging_transport), "localhost", 5001);
+    ipfs::Json version6;
+    client6.Version(&version6);
+    /** [ipfs::http::TransportCurl::SetHedgePolicy] */
+
     // Test copy/move of client objects
     ipfs::Client clientA(client);
     clientA = client;
@@ -20,8 +20,10 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
 #include <ipfs/client.h>
 
 #include <iostream>
+#include <memory_resource>
 #include <stdexcept>
 #include <string>
+#include <vector>
 
 int main(int, char**) {
   try {
@@ -64,6 +66,24 @@ int main(int, char**) {
     */
     /** [ipfs::Client::PinLs__a] */
 
+    /** [ipfs::ArenaScope] */
+    /* One arena for all the results of a batch of calls, freed at once. */
+    std::pmr::monotonic_buffer_resource arena;
+
+    ipfs::ArenaJson arena_pinned;
+    client.PinLs(&arena, &arena_pinned);
+
+    {
+      /* What is added within a scope comes from the arena, too. */
+      ipfs::ArenaScope scope(&arena);
+      arena_pinned["Listed"] = "by a crawler that keeps the heap calm";
+    }
+    /** [ipfs::ArenaScope] */
+    if (arena_pinned["Keys"].size() != pinned["Keys"].size()) {
+      throw std::runtime_error(
+          "client.PinLs(): the arena result differs from the Json one");
+    }
+
     /** [ipfs::Client::PinLs__b] */
     /* std::string object_id = "QmdfTbBqBPQ7VNxZEYEj14V...1zR1n" for example. */
     client.PinLs(object_id, &pinned);
@@ -82,6 +102,33 @@ int main(int, char**) {
     */
     /** [ipfs::Client::PinLs__b] */
 
+    /** [ipfs::Client::PinLs__visitor] */
+    size_t recursive = 0;
+
+    client.PinLs([&recursive](const ipfs::PinInfo& pin) {
+      if (pin.type == ipfs::PinType::kRecursive) {
+        std::cout << "Pinned recursively: " << pin.cid << std::endl;
+        ++recursive;
+      }
+      return true;
+    });
+    /* An example output:
+    Pinned recursively: QmUNLLsPACCz1vLxQVkXqqLX5R1X345qqfHbsf67hvA3Nn
+    Pinned recursively: QmdfTbBqBPQ7VNxZEYEj14VmRuZBkqFbiwReogJgS1zR1n
+    */
+    /** [ipfs::Client::PinLs__visitor] */
+
+    std::vector<ipfs::PinInfo> pins;
+    client.PinLs(&pins);
+
+    size_t found = 0;
+    for (const ipfs::PinInfo& pin : pins) {
+      found += pin.cid == object_id && pin.type == ipfs::PinType::kRecursive;
+    }
+    if (recursive == 0 || found != 1) {
+      throw std::runtime_error("The streamed list of pins lacks " + object_id);
+    }
+
     /** [ipfs::Client::PinRm] */
     /* std::string object_id = "QmdfTbBqBPQ7VNxZEYEj14V...1zR1n" for example. */
 
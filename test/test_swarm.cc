@@ -22,6 +22,7 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
 #include <iostream>
 #include <stdexcept>
 #include <string>
+#include <vector>
 
 int main(int, char**) {
   try {
@@ -131,6 +132,20 @@ int main(int, char**) {
     }
     */
     /** [ipfs::Client::SwarmPeers] */
+
+    /** [ipfs::Client::SwarmPeers__typed] */
+    std::vector<ipfs::PeerInfo> peer_list;
+
+    client.SwarmPeers(&peer_list);
+
+    for (const ipfs::PeerInfo& peer : peer_list) {
+      std::cout << peer.peer << " at " << peer.addr << ", " << peer.latency
+                << std::endl;
+    }
+    /* An example output:
+    QmaCpDMGvV2BGHeYERUEnRQAwe3N8SzbUtfsmvsqQLuvuJ at /ip4/104.131.131.82/tcp/4001, 23.4ms
+    */
+    /** [ipfs::Client::SwarmPeers__typed] */
   } catch (const std::exception& e) {
     std::cerr << e.what() << std::endl;
     return 1;
@@ -19,10 +19,13 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
 
 #include <ipfs/client.h>
 
+#include <chrono>
 #include <iostream>
+#include <memory>
 #include <sstream>
 #include <stdexcept>
 #include <thread>
+#include <vector>
 
 int main(int, char**) {
   try {
@@ -53,6 +56,111 @@ int main(int, char**) {
       /** [ipfs::Client::Abort] */
     }
 
+    {
+      /* Abort() ends what runs at the time, not the requests after Reset(). */
+      std::stringstream contents;
+      ipfs::AsyncResult hanging = client.FilesGetAsync(
+          "QmZp1rrtGTictR2rpNcx4673R7qU9Jdr9DQ6Z7F6Wgo2bQ", &contents);
+      client.Abort();
+      client.Reset();
+      ipfs::Json version;
+      client.VersionAsync(&version).get();
+      try {
+        hanging.get();
+        throw std::runtime_error("Aborted request succeeded");
+      } catch (const std::runtime_error& e) {
+        std::cerr << "Expected error: " << e.what() << std::endl;
+      }
+    }
+
+    {
+      /** [ipfs::Client::WithOptions] */
+      /* Cancel one request while another one runs on, without Reset(). */
+      auto token = std::make_shared<ipfs::http::CancellationToken>();
+      ipfs::Client cancellable = client.WithOptions({token});
+
+      std::stringstream contents;
+      /* File should not exist, takes forever (until time-out) */
+      ipfs::AsyncResult hanging = cancellable.FilesGetAsync(
+          "QmZp1rrtGTictR2rpNcx4673R7qU9Jdr9DQ6Z7F6Wgo2bQ", &contents);
+      ipfs::Json version;
+      ipfs::AsyncResult other = client.VersionAsync(&version);
+
+      token->Cancel();
+      try {
+        hanging.get();
+        throw std::runtime_error("Cancelled request succeeded");
+      } catch (const std::runtime_error& e) {
+        std::cerr << "Expected error: " << e.what() << std::endl;
+      }
+      other.get();
+      /** [ipfs::Client::WithOptions] */
+
+      /* A blocking call is woken up by the cancellation too. */
+      auto blocking_token = std::make_shared<ipfs::http::CancellationToken>();
+      std::thread thread([&client, blocking_token]() {
+        std::stringstream contents;
+        try {
+          client.WithOptions({blocking_token})
+              .FilesGet("QmZp1rrtGTictR2rpNcx4673R7qU9Jdr9DQ6Z7F6Wgo2bQ",
+                        &contents);
+        } catch (const std::runtime_error& e) {
+          std::cerr << "Expected error: " << e.what() << std::endl;
+        }
+      });
+      blocking_token->Cancel();
+      thread.join();
+    }
+
+    {
+      /** [ipfs::Client::WithOptions__deadline] */
+      ipfs::http::FetchOptions options;
+      options.deadline =
+          std::chrono::steady_clock::now() + std::chrono::milliseconds(500);
+      ipfs::Client bounded = client.WithOptions(options);
+
+      std::stringstream contents;
+      try {
+        /* File should not exist, fails once the deadline has passed */
+        bounded.FilesGet("QmZp1rrtGTictR2rpNcx4673R7qU9Jdr9DQ6Z7F6Wgo2bQ",
+                         &contents);
+        throw std::runtime_error("Request without a result met its deadline");
+      } catch (const std::runtime_error& e) {
+        std::cerr << "Expected error: " << e.what() << std::endl;
+      }
+      /** [ipfs::Client::WithOptions__deadline] */
+      if (std::chrono::steady_clock::now() >
+          *options.deadline + std::chrono::seconds(5)) {
+        throw std::runtime_error("Request ran far beyond its deadline");
+      }
+    }
+
+    /** [ipfs::Client::Client__shared] */
+    /* A single client can be used by several threads at the same time. */
+    std::vector<std::thread> threads;
+    std::vector<std::string> errors(4);
+    for (size_t i = 0; i < errors.size(); ++i) {
+      threads.emplace_back([&client, &errors, i]() {
+        try {
+          for (int j = 0; j < 10; ++j) {
+            ipfs::Json version;
+            client.Version(&version);
+          }
+        } catch (const std::exception& e) {
+          errors[i] = e.what();
+        }
+      });
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+    /** [ipfs::Client::Client__shared] */
+    for (const auto& error : errors) {
+      if (!error.empty()) {
+        throw std::runtime_error("Shared client failed: " + error);
+      }
+    }
+
     std::cout << "INFO: Done!" << std::endl;
   } catch (const std::exception& e) {
     std::cerr << e.what() << std::endl;
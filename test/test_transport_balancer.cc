@@ -0,0 +1,140 @@
+/* Copyright (c) 2016-2023, The C++ IPFS client library developers
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#include <ipfs/client.h>
+#include <ipfs/http/transport-balancer.h>
+#include <ipfs/test/utils.h>
+
+#include <cassert>
+#include <chrono>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+int main(int, char**) {
+  {
+    /** [ipfs::http::TransportBalancer] */
+    ipfs::http::BalancerOptions options;
+    options.policy = ipfs::http::BalancerOptions::Policy::kConsistentHash;
+
+    /* The host and port of the client are replaced by those of the daemon
+     * that each request goes to. */
+    ipfs::Client client(std::make_unique<ipfs::http::TransportBalancer>(
+                            std::vector<std::string>{"http://localhost:5001",
+                                                     "http://127.0.0.1:5001"},
+                            options),
+                        "localhost", 5001);
+
+    std::stringstream contents;
+    client.FilesGet(
+        "/ipfs/QmYwAPJzv5CZsnA625s3Xf2nemtYgPpHdWEz79ojWnPbdG/readme",
+        &contents);
+    /** [ipfs::http::TransportBalancer] */
+    assert(!contents.str().empty());
+  }
+  {
+    /* test that the requests fail over from a daemon that is down, and that
+     * it is taken out of rotation */
+    ipfs::http::BalancerOptions options;
+    options.failure_threshold = 1;
+    options.ejection_time = std::chrono::milliseconds(60000);
+    ipfs::http::TransportBalancer* balancer = nullptr;
+    ipfs::Client client = ipfs::test::client_with(
+        std::make_unique<ipfs::http::TransportBalancer>(
+            std::vector<std::string>{"http://127.0.0.1:1",
+                                     "http://localhost:5001"},
+            options),
+        &balancer);
+
+    for (int i = 0; i < 4; ++i) {
+      ipfs::Json version;
+      client.Version(&version);
+      assert(version.contains("Version"));
+    }
+    assert(!balancer->IsHealthy(0));
+    assert(balancer->IsHealthy(1));
+
+    /* a copy shares the health of the daemons */
+    ipfs::Client copy(client);
+    ipfs::Json version;
+    copy.Version(&version);
+    assert(version.contains("Version"));
+  }
+  {
+    /* test the other policies, asynchronous requests and a clone */
+    for (auto policy :
+         {ipfs::http::BalancerOptions::Policy::kLeastOutstanding,
+          ipfs::http::BalancerOptions::Policy::kPowerOfTwoChoices}) {
+      ipfs::http::BalancerOptions options;
+      options.policy = policy;
+      ipfs::http::TransportBalancer balancer(
+          std::vector<std::string>{"http://localhost:5001",
+                                   "http://127.0.0.1:5001"},
+          options);
+      std::unique_ptr<ipfs::http::Transport> clone = balancer.Clone();
+
+      std::vector<std::stringstream> responses(6);
+      ipfs::test::FetchCompletions done(responses.size());
+      for (size_t i = 0; i < responses.size(); ++i) {
+        ipfs::http::Transport& transport = i % 2 == 0 ? balancer : *clone;
+        transport.FetchAsync("http://localhost:5001/api/v0/version", {},
+                             &responses[i], done(i));
+      }
+      for (size_t i = 0; i < responses.size(); ++i) {
+        done.Wait(i);
+        assert(!responses[i].str().empty());
+      }
+    }
+  }
+  {
+    /* test that a balancer can be destroyed with a request in flight, which
+     * then fails without failing over */
+    std::stringstream response;
+    ipfs::test::FetchCompletions done(1);
+    {
+      ipfs::http::TransportBalancer balancer(std::vector<std::string>{
+          "http://localhost:5001", "http://127.0.0.1:5001"});
+      /* File should not exist, takes forever (until time-out) */
+      balancer.FetchAsync(
+          "http://localhost:5001/api/v0/cat?arg="
+          "QmZp1rrtGTictR2rpNcx4673R7qU9Jdr9DQ6Z7F6Wgo2bQ",
+          {}, &response, done(0));
+    }
+    ipfs::test::must_fail("Destroyed TransportBalancer",
+                          [&]() { done.Wait(0); });
+  }
+  {
+    /* test that an answer with an error status does not fail over */
+    ipfs::http::TransportBalancer balancer(
+        std::vector<std::string>{"http://localhost:5001"});
+    ipfs::test::must_fail("TransportBalancer::Fetch()", [&]() {
+      std::stringstream response;
+      balancer.Fetch("http://localhost:5001/api/v0/nonexistent", {},
+                     &response);
+    });
+    assert(balancer.IsHealthy(0));
+
+    ipfs::test::must_fail("TransportBalancer::TransportBalancer()", []() {
+      ipfs::http::TransportBalancer empty(std::vector<std::string>{});
+    });
+  }
+
+  return 0;
+}
@@ -0,0 +1,222 @@
+/* Copyright (c) 2016-2023, The C++ IPFS client library developers
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#include <ipfs/client.h>
+#include <ipfs/http/transport-circuit-breaker.h>
+#include <ipfs/http/transport-curl.h>
+#include <ipfs/test/utils.h>
+
+#include <cassert>
+#include <chrono>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+/** @return Whether the circuit of an endpoint closes in time. */
+static bool closes_within(
+    /** [in] The circuit breaker. */
+    ipfs::http::TransportCircuitBreaker* breaker,
+    /** [in] Scheme, host and port of the endpoint. */
+    const std::string& endpoint,
+    /** [in] How long to wait for it. */
+    std::chrono::milliseconds time) {
+  const auto until = std::chrono::steady_clock::now() + time;
+  while (std::chrono::steady_clock::now() < until) {
+    if (!breaker->IsOpen(endpoint)) {
+      return true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+  return false;
+}
+
+int main(int, char**) {
+  {
+    /** [ipfs::http::TransportCircuitBreaker] */
+    ipfs::http::CircuitBreakerOptions options;
+    options.min_requests = 2;
+    options.open_time = std::chrono::milliseconds(60000);
+    /* Nothing listens on port 1. */
+    ipfs::http::TransportCircuitBreaker* breaker = nullptr;
+    ipfs::Client client = ipfs::test::client_with(
+        std::make_unique<ipfs::http::TransportCircuitBreaker>(
+            std::make_unique<ipfs::http::TransportCurl>(false), options),
+        &breaker, "127.0.0.1", 1);
+    for (int i = 0; i < 2; ++i) {
+      ipfs::test::must_fail("TransportCircuitBreaker::Fetch()", [&]() {
+        ipfs::Json version;
+        client.Version(&version);
+      });
+    }
+
+    /* Now the requests fail right away, without reaching the network. */
+    assert(breaker->IsOpen("http://127.0.0.1:1"));
+    try {
+      ipfs::Json version;
+      client.Version(&version);
+      assert(false);
+    } catch (const ipfs::http::CircuitOpenError& e) {
+      assert(e.Endpoint() == "http://127.0.0.1:1");
+    }
+    /** [ipfs::http::TransportCircuitBreaker] */
+
+    /* The asynchronous requests fail fast, too. */
+    std::stringstream response;
+    ipfs::test::must_fail("TransportCircuitBreaker::FetchAsync()", [&]() {
+      client
+          .FilesGetAsync(
+              "/ipfs/QmYwAPJzv5CZsnA625s3Xf2nemtYgPpHdWEz79ojWnPbdG/readme",
+              &response)
+          .get();
+    });
+  }
+  {
+    /* test that errors of a daemon that answers don't open the circuit, and
+     * that the circuits are per endpoint and shared with the copies */
+    ipfs::http::CircuitBreakerOptions options;
+    options.min_requests = 2;
+    ipfs::http::TransportCircuitBreaker breaker(
+        std::make_unique<ipfs::http::TransportCurl>(false), options);
+    std::unique_ptr<ipfs::http::Transport> clone = breaker.Clone();
+    for (int i = 0; i < 3; ++i) {
+      ipfs::test::must_fail("TransportCircuitBreaker::Fetch()", [&]() {
+        std::stringstream response;
+        clone->Fetch("http://localhost:5001/api/v0/nonexistent", {},
+                     &response);
+      });
+    }
+    assert(!breaker.IsOpen("http://localhost:5001"));
+
+    for (int i = 0; i < 2; ++i) {
+      ipfs::test::must_fail("TransportCircuitBreaker::Fetch()", [&]() {
+        std::stringstream response;
+        clone->Fetch("http://127.0.0.1:1/api/v0/version", {}, &response);
+      });
+    }
+    assert(breaker.IsOpen("http://127.0.0.1:1"));
+    assert(!breaker.IsOpen("http://localhost:5001"));
+
+    std::stringstream response;
+    breaker.Fetch("http://localhost:5001/api/v0/version", {}, &response);
+    assert(!response.str().empty());
+  }
+  {
+    /* test that slow requests open the circuit, and that a probe closes it
+     * once the daemon answers, but not while it doesn't */
+    ipfs::http::CircuitBreakerOptions options;
+    options.min_requests = 2;
+    options.failure_rate = 1;
+    options.slow_call_rate = 1;
+    /* Every request is slow. */
+    options.slow_call_duration = std::chrono::milliseconds(0);
+    options.open_time = std::chrono::milliseconds(100);
+    options.probe_interval = std::chrono::milliseconds(100);
+    ipfs::http::TransportCircuitBreaker* breaker = nullptr;
+    ipfs::Client client = ipfs::test::client_with(
+        std::make_unique<ipfs::http::TransportCircuitBreaker>(
+            std::make_unique<ipfs::http::TransportCurl>(false), options),
+        &breaker);
+    for (int i = 0; i < 2; ++i) {
+      ipfs::Json version;
+      client.Version(&version);
+    }
+    assert(breaker->IsOpen("http://localhost:5001"));
+    if (!closes_within(breaker, "http://localhost:5001",
+                       std::chrono::milliseconds(5000))) {
+      throw std::runtime_error(
+          "TransportCircuitBreaker: the probe did not close the circuit");
+    }
+    ipfs::Json version;
+    client.Version(&version);
+    assert(version.contains("Version"));
+
+    /* Nothing listens on port 1, so its probes fail. */
+    for (int i = 0; i < 2; ++i) {
+      ipfs::test::must_fail("TransportCircuitBreaker::Fetch()", [&]() {
+        std::stringstream response;
+        breaker->Fetch("http://127.0.0.1:1/api/v0/version", {}, &response);
+      });
+    }
+    assert(breaker->IsOpen("http://127.0.0.1:1"));
+    if (closes_within(breaker, "http://127.0.0.1:1",
+                      std::chrono::milliseconds(500))) {
+      throw std::runtime_error(
+          "TransportCircuitBreaker: a failed probe closed the circuit");
+    }
+  }
+  {
+    /* test that a request that runs into its deadline counts as slow, not
+     * as failed, and one whose deadline had passed before it was sent does
+     * not count */
+    ipfs::http::CircuitBreakerOptions options;
+    options.min_requests = 2;
+    options.failure_rate = 2; /* never */
+    options.slow_call_rate = 1;
+    ipfs::http::TransportCircuitBreaker breaker(
+        std::make_unique<ipfs::http::TransportCurl>(false), options);
+    auto fetch_until = [&](std::chrono::steady_clock::time_point deadline) {
+      ipfs::http::FetchOptions bounded;
+      bounded.deadline = deadline;
+      ipfs::test::must_fail("TransportCircuitBreaker::Fetch()", [&]() {
+        ipfs::http::CallbackSink sink([](const char*, size_t) { return true; });
+        /* File should not exist, takes forever (until time-out) */
+        breaker.Fetch(
+            "http://localhost:5001/api/v0/cat?arg="
+            "QmZp1rrtGTictR2rpNcx4673R7qU9Jdr9DQ6Z7F6Wgo2bQ",
+            {}, &sink, bounded);
+      });
+    };
+
+    for (int i = 0; i < 2; ++i) {
+      fetch_until(std::chrono::steady_clock::now());
+    }
+    if (breaker.IsOpen("http://localhost:5001")) {
+      throw std::runtime_error(
+          "TransportCircuitBreaker: requests past their deadline before they "
+          "were sent opened the circuit");
+    }
+
+    for (int i = 0; i < 2; ++i) {
+      fetch_until(std::chrono::steady_clock::now() +
+                  std::chrono::milliseconds(200));
+    }
+    assert(breaker.IsOpen("http://localhost:5001"));
+  }
+  {
+    /* test that a circuit breaker can be destroyed with a request in
+     * flight */
+    std::stringstream response;
+    ipfs::test::FetchCompletions done(1);
+    {
+      ipfs::http::TransportCircuitBreaker breaker(
+          std::make_unique<ipfs::http::TransportCurl>(false));
+      /* File should not exist, takes forever (until time-out) */
+      breaker.FetchAsync(
+          "http://localhost:5001/api/v0/cat?arg="
+          "QmZp1rrtGTictR2rpNcx4673R7qU9Jdr9DQ6Z7F6Wgo2bQ",
+          {}, &response, done(0));
+    }
+    ipfs::test::must_fail("Destroyed TransportCircuitBreaker",
+                          [&]() { done.Wait(0); });
+  }
+
+  return 0;
+}
@@ -0,0 +1,161 @@
+/* Copyright (c) 2016-2023, The C++ IPFS client library developers
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+#include <ipfs/client.h>
+#include <ipfs/http/transport-coalescer.h>
+#include <ipfs/http/transport-curl.h>
+#include <ipfs/test/utils.h>
+
+#include <cassert>
+#include <chrono>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+int main(int, char**) {
+  {
+    /** [ipfs::http::TransportCoalescer] */
+    ipfs::http::TransportCoalescer* coalescer = nullptr;
+    ipfs::Client client = ipfs::test::client_with(
+        std::make_unique<ipfs::http::TransportCoalescer>(
+            std::make_unique<ipfs::http::TransportCurl>(false)),
+        &coalescer);
+
+    /* The same read, many times at once: one request to the daemon. */
+    const std::string path =
+        "/ipfs/QmYwAPJzv5CZsnA625s3Xf2nemtYgPpHdWEz79ojWnPbdG/readme";
+    std::vector<std::stringstream> contents(8);
+    std::vector<ipfs::AsyncResult> results;
+    for (std::stringstream& c : contents) {
+      results.push_back(client.FilesGetAsync(path, &c));
+    }
+    for (ipfs::AsyncResult& result : results) {
+      result.get();
+    }
+    /** [ipfs::http::TransportCoalescer] */
+    for ([[maybe_unused]] std::stringstream& c : contents) {
+      assert(!c.str().empty());
+      assert(c.str() == contents.front().str());
+    }
+    assert(coalescer->CoalescedCount() > 0);
+
+    /* A copy has transfers of its own, and a synchronous read works the
+     * same. */
+    ipfs::Client copy(client);
+    std::stringstream again;
+    copy.FilesGet(path, &again);
+    assert(again.str() == contents.front().str());
+  }
+  {
+    /* test that a sink that wants no more only leaves the shared transfer */
+    ipfs::http::TransportCoalescer coalescer(
+        std::make_unique<ipfs::http::TransportCurl>(false));
+    ipfs::http::FetchOptions options;
+    options.idempotent = true;
+    const std::string url =
+        "http://localhost:5001/api/v0/cat?arg=%2Fipfs%2F"
+        "QmYwAPJzv5CZsnA625s3Xf2nemtYgPpHdWEz79ojWnPbdG%2Freadme";
+
+    std::string full;
+    size_t stopped_after = 0;
+    ipfs::http::CallbackSink full_sink([&full](const char* data, size_t size) {
+      full.append(data, size);
+      return true;
+    });
+    ipfs::http::CallbackSink stopping_sink(
+        [&stopped_after](const char*, size_t size) {
+          stopped_after += size;
+          return false;
+        });
+    ipfs::test::FetchCompletions done(2);
+    coalescer.FetchAsync(url, {}, &full_sink, options, done(0));
+    coalescer.FetchAsync(url, {}, &stopping_sink, options, done(1));
+    done.Wait(0);
+    done.Wait(1);
+    assert(!full.empty());
+    assert(stopped_after > 0 && stopped_after <= full.size());
+  }
+  {
+    /* test that a request keeps its own deadline in a transfer that may run
+     * past it */
+    ipfs::http::TransportCoalescer coalescer(
+        std::make_unique<ipfs::http::TransportCurl>(false));
+    const std::string url = "https://httpbin.org/delay/3";
+    ipfs::http::FetchOptions no_deadline;
+    no_deadline.idempotent = true;
+    ipfs::http::FetchOptions soon = no_deadline;
+    soon.deadline =
+        std::chrono::steady_clock::now() + std::chrono::milliseconds(300);
+
+    std::string leader_body;
+    std::string async_body;
+    std::string sync_body;
+    ipfs::http::StringSink leader_sink(&leader_body);
+    ipfs::http::StringSink async_sink(&async_body);
+    ipfs::http::StringSink sync_sink(&sync_body);
+    ipfs::test::FetchCompletions done(2);
+    const auto start = std::chrono::steady_clock::now();
+    coalescer.FetchAsync(url, {}, &leader_sink, no_deadline, done(0));
+    coalescer.FetchAsync(url, {}, &async_sink, soon, done(1));
+    ipfs::test::must_fail("TransportCoalescer::Fetch() past its deadline",
+                          [&]() {
+                            coalescer.Fetch(url, {}, &sync_sink, soon);
+                          });
+    ipfs::test::must_fail("TransportCoalescer::FetchAsync() past its deadline",
+                          [&]() { done.Wait(1); });
+    if (std::chrono::steady_clock::now() - start >= std::chrono::seconds(2)) {
+      throw std::runtime_error(
+          "TransportCoalescer: a request waited past its deadline");
+    }
+    if (coalescer.CoalescedCount() != 2) {
+      throw std::runtime_error(
+          "TransportCoalescer: the requests with a deadline did not join");
+    }
+
+    /* The transfer goes on for the request without a deadline. */
+    done.Wait(0);
+    assert(!leader_body.empty());
+
+    /* One with a deadline cannot be joined by one with a later deadline. */
+    ipfs::http::FetchOptions later = no_deadline;
+    later.deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds(20);
+    ipfs::http::FetchOptions latest = later;
+    *latest.deadline += std::chrono::seconds(10);
+    std::string first_body;
+    std::string second_body;
+    ipfs::http::StringSink first_sink(&first_body);
+    ipfs::http::StringSink second_sink(&second_body);
+    ipfs::test::FetchCompletions both(2);
+    coalescer.FetchAsync(url, {}, &first_sink, later, both(0));
+    coalescer.FetchAsync(url, {}, &second_sink, latest, both(1));
+    both.Wait(0);
+    both.Wait(1);
+    assert(!first_body.empty() && !second_body.empty());
+    if (coalescer.CoalescedCount() != 2) {
+      throw std::runtime_error(
+          "TransportCoalescer: a request joined a transfer that may end "
+          "before its deadline");
+    }
+  }
+
+  return 0;
+}
@@ -18,9 +18,196 @@ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
 CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
 
 #include <ipfs/http/transport-curl.h>
+#include <ipfs/test/utils.h>
 
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
 #include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+/** HTTP server on 127.0.0.1 that counts the requests, and answers each one
+ * from its own thread with whatever a function says. Every connection carries
+ * one request. */
+class TestServer {
+ public:
+  /** Answer to a request. */
+  struct Answer {
+    /** The whole response, status line and headers included. */
+    std::string response;
+
+    /** How long to wait before sending it. */
+    std::chrono::milliseconds delay{0};
+  };
+
+  /** Constructor, starts listening on a free port. */
+  explicit TestServer(
+      /** [in] Called with the number of the request, starting from 0. */
+      std::function<Answer(int request)> answer)
+      : answer_(std::move(answer)) {
+    listener_ = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    if (listener_ < 0 ||
+        bind(listener_, reinterpret_cast<sockaddr*>(&address), length) != 0 ||
+        listen(listener_, 16) != 0 ||
+        getsockname(listener_, reinterpret_cast<sockaddr*>(&address),
+                    &length) != 0) {
+      throw std::runtime_error("TestServer can't listen");
+    }
+    port_ = ntohs(address.sin_port);
+    acceptor_ = std::thread([this]() { Accept(); });
+  }
+
+  /** Destructor, waits for the answers that are still being sent. */
+  ~TestServer() {
+    stopped_ = true;
+    acceptor_.join();
+    close(listener_);
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (std::thread& connection : connections_) {
+      connection.join();
+    }
+  }
+
+  /** @return URL of the server with `path`. */
+  std::string Url(const std::string& path) const {
+    return "http://127.0.0.1:" + std::to_string(port_) + path;
+  }
+
+  /** @return Number of requests so far. */
+  int Requests() const { return requests_; }
+
+  /** @return Response with a status code and a body. */
+  static std::string Response(int status, const std::string& body) {
+    return "HTTP/1.1 " + std::to_string(status) +
+           " Test\r\nConnection: close\r\nContent-Length: " +
+           std::to_string(body.size()) + "\r\n\r\n" + body;
+  }
+
+ private:
+  /** Accept the connections until stopped. */
+  void Accept() {
+    while (!stopped_) {
+      pollfd fd = {listener_, POLLIN, 0};
+      if (poll(&fd, 1, 20) <= 0) {
+        continue;
+      }
+      const int connection = accept(listener_, nullptr, nullptr);
+      if (connection < 0) {
+        continue;
+      }
+      const int request = requests_++;
+      std::lock_guard<std::mutex> lock(mutex_);
+      connections_.emplace_back(
+          [this, connection, request]() { Serve(connection, request); });
+    }
+  }
+
+  /** Read a request and answer it. */
+  void Serve(
+      /** [in] Socket of the connection, closed when done. */
+      int connection,
+      /** [in] Number of the request. */
+      int request) {
+    std::string received;
+    char buffer[4096];
+    size_t header_end = std::string::npos;
+    size_t body_size = 0;
+    while (header_end == std::string::npos ||
+           received.size() < header_end + 4 + body_size) {
+      const ssize_t n = recv(connection, buffer, sizeof(buffer), 0);
+      if (n <= 0) {
+        break;
+      }
+      received.append(buffer, static_cast<size_t>(n));
+      if (header_end == std::string::npos) {
+        header_end = received.find("\r\n\r\n");
+        const size_t length = received.find("Content-Length: ");
+        if (header_end != std::string::npos && length < header_end) {
+          body_size = std::strtoul(received.c_str() + length + 16, nullptr, 10);
+        }
+      }
+    }
+
+    const Answer answer = answer_(request);
+    const auto due = std::chrono::steady_clock::now() + answer.delay;
+    while (!stopped_ && std::chrono::steady_clock::now() < due) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    send(connection, answer.response.data(), answer.response.size(),
+         MSG_NOSIGNAL);
+    close(connection);
+  }
+
+  /** Answers the requests. */
+  std::function<Answer(int request)> answer_;
+
+  /** Listening socket. */
+  int listener_ = -1;
+
+  /** Port that the server listens on. */
+  int port_ = 0;
+
+  /** Set by the destructor. */
+  std::atomic<bool> stopped_ = false;
+
+  /** Number of requests so far. */
+  std::atomic<int> requests_ = 0;
+
+  /** Accepts the connections. */
+  std::thread acceptor_;
+
+  /** Protects `connections_`. */
+  std::mutex mutex_;
+
+  /** Threads of the connections. */
+  std::vector<std::thread> connections_;
+};
+
+/** Run a fetch that must fail with an HTTP status code, or with no answer
+ * at all if it is 0. */
+static void expect_failure(
+    /** [in] Label to prefix in diagnostics. */
+    const std::string& label,
+    /** [in] The fetch. */
+    const std::function<void()>& fetch,
+    /** [in] The expected HTTP status code. */
+    long status_code) {
+  long got = -1;
+  try {
+    fetch();
+  } catch (const ipfs::http::HttpStatusError& e) {
+    got = e.StatusCode();
+  } catch (const std::exception&) {
+    got = 0;
+  }
+  if (got != status_code) {
+    throw std::runtime_error(label + " ended with " + std::to_string(got) +
+                             " instead of " + std::to_string(status_code));
+  }
+}
 
 int main(int, char**) {
   {
@@ -39,6 +226,205 @@ int main(int, char**) {
       assert(!response.str().empty());
     }
   }
+  /* test clone, which shares the connection state of the original */
+  {
+    ipfs::http::TransportCurl transportCurl(false);
+    std::stringstream response;
+    transportCurl.Fetch("https://httpbin.org/post", {}, &response);
+    assert(!response.str().empty());
+
+    std::unique_ptr<ipfs::http::Transport> clone = transportCurl.Clone();
+    std::stringstream clone_response;
+    clone->Fetch("https://httpbin.org/post", {}, &clone_response);
+    assert(!clone_response.str().empty());
+  }
+  /* test Unix domain socket, which is used for every request */
+  {
+    ipfs::http::TransportCurl transportCurl(false);
+    transportCurl.SetUnixSocketPath("/nonexistent/ipfs-api.sock");
+    ipfs::test::must_fail("TransportCurl::SetUnixSocketPath()", [&]() {
+      std::stringstream response;
+      transportCurl.Fetch("https://httpbin.org/post", {}, &response);
+    });
+    transportCurl.SetUnixSocketPath("");
+    std::stringstream response;
+    transportCurl.Fetch("https://httpbin.org/post", {}, &response);
+    assert(!response.str().empty());
+  }
+  /* test an external event loop, here a plain poll() loop */
+  {
+    /** [ipfs::http::TransportCurl::SetEventLoop] */
+    ipfs::http::TransportCurl transportCurl(false);
+    std::map<curl_socket_t, int> watched;
+    std::optional<std::chrono::steady_clock::time_point> deadline;
+    transportCurl.SetEventLoop(
+        {[&watched](curl_socket_t socket, int events) {
+           if (events == 0) {
+             watched.erase(socket);
+           } else {
+             watched[socket] = events;
+           }
+         },
+         [&deadline](long timeout_ms) {
+           if (timeout_ms < 0) {
+             deadline.reset();
+           } else {
+             deadline = std::chrono::steady_clock::now() +
+                        std::chrono::milliseconds(timeout_ms);
+           }
+         }});
+
+    bool done = false;
+    std::stringstream response;
+    transportCurl.FetchAsync("https://httpbin.org/post", {}, &response,
+                             [&done](std::exception_ptr) { done = true; });
+
+    while (!done) {
+      std::vector<pollfd> fds;
+      for (const auto& [socket, events] : watched) {
+        fds.push_back({socket,
+                       static_cast<short>(
+                           (events & ipfs::http::TransportCurl::kSocketRead
+                                ? POLLIN
+                                : 0) |
+                           (events & ipfs::http::TransportCurl::kSocketWrite
+                                ? POLLOUT
+                                : 0)),
+                       0});
+      }
+      int wait_ms = -1;
+      if (deadline) {
+        wait_ms = static_cast<int>(std::max<int64_t>(
+            0, std::chrono::duration_cast<std::chrono::milliseconds>(
+                   *deadline - std::chrono::steady_clock::now())
+                   .count()));
+      }
+      poll(fds.data(), fds.size(), wait_ms);
+      if (deadline && std::chrono::steady_clock::now() >= *deadline) {
+        deadline.reset();
+        transportCurl.OnTimeout();
+      }
+      for (const pollfd& fd : fds) {
+        if (fd.revents != 0) {
+          transportCurl.OnSocketEvent(
+              fd.fd,
+              (fd.revents & POLLIN ? ipfs::http::TransportCurl::kSocketRead
+                                   : 0) |
+                  (fd.revents & POLLOUT
+                       ? ipfs::http::TransportCurl::kSocketWrite
+                       : 0) |
+                  (fd.revents & (POLLERR | POLLHUP)
+                       ? ipfs::http::TransportCurl::kSocketError
+                       : 0));
+        }
+      }
+    }
+    /** [ipfs::http::TransportCurl::SetEventLoop] */
+    assert(!response.str().empty());
+  }
+  /* test that transient failures of idempotent fetches are retried, and that
+   * the others and the retries beyond the budget are not */
+  {
+    TestServer server([](int) {
+      return TestServer::Answer{TestServer::Response(503, "unavailable")};
+    });
+    ipfs::http::TransportCurl transportCurl(false);
+    ipfs::http::TransportCurl::RetryPolicy policy;
+    policy.max_attempts = 3;
+    policy.initial_backoff = std::chrono::milliseconds(20);
+    transportCurl.SetRetryPolicy(policy);
+    ipfs::http::FetchOptions options;
+    options.idempotent = true;
+    auto fetch = [&](const std::string& url) {
+      return [&transportCurl, &options, url]() {
+        std::string body;
+        ipfs::http::StringSink sink(&body);
+        transportCurl.Fetch(url, {}, &sink, options);
+      };
+    };
+
+    expect_failure("Retried fetch", fetch(server.Url("/retried")), 503);
+    assert(server.Requests() == 3);
+
+    options.idempotent = false;
+    expect_failure("Non-idempotent fetch", fetch(server.Url("/once")), 503);
+    assert(server.Requests() == 4);
+
+    /* With a budget of a single retry, a failed non-idempotent fetch leaves
+     * it alone, the next fetch uses it up and the one after that can't
+     * retry. */
+    policy.budget_max = 1;
+    policy.budget_ratio = 0;
+    transportCurl.SetRetryPolicy(policy);
+    expect_failure("Non-idempotent fetch", fetch("http://127.0.0.1:1/"), 0);
+    options.idempotent = true;
+    expect_failure("Fetch with budget", fetch(server.Url("/budget")), 503);
+    assert(server.Requests() == 6);
+    expect_failure("Fetch without budget", fetch(server.Url("/none")), 503);
+    assert(server.Requests() == 7);
+
+    /* A server that keeps answering 503 fails the fetch in the end. */
+    policy.budget_max = 10;
+    transportCurl.SetRetryPolicy(policy);
+    expect_failure("TransportCurl::Fetch()",
+                   fetch("https://httpbin.org/status/503"), 503);
+  }
+  /* test that a read that stalls is hedged, and that only the body of the
+   * faster copy reaches the sink */
+  {
+    TestServer server([](int request) {
+      return request == 0
+                 ? TestServer::Answer{TestServer::Response(200, "slow"),
+                                      std::chrono::milliseconds(3000)}
+                 : TestServer::Answer{TestServer::Response(200, "fast")};
+    });
+    ipfs::http::TransportCurl transportCurl(false);
+    ipfs::http::TransportCurl::HedgePolicy policy;
+    policy.percentile = 0.95;
+    policy.initial_delay = std::chrono::milliseconds(50);
+    policy.min_delay = std::chrono::milliseconds(5);
+    transportCurl.SetHedgePolicy(policy);
+    ipfs::http::FetchOptions options;
+    options.idempotent = true;
+
+    const auto start = std::chrono::steady_clock::now();
+    std::string body;
+    ipfs::http::StringSink sink(&body);
+    transportCurl.Fetch(server.Url("/hedged"), {}, &sink, options);
+    assert(body == "fast");
+    assert(server.Requests() == 2);
+    if (std::chrono::steady_clock::now() - start >=
+        std::chrono::milliseconds(3000)) {
+      throw std::runtime_error(
+          "TransportCurl: the hedged fetch waited for its slow copy");
+    }
+
+    /* Both copies are slow here, either one may win. */
+    std::string delayed;
+    ipfs::http::StringSink delayed_sink(&delayed);
+    transportCurl.Fetch("https://httpbin.org/delay/3", {}, &delayed_sink,
+                        options);
+    /* Exactly one JSON document, the bodies of the copies are not mixed. */
+    assert(nlohmann::json::accept(delayed));
+  }
+  /* test that a string sink has its extra capacity also after a body of no
+   * announced size */
+  {
+    TestServer server([](int) {
+      return TestServer::Answer{
+          "HTTP/1.1 200 Test\r\nConnection: close\r\n"
+          "Transfer-Encoding: chunked\r\n\r\n"
+          "6\r\nchunk \r\n5\r\nsized\r\n0\r\n\r\n"};
+    });
+    ipfs::http::TransportCurl transportCurl(false);
+    std::string body;
+    ipfs::http::StringSink sink(&body, 64);
+    transportCurl.Fetch(server.Url("/chunked"), {}, &sink, {});
+    if (body != "chunk sized" || body.capacity() - body.size() < 64) {
+      throw std::runtime_error(
+          "StringSink: a chunked body came without the extra capacity");
+    }
+  }
   /* test move assignment to other object */
   {
     ipfs::http::TransportCurl transportCurl(false);